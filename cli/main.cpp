@@ -3,13 +3,11 @@
 #include <string>
 
 int main() {
-    std::string line, out;
+    std::string line;
     std::cout << "tinydb CLI\n";
+    auto print = [](const char* data, size_t n, void*) { std::cout.write(data, static_cast<std::streamsize>(n)); };
     while (std::cout << "tinydb> " && std::getline(std::cin, line)) {
-        out.clear();
-        int rc = tinydb_process_line(line, out);
-        if (!out.empty()) std::cout << out;
-        if (rc != 0) break;
+        if (tinydb_process_line_stream(line, print, nullptr) != 0) break;
     }
     return 0;
 }
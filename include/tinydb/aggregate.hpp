@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "tinydb/record.hpp"
+
+namespace tinydb {
+
+// Aggregate functions as the AggReset op lists them, one byte each.
+// CountAll is COUNT(*); the others skip NULL arguments.
+enum class AggOp : uint8_t { CountAll, Count, Sum, Min, Max, Avg };
+
+// Bump allocator: hands out pieces of large blocks and frees them all at
+// once. reset() keeps the first block for the next round.
+class Arena {
+public:
+    void* alloc(size_t n, size_t align);
+    std::string_view copy(std::string_view s);
+    void reset();
+private:
+    static constexpr size_t BLOCK = 64 * 1024;
+    struct Block { std::unique_ptr<char[]> data; size_t size; };
+    std::vector<Block> blocks_;
+    size_t used_{0}; // bytes taken from the last block
+};
+
+// Hash aggregation for GROUP BY. Groups are found through an
+// open-addressing table (linear probing, at most half full) keyed by the
+// group's values encoded as by append_key(), so INT 2 and REAL 2.0 fall
+// in one group. Keys and running totals live in an Arena, and groups come
+// back in the order they first appeared. Without key columns there is
+// exactly one group even over no rows: COUNT(*) of an empty table is 0.
+class HashAggregate {
+public:
+    // Start over with `nkeys` key columns and one aggregate per byte
+    // (an AggOp) of `ops`.
+    void reset(size_t nkeys, std::string_view ops);
+    // Fold in a row given as its key values, then one argument per
+    // aggregate (not read for CountAll). False if an INT SUM overflows.
+    bool step(const Value* in);
+    size_t groups() const { return groups_.size(); }
+    // Key values of group g, then the result of each aggregate, into
+    // out[0, nkeys + aggregates). TEXT is borrowed until reset().
+    void result(size_t g, Value* out) const;
+private:
+    // Running state of one aggregate of one group.
+    struct Acc {
+        ColTag tag{ColTag::NIL}; // Sum/Avg: INT until it must be REAL; Min/Max: held value's type
+        int64_t n{0};            // rows counted
+        int64_t i{0};
+        double r{0.0};
+        std::string_view text;   // Min/Max TEXT and BLOB, in the arena
+    };
+    struct Group {
+        uint64_t hash;
+        std::string_view entry; // values, type bytes and a zero rowid
+        size_t vlen;            // length of the values part
+        Acc* acc;
+    };
+    Group& find(const Value* keys);
+    void grow();
+
+    size_t nkeys_{0};
+    std::string ops_;
+    Arena arena_;
+    std::vector<Group> groups_;
+    std::vector<uint32_t> slots_; // group index + 1; 0 is free
+    std::string key_;             // the key being looked up
+};
+
+} // namespace tinydb
@@ -1,3 +1,20 @@
 #pragma once
-// Placeholder for shared AST helpers if needed later.
+#include <vector>
+#include "tinydb/parser.hpp"
 
+namespace tinydb {
+
+// Inclusive rowid bounds from a WHERE clause; a missing side is unbounded.
+// A side with a parameter index (1-based) is that parameter plus lo/hi.
+struct RowidRange { bool has_lo=false, has_hi=false; long long lo=0, hi=0; int lo_param=0, hi_param=0; };
+
+// Fold the comparisons of rowid with an integer or placeholder among the
+// top-level AND terms of `where` into a range the tree can seek to. Every
+// other term, including bounds that cannot be folded (a second placeholder
+// on one side), is appended to `rest` to be checked row by row.
+RowidRange rowid_range(const Expr* where, std::vector<const Expr*>& rest);
+
+// True if `name` is the rowid alias, in any case.
+bool is_rowid(const std::string& name);
+
+} // namespace tinydb
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "tinydb/btree.hpp"
+#include "tinydb/record.hpp"
+
+namespace tinydb {
+
+constexpr size_t BATCH_ROWS = 1024;
+
+// Column vectors for up to BATCH_ROWS rows of one leaf. Column c of row k
+// is at [c * BATCH_ROWS + k], so a loop over one column walks plain
+// arrays of one type. TEXT and BLOB borrow from the leaf, which the scan
+// cursor keeps pinned, or from spill_ for rows continued on overflow
+// pages; either way they stay valid until the next load().
+class Batch {
+public:
+    static constexpr size_t ALL = SIZE_MAX;
+    // Decode columns [0, ncols) (ALL: every column of each row) of the
+    // rows from the cursor to the end of its leaf. The cursor is left on
+    // the last of them. Returns the number of rows.
+    size_t load(BTree& bt, Cursor& c, size_t ncols);
+    void clear() { n_ = 0; }
+    size_t rows() const { return n_; }
+    // Columns held for row k; with ALL, that row's own width.
+    size_t width(size_t k) const { return width_[k]; }
+    int64_t key(size_t k) const { return keys_[k]; }
+    const ColTag* tags(size_t col) const { return tag_.data() + col * BATCH_ROWS; }
+    const int64_t* ints(size_t col) const { return i_.data() + col * BATCH_ROWS; }
+    const double* reals(size_t col) const { return r_.data() + col * BATCH_ROWS; }
+    // Copy column `from` of every row to column `to`, growing the batch.
+    void copy_column(size_t from, size_t to);
+    // Column `col` of row k into `out`, TEXT borrowed.
+    void get(size_t col, size_t k, Value& out) const;
+private:
+    bool decode(size_t k, std::string_view payload, size_t ncols, bool whole);
+    void reserve_columns(size_t ncols);
+
+    size_t n_{0};
+    size_t cap_cols_{0};
+    std::vector<CellView> cells_;
+    std::vector<int64_t> keys_;
+    std::vector<uint32_t> width_;
+    std::vector<ColTag> tag_;
+    std::vector<int64_t> i_;
+    std::vector<double> r_;
+    std::vector<std::string_view> text_;
+    std::vector<std::string> spill_; // by row; never resized once made
+};
+
+} // namespace tinydb
@@ -1,35 +1,121 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include "tinydb/pager.hpp"
 
 namespace tinydb {
 
 struct Key { int64_t rowid{0}; };
 
+// Longest index key; four of them fit in a page, so a split always has
+// room for both halves.
+constexpr size_t MAX_INDEX_KEY = 1000;
+
+// A position in a tree. A positioned cursor pins its leaf in the buffer
+// pool, or reads it from the storage's mapping when it is not resident,
+// so payload views it hands out stay valid until it moves; cursors are
+// therefore move-only and must not outlive the pager.
 class Cursor {
 public:
     uint32_t root{0};
     uint32_t pgno{0};
     int idx{0};
+    bool skip_next{false}; // already on the successor of an erased row
+    PageRef page;          // pin on leaf `pgno`, unless it is mapped
+    std::string spill;     // an overflowing payload, reassembled
+};
+
+// One row of a leaf as seen by BTree::leaf_run: the payload bytes kept in
+// the leaf and, when it continues on overflow pages, the first of them.
+struct CellView {
+    int64_t key{0};
+    std::string_view local;
+    size_t total{0};
+    uint32_t overflow{0};
 };
 
+// Produces the next (key, payload) pair for bulk_load; false when done.
+using RowSource = std::function<bool(Key& k, std::string& payload)>;
+
 class BTree {
 public:
     explicit BTree(Pager& p);
     Pager& pager() { return pager_; }
     uint32_t create_table();
     void insert(uint32_t root, Key k, std::string_view payload);
+    // Build an empty tree bottom-up from rows in strictly increasing key
+    // order, packing pages to `fill` (at most 1) of their size. Returns
+    // false if the tree already has rows. Throws std::runtime_error on a
+    // key out of order (or whatever `next` throws), after freeing every
+    // page taken so far: the tree is left empty.
+    bool bulk_load(uint32_t root, const RowSource& next, double fill = 0.9);
     Cursor open(uint32_t root);
     bool seek(Cursor& c, int64_t key);
+    // Position on the largest key; false if the tree is empty.
+    bool last(Cursor& c);
     bool next(Cursor& c);
-    std::string_view read_payload(const Cursor& c);
+    // True if the cursor is on a row (not past the end).
+    bool valid(const Cursor& c);
+    // Remove one key; false if it was absent.
+    bool erase(uint32_t root, int64_t key);
+    // Remove the row under the cursor. The following next() lands on the
+    // row after it.
+    void erase(Cursor& c);
+    // Remove every key in [lo, hi] and return how many rows went. Subtrees
+    // entirely inside the range are freed without visiting their rows;
+    // pages left underfull are merged with or refilled from a sibling.
+    uint64_t erase_range(uint32_t root, int64_t lo, int64_t hi);
+    // Payload of the current cell, truncated to `limit` bytes; valid until
+    // the cursor moves. Payloads stored whole in the leaf are returned
+    // without copying. Overflow pages past the limit are never read.
+    std::string_view read_payload(Cursor& c, size_t limit = SIZE_MAX);
+    // The part of the payload stored in the leaf itself, without copying.
+    std::string_view local_payload(Cursor& c);
+    size_t payload_size(const Cursor& c);
+    // Views of up to `max` rows from the cursor to the end of its leaf,
+    // written to `out`; returns how many. The cursor is left on the last
+    // of them, so next() continues after it. Views live until it moves.
+    size_t leaf_run(Cursor& c, CellView* out, size_t max);
+    // The whole payload of `cell`, overflow pages included, into `out`.
+    void read_overflow(const CellView& cell, std::string& out);
     int64_t key(const Cursor& c);
+    // Number of rows, summed from each leaf's cell count: no cell is read.
+    uint64_t count(uint32_t root);
     bool check(uint32_t root);
+
+    // Index trees: B+trees of unique byte-string keys in memcmp order,
+    // without payloads (see append_key() for how entries are built).
+    // Pages are not merged, but a leaf emptied by erases leaves the chain
+    // and goes back to the free list.
+    uint32_t create_index();
+    // Add `key`, at most MAX_INDEX_KEY bytes; false if it is present.
+    bool index_insert(uint32_t root, std::string_view key);
+    // Remove `key`; false if it was absent.
+    bool index_erase(uint32_t root, std::string_view key);
+    // Position on the first key >= `key`; false if there is none.
+    bool index_seek(Cursor& c, std::string_view key);
+    bool index_next(Cursor& c);
+    // The key under the cursor, empty past the end; valid until it moves.
+    std::string_view index_key(Cursor& c);
+    bool index_check(uint32_t root);
+    // Drop cached page hints, e.g. after the pager rolled pages back.
+    void forget_hints() { append_hints_.clear(); }
 private:
+    // The leaf the cursor is on, pinned (dropping any previous pin) unless
+    // it is read straight from the storage's mapping.
+    const uint8_t* pin(Cursor& c);
+    const uint8_t* leaf_of(const Cursor& c);
+    // Append overflow chain bytes from `pgno` on until `out` holds `want`.
+    void append_overflow(uint32_t pgno, size_t want, std::string& out);
+
     Pager& pager_;
-    std::string tmp_;
+    std::string cell_; // encoded body of the cell being inserted
+    // root -> page number of that tree's rightmost leaf, revalidated on use.
+    std::unordered_map<uint32_t, uint32_t> append_hints_;
 };
 
 } // namespace tinydb
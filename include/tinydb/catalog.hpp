@@ -2,30 +2,55 @@
 #include <cstdint>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace tinydb {
 
 class Pager;
 class BTree;
 
+// A secondary index: one entry per row of its table, built from the
+// row's values in `cols` (positions in the table) by append_key().
+struct IndexInfo {
+    std::string name;
+    uint32_t root{0};
+    std::vector<int> cols;
+};
+
 struct TableInfo {
     std::string name;
     uint32_t root{0};
+    std::vector<std::string> cols; // empty for tables created without names
+    std::vector<IndexInfo> indexes;
+    // Position of column `name`, or -1.
+    int column(const std::string& name) const;
 };
 
 class Catalog {
 public:
     Catalog() = default;
     Catalog(Pager& pager, BTree& bt);
-    bool create_table(const std::string& name, uint32_t root);
-    uint32_t create_table(const std::string& name);
+    // Re-read the schema table, e.g. after a rollback.
+    void reload();
+    bool create_table(const std::string& name, uint32_t root,
+                      const std::vector<std::string>& cols = {});
+    uint32_t create_table(const std::string& name, const std::vector<std::string>& cols = {});
+    // Index `name` on columns `cols` of `table`, filled from the rows it
+    // already has. Returns its root, or 0 if the name is taken, the table
+    // or a column is unknown, or a row's entry would be too long.
+    uint32_t create_index(const std::string& name, const std::string& table,
+                          const std::vector<std::string>& cols);
     const TableInfo* lookup(const std::string& name) const;
     const std::unordered_map<std::string, TableInfo>& tables() const { return tables_; }
+    // Changes whenever the set of tables or indexes may have; compiled
+    // programs from an older version can refer to stale roots.
+    uint64_t version() const { return version_; }
 private:
     Pager* pager_{nullptr};
     BTree* btree_{nullptr};
     uint32_t schema_root_{0};
     int64_t next_rowid_{1};
+    uint64_t version_{0};
     std::unordered_map<std::string, TableInfo> tables_;
 };
 
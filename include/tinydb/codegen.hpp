@@ -7,7 +7,7 @@
 
 namespace tinydb {
 
-std::vector<Instr> codegen(const ASTNode& ast, const Catalog& cat);
+Program codegen(const ASTNode& ast, const Catalog& cat);
 
 } // namespace tinydb
 
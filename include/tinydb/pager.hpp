@@ -1,8 +1,11 @@
 #pragma once
 #include <array>
+#include <cstddef>
 #include <cstdint>
+#include <list>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 #include "tinydb/storage.hpp"
 
 namespace tinydb {
@@ -13,25 +16,123 @@ namespace tinydb {
 #endif
 constexpr uint32_t PAGE_SIZE = 4096;
 constexpr uint32_t HEADER_PGNO = 1;
+constexpr size_t DEFAULT_POOL_FRAMES = 1024; // 4 MiB of page frames
 
 struct Page {
     uint32_t no{};
     std::array<uint8_t, PAGE_SIZE> data{};
     bool dirty{false};
+    uint32_t pins{0};
 };
 
+class Pager;
+class Wal;
+
+// RAII pin on a buffer pool frame. While a PageRef is alive the page
+// cannot be chosen as an eviction victim.
+class PageRef {
+public:
+    PageRef() = default;
+    PageRef(Pager& pager, Page& page);
+    PageRef(const PageRef&) = delete;
+    PageRef& operator=(const PageRef&) = delete;
+    PageRef(PageRef&& o) noexcept;
+    PageRef& operator=(PageRef&& o) noexcept;
+    ~PageRef() { reset(); }
+    void reset();
+    Page* get() const { return page_; }
+    Page& operator*() const { return *page_; }
+    Page* operator->() const { return page_; }
+    explicit operator bool() const { return page_ != nullptr; }
+private:
+    Pager* pager_{nullptr};
+    Page* page_{nullptr};
+};
+
+// Fixed-capacity buffer pool using the 2Q replacement policy: pages seen
+// once live in a FIFO (a1in_) so a large scan cannot flush the hot set
+// kept in the LRU list (am_). Pages evicted from a1in_ are remembered in
+// a ghost list (a1out_); a miss that hits the ghost list is promoted
+// straight into am_. Dirty victims are written back before reuse.
 class Pager {
 public:
-    explicit Pager(std::unique_ptr<IStorage> s);
+    // With `wal`, commits append page images to that log instead of
+    // overwriting the database file, which only changes at checkpoints.
+    explicit Pager(std::unique_ptr<IStorage> s, size_t frames = DEFAULT_POOL_FRAMES,
+                   std::unique_ptr<IStorage> wal = nullptr);
+    ~Pager();
+    Pager(const Pager&) = delete;
+    Pager& operator=(const Pager&) = delete;
+    // Returned reference is only guaranteed resident until the next call
+    // that may load a page; pin (or use acquire) to hold it longer.
     Page& get(uint32_t pgno);
-    uint32_t alloc();
+    PageRef acquire(uint32_t pgno) { return PageRef(*this, get(pgno)); }
+    // Read-only bytes of a page. Pages that are not resident are served
+    // straight from the storage's mapping when it has one, without taking
+    // a frame or copying; otherwise this is get(). Do not write through it.
+    const uint8_t* view(uint32_t pgno);
+    // As view(), for bytes that must outlast later loads: a page that is
+    // resident, or cannot be mapped, comes back pinned in `pin`; a mapped
+    // one leaves `pin` empty.
+    const uint8_t* view(uint32_t pgno, PageRef& pin);
+    // New zeroed page. Reuses a free-list page when there is one, picking
+    // the one numerically closest to `near` (e.g. the parent) if given.
+    uint32_t alloc(uint32_t near = 0);
+    // Return a page to the persistent free list.
+    void free(uint32_t pgno);
+    uint32_t free_count();
     void mark_dirty(Page&);
+    void pin(Page& p) { ++p.pins; }
+    void unpin(Page& p) { if (p.pins) --p.pins; }
+    // Make every dirty page durable: in WAL mode as one commit, else by
+    // writing the pages in place. Ends any open transaction.
     void flush();
+    // Explicit transactions: between begin() and flush() nothing is
+    // committed; rollback() returns every page to its state at begin().
+    void begin();
+    void rollback();
+    bool in_transaction() const { return in_txn_; }
+    // Copy committed WAL frames into the database file (no-op without WAL).
+    void checkpoint();
+    size_t capacity() const { return capacity_; }
+    size_t resident() const { return table_.size(); }
+    // Resident pages currently pinned (the header page always is).
+    size_t pinned() const;
 private:
+    enum class Queue : uint8_t { None, A1in, Am };
+    struct Frame {
+        std::unique_ptr<Page> page;
+        Queue queue{Queue::None};
+        std::list<size_t>::iterator pos;
+    };
+    size_t grab_frame(uint32_t pgno);
+    const uint8_t* mapped(uint32_t pgno);
+    bool evict_from(std::list<size_t>& q, size_t& out);
+    void remember_ghost(uint32_t pgno);
+    uint32_t take_free(uint32_t near);
+    void read_page(Page& p);
+    void write_back(Page& p);
+    void commit_wal(std::vector<Page*>& dirty);
+    void drop_frames();
+
     std::unique_ptr<IStorage> storage_;
-    std::unordered_map<uint32_t, std::unique_ptr<Page>> cache_;
+    std::unique_ptr<Wal> wal_;
+    size_t capacity_;
+    size_t kin_;   // target size of a1in_
+    size_t kout_;  // max size of the ghost list
+    std::vector<Frame> frames_;
+    std::vector<size_t> free_frames_;
+    std::unordered_map<uint32_t, size_t> table_;
+    std::list<size_t> a1in_;
+    std::list<size_t> am_;
+    std::list<uint32_t> a1out_;
+    std::unordered_map<uint32_t, std::list<uint32_t>::iterator> ghosts_;
     uint32_t next_pgno_{2};
+    bool in_txn_{false};
+    uint32_t txn_next_pgno_{0};
+    // Without a WAL, committed images of pages dirtied in the open
+    // transaction; evicted pages may already have overwritten the file.
+    std::unordered_map<uint32_t, std::array<uint8_t, PAGE_SIZE>> undo_;
 };
 
 } // namespace tinydb
-
@@ -5,10 +5,44 @@
 
 namespace tinydb {
 
-struct ASTNode { virtual ~ASTNode() = default; };
+struct ASTNode {
+    virtual ~ASTNode() = default;
+    // Placeholder names by index - 1 ("" for ?); in values they read "?N".
+    std::vector<std::string> params;
+};
+// One side of a comparison: a column name, or a literal as parse_value()
+// keeps it ('text', NULL, a number) or a "?N" placeholder.
+struct Operand { bool column=false; std::string text; };
+// WHERE clause tree. The parser puts a column on the left of a comparison
+// whenever either side is one, and reads x BETWEEN a AND b as x >= a AND x <= b.
+struct Expr {
+    enum Kind { Cmp, And, Or } kind{Cmp};
+    enum CmpOp { EQ, NE, LT, LE, GT, GE } op{EQ};
+    Operand lhs, rhs;                  // Cmp
+    std::unique_ptr<Expr> left, right; // And, Or
+};
 struct ASTCreate : ASTNode { std::string table; std::vector<std::pair<std::string,std::string>> cols; };
+struct ASTCreateIndex : ASTNode { std::string name, table; std::vector<std::string> cols; };
 struct ASTInsert : ASTNode { std::string table; std::vector<std::string> values; };
-struct ASTSelect : ASTNode { std::string table; std::vector<std::string> cols; bool where_rowid=false; long long rowid=0; };
+// Aggregate function of a select-list item; None for a plain column.
+enum class AggFn { None, Count, Sum, Min, Max, Avg };
+// cols is the select list, or "*" alone for every column. If any item is
+// an aggregate, aggs holds each item's function and cols[i] its argument
+// ("*" for COUNT(*)); otherwise aggs is empty. An ORDER BY term is a
+// column or a 1-based select-list position, and whether it is DESC.
+// limit and offset are parse_value() text, empty if not given.
+struct ASTSelect : ASTNode {
+    std::string table;
+    std::vector<std::string> cols;
+    std::vector<AggFn> aggs;
+    std::vector<std::string> group_by;
+    std::vector<std::pair<std::string, bool>> order_by;
+    std::string limit, offset;
+    std::unique_ptr<Expr> where;
+};
+struct ASTDelete : ASTNode { std::string table; std::unique_ptr<Expr> where; };
+struct ASTUpdate : ASTNode { std::string table; std::vector<std::pair<std::string,std::string>> sets; std::unique_ptr<Expr> where; };
+struct ASTTransaction : ASTNode { enum Kind { Begin, Commit, Rollback } kind{Begin}; };
 
 std::unique_ptr<ASTNode> parse(const std::string& sql);
 
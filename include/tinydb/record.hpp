@@ -6,16 +6,101 @@
 
 namespace tinydb {
 
-enum class ColTag : uint8_t { INT = 0, TEXT = 1 };
+// NIL is SQL NULL.
+enum class ColTag : uint8_t { INT = 0, TEXT = 1, REAL = 2, BLOB = 3, NIL = 4 };
 
 struct Value {
     ColTag tag{ColTag::INT};
     int64_t i{0};
-    std::string s{};
+    std::string s{}; // TEXT or BLOB bytes
+    // TEXT/BLOB borrowed from row bytes instead of owned in `s`; valid only
+    // as long as those bytes are (for VM registers: until the cursor moves).
+    std::string_view ref{};
+    double r{0.0};
+    std::string_view text() const { return ref.empty() ? std::string_view(s) : ref; }
 };
 
+// Rows are a header followed by a body, as in SQLite: the header is its
+// own size (varint) and then one serial type (varint) per column:
+//   0 NULL; 1..6 INT in 1, 2, 3, 4, 6 or 8 bytes; 7 REAL (8 bytes);
+//   8, 9 the INT constants 0 and 1 (no body bytes);
+//   N >= 12 even: BLOB of (N-12)/2 bytes; N >= 13 odd: TEXT of (N-13)/2.
+// Integers are zigzag-encoded and stored little-endian in the narrowest
+// width that holds them, so small negative values stay small. A column's
+// offset follows from the serial types before it alone.
+
+// Order of two values as in SQLite: NULL, then numbers (INT and REAL by
+// value), then TEXT, then BLOB, both bytewise. Negative, zero or positive.
+int compare_values(const Value& a, const Value& b);
+
+// Index keys: values encoded so that comparing keys bytewise (memcmp)
+// orders them column by column as compare_values() would. Each value is
+// a class byte (NULL < number < TEXT < BLOB) and then, for a number, its
+// floor as a big-endian biased integer and its fraction; for TEXT and
+// BLOB the bytes with 00 escaped as 00 FF, closed by 00 01. A number's
+// encoding does not depend on its type, so INT 2 and REAL 2.0 meet the
+// same seek. A full index entry follows the values with one type byte
+// per column and then the rowid, which makes it unique:
+//   value... | tag... | rowid (8 bytes)
+// Append the encoding of `v` to `out`.
+void append_key(const Value& v, std::string& out);
+// Complete an entry whose n values were appended to `out`.
+void finish_key(const Value* cols, size_t n, int64_t rowid, std::string& out);
+// Column `col` of an entry of `ncols` columns; TEXT and BLOB that need no
+// unescaping are views into `key`. False if the entry is malformed.
+bool key_column(std::string_view key, size_t ncols, size_t col, Value& out);
+int64_t key_rowid(std::string_view key);
+
+// Encoded length of a row of n columns.
+size_t row_size(const Value* cols, size_t n);
+// Encode into `out`, replacing its contents; reusing one buffer across
+// rows avoids allocating once its capacity has grown to the widest row.
+void encode_row(const Value* cols, size_t n, std::string& out);
 std::vector<uint8_t> encode_row(const std::vector<Value>& cols);
 std::vector<Value>   decode_row(const uint8_t* p, size_t n);
+// Column-major destination for decode_columns(): column c of the row
+// goes to index c * stride of each array.
+struct ColumnSink {
+    ColTag* tag;
+    int64_t* i;
+    double* r;
+    std::string_view* text;
+    size_t stride;
+};
+// Number of columns of the row in p[0, n); SIZE_MAX if its header does
+// not fit in those bytes.
+size_t row_columns(const uint8_t* p, size_t n);
+// Decode columns [0, ncols) of the row in p[0, n) in one pass, TEXT and
+// BLOB as views into p; columns past the row's end read as the default
+// value. False if the bytes end before column ncols - 1 does.
+bool decode_columns(const uint8_t* p, size_t n, size_t ncols, const ColumnSink& out);
+// Random access to the columns of one encoded row. Column offsets are
+// found on demand, walking only as far as the highest column asked for,
+// and kept for later reads of the same row.
+class RowDecoder {
+public:
+    // Index the row in p[0, n), which may be just a prefix of it.
+    void reset(const uint8_t* p, size_t n);
+    // Decode column `col` into `out`, TEXT as a view into the row bytes.
+    // A column past the row's end reads as the default value. Returns
+    // false if the indexed bytes end before the column does; need() is
+    // then the prefix length that would suffice (SIZE_MAX if unknown).
+    bool get(size_t col, Value& out);
+    size_t columns() const { return ncols_; }
+    size_t need() const { return need_; }
+private:
+    bool index_to(size_t col);
+
+    const uint8_t* p_{nullptr};
+    size_t n_{0};
+    size_t ncols_{0};
+    size_t need_{0};
+    size_t hdr_{0};   // header size, i.e. offset of the first column's body
+    size_t next_{0};  // offset of the next serial type not yet indexed
+    bool truncated_{false};
+    std::vector<uint64_t> types_; // serial type of each indexed column
+    std::vector<uint32_t> off_;   // body offset of each indexed column
+};
 
 } // namespace tinydb
 
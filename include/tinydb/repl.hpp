@@ -1,8 +1,16 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
 
 // Process a single REPL line. Appends any output (including newlines)
 // to `out` and returns 0 on success. Non-zero return indicates the
 // caller should terminate (e.g. on ".quit").
 extern "C" int tinydb_process_line(const std::string& line, std::string& out);
+
+// Receives output in pieces as it is produced.
+typedef void (*tinydb_output_fn)(const char* data, size_t n, void* ctx);
+
+// As tinydb_process_line, but query results are handed to `emit` in
+// chunks while the statement runs instead of being collected first.
+extern "C" int tinydb_process_line_stream(const std::string& line, tinydb_output_fn emit, void* ctx);
@@ -0,0 +1,94 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "tinydb/storage.hpp"
+
+namespace tinydb {
+
+// Makes the temporary storage a sort spills its runs to.
+using TempStorageFn = std::function<std::unique_ptr<IStorage>()>;
+
+constexpr size_t DEFAULT_SORT_MEMORY = size_t{16} << 20;
+// Smallest budget a sort takes: a merge needs a read-ahead buffer per run
+// and one for its output, so less would merge two runs at a time.
+constexpr size_t MIN_SORT_MEMORY = size_t{256} << 10;
+
+// Sorts records of a key, compared bytewise (keys are built with
+// append_key()), and a row carried along. Records with equal keys come
+// back in the order they were added. Records are packed in one buffer
+// that never grows past the memory budget: once it is full it is sorted
+// and written to temporary storage as a run, and sort() merges the runs
+// back, at most as many at a time as their read buffers and one for the
+// merged output fit in the budget. With a limit only that many smallest
+// records are kept, in a heap, until the heap itself outgrows the budget
+// and the sort goes on as above.
+class Sorter {
+public:
+    Sorter();
+    // At least MIN_SORT_MEMORY.
+    void set_memory(size_t bytes) { memory_ = std::max(bytes, MIN_SORT_MEMORY); }
+    void set_temp_storage(TempStorageFn make) { make_temp_ = std::move(make); }
+    // Drop every record, and the temporary storage; keep at most `limit`
+    // of the next ones (SIZE_MAX: all).
+    void reset(size_t limit = SIZE_MAX);
+    void add(std::string_view key, std::string_view row);
+    // Done adding: land on the first record; false if there is none.
+    bool sort();
+    // Step to the next record; false past the last one.
+    bool next();
+    // Row of the current record, valid until next().
+    std::string_view row() const;
+    // Runs written to temporary storage, by every sort so far.
+    size_t spilled() const { return spilled_; }
+private:
+    // Records, in memory and in runs alike, are
+    //   [u32 key length][u32 row length][key][row]
+    // where the key ends with the record's sequence number.
+    struct Run { uint64_t off, len; };
+    // A run being merged: the bytes read ahead and the record at `pos`.
+    struct Reader {
+        uint64_t off{0}, end{0}; // part of the run not read yet
+        std::string buf;
+        size_t pos{0};
+        size_t len{0};           // length of the current record; 0 when done
+    };
+    static std::string_view key_of(const char* rec);
+    void push_heap(std::string_view rec);
+    void make_room(size_t size);
+    void spill();
+    void write_run(const std::vector<std::string_view>& recs);
+    bool advance(Reader& r);
+    void open_readers(size_t first, size_t n);
+    std::string_view reader_key(size_t i) const;
+    void step_merge();
+    const char* current() const;
+    size_t fan_in() const;
+
+    size_t memory_{DEFAULT_SORT_MEMORY};
+    TempStorageFn make_temp_;
+    size_t limit_{SIZE_MAX};
+    uint64_t seq_{0};
+    size_t emitted_{0};
+    std::string rec_;                 // the record being added
+    std::vector<std::string> heap_;   // top-`limit_` records, largest first,
+                                      // in order once sorted
+    size_t heap_bytes_{0};
+    bool use_heap_{false};
+    std::string buf_;                 // records not yet in a run
+    std::vector<size_t> recs_;        // offset of each in buf_, sorted by sort()
+    size_t pos_{0};                   // current record of heap_ or recs_
+    std::unique_ptr<IStorage> temp_;
+    uint64_t temp_end_{0};
+    std::vector<Run> runs_;
+    size_t spilled_{0};
+    std::vector<Reader> readers_;
+    std::vector<size_t> merge_;       // readers with records left, as a heap
+};
+
+} // namespace tinydb
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "tinydb/catalog.hpp"
+#include "tinydb/parser.hpp"
+#include "tinydb/vm.hpp"
+
+namespace tinydb {
+
+// A statement parsed and compiled once, then run any number of times
+// with different values bound to its ? / ?N / :name placeholders.
+class Statement {
+public:
+    using Step = StepResult;
+
+    // nullptr if `sql` does not parse or is not run by the VM (CREATE TABLE).
+    static std::unique_ptr<Statement> prepare(const std::string& sql, const Catalog& cat);
+    static std::unique_ptr<Statement> prepare(const ASTNode& ast, const Catalog& cat);
+
+    size_t param_count() const { return names_.size(); }
+    // 1-based index of :name, or 0.
+    int param_index(std::string_view name) const;
+    // Parameters are numbered from 1; false if `idx` is out of range.
+    // Unbound parameters are NULL. Binding ends a run in progress.
+    bool bind(int idx, Value v);
+    bool bind(std::string_view name, Value v) { return bind(param_index(name), std::move(v)); }
+    void clear_bindings();
+
+    // Statements run on `vm`, which must outlive them.
+    ~Statement() { reset(); }
+    Statement(const Statement&) = delete;
+    Statement& operator=(const Statement&) = delete;
+
+    // Run to the next result row (Row, see row()) or the end (Done). The
+    // program starts on the first call after prepare/reset and pauses at
+    // each row; running another program on `vm` meanwhile ends it (Error).
+    Step step(VM& vm);
+    // Valid until the next step.
+    const std::vector<Value>& row() const { return vm_->row(); }
+    // Ready to run again; bindings are kept.
+    void reset();
+
+    bool is_query() const { return query_; }
+    bool is_transaction() const { return txn_; }
+    // Catalog::version() the program was compiled against.
+    uint64_t schema_version() const { return version_; }
+    const Program& program() const { return prog_; }
+private:
+    Statement() = default;
+
+    Program prog_;
+    std::vector<std::string> names_;
+    std::vector<Value> params_;
+    uint64_t version_{0};
+    bool query_{false};
+    bool txn_{false};
+    bool ran_{false};
+    Step last_{Step::Error}; // returned again once the run is over
+    VM* vm_{nullptr};
+};
+
+// Prepared statements by SQL text, least recently used evicted first, so
+// repeated statements skip parsing and code generation.
+class StatementCache {
+public:
+    explicit StatementCache(size_t capacity = 64) : capacity_(capacity ? capacity : 1) {}
+    // The cached statement for `sql`, reset, if it was compiled against
+    // the catalog's current version; otherwise nullptr.
+    Statement* find(const std::string& sql, const Catalog& cat);
+    // Take ownership of `st` as the entry for `sql`.
+    Statement* insert(const std::string& sql, std::unique_ptr<Statement> st);
+    void clear();
+    size_t size() const { return map_.size(); }
+private:
+    using Entry = std::pair<std::string, std::unique_ptr<Statement>>;
+
+    size_t capacity_;
+    std::list<Entry> lru_; // most recent first
+    std::unordered_map<std::string, std::list<Entry>::iterator> map_;
+};
+
+} // namespace tinydb
@@ -1,30 +1,76 @@
 // Storage interface and file-backed implementation
 #pragma once
+#include <cstddef>
 #include <cstdint>
-#include <cstdio>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace tinydb {
 
+struct IoSlice {
+    const void* data;
+    size_t len;
+};
+
 class IStorage {
 public:
     virtual ~IStorage() = default;
     virtual void read(uint64_t off, void* buf, size_t n) = 0;
     virtual void write(uint64_t off, const void* buf, size_t n) = 0;
+    // Write `cnt` buffers back to back starting at `off`.
+    virtual void writev(uint64_t off, const IoSlice* v, size_t cnt) {
+        for (size_t i = 0; i < cnt; ++i) { write(off, v[i].data, v[i].len); off += v[i].len; }
+    }
     virtual void sync() = 0;
+    // Pointer to `n` bytes at `off` that stays valid for the lifetime of
+    // the storage, or nullptr if the backend cannot expose its bytes.
+    virtual const uint8_t* view(uint64_t /*off*/, size_t /*n*/) { return nullptr; }
 };
 
+// Positional I/O (pread/pwrite) on a raw descriptor: no shared file
+// position, 64-bit offsets, and nothing buffered in user space.
 class FileStorage : public IStorage {
 public:
     explicit FileStorage(const std::string& path);
     ~FileStorage() override;
     void read(uint64_t off, void* buf, size_t n) override;
     void write(uint64_t off, const void* buf, size_t n) override;
+    void writev(uint64_t off, const IoSlice* v, size_t cnt) override;
     void sync() override;
 private:
     std::string path_;
-    std::FILE* f_{nullptr};
+    int fd_{-1};
 };
 
-} // namespace tinydb
+// A FileStorage on a new file in the temporary directory ($TMPDIR, else
+// /tmp), unlinked at once: its space goes back when the storage is
+// destroyed, or the process exits.
+std::unique_ptr<IStorage> make_temp_storage();
+
+// Read-only shared mapping of the file; writes go through pwrite so the
+// mapping (kernel page cache) always reflects them. Growing past the
+// mapped range maps the file again at a larger size; older mappings are
+// kept until destruction so pointers returned by view() never dangle.
+class MmapStorage : public IStorage {
+public:
+    explicit MmapStorage(const std::string& path);
+    ~MmapStorage() override;
+    void read(uint64_t off, void* buf, size_t n) override;
+    void write(uint64_t off, const void* buf, size_t n) override;
+    void writev(uint64_t off, const IoSlice* v, size_t cnt) override;
+    void sync() override;
+    const uint8_t* view(uint64_t off, size_t n) override;
+private:
+    void grown(uint64_t end);
+    void remap(uint64_t need);
+    std::string path_;
+    int fd_{-1};
+    uint64_t size_{0};
+    uint8_t* map_{nullptr};
+    size_t map_len_{0};
+    std::vector<std::pair<void*, size_t>> retired_;
+};
 
+} // namespace tinydb
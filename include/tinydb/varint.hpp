@@ -1,12 +1,51 @@
 #pragma once
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 #include <utility>
 
 namespace tinydb {
 
+constexpr size_t MAX_VARINT = 10; // bytes needed for any uint64_t
+
+inline size_t varint_size(uint64_t x) {
+    size_t n = 1;
+    while (x >>= 7U) ++n;
+    return n;
+}
+
+// Write x as LEB128 into out (room for MAX_VARINT bytes); returns length.
+inline size_t encode_varint(uint64_t x, uint8_t* out) {
+    size_t i = 0;
+    while (x >= 0x80) {
+        out[i++] = static_cast<uint8_t>(x | 0x80);
+        x >>= 7U;
+    }
+    out[i++] = static_cast<uint8_t>(x);
+    return i;
+}
+
 std::vector<uint8_t> encode_varint(uint64_t x);
-std::pair<uint64_t, size_t> decode_varint(const uint8_t* p, size_t n);
 
-} // namespace tinydb
+// Map signed to unsigned so values near zero, of either sign, are small:
+// 0, -1, 1, -2, ... become 0, 1, 2, 3, ...
+inline uint64_t zigzag_encode(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1U) ^ static_cast<uint64_t>(v >> 63);
+}
+inline int64_t zigzag_decode(uint64_t z) {
+    return static_cast<int64_t>(z >> 1U) ^ -static_cast<int64_t>(z & 1U);
+}
 
+std::pair<uint64_t, size_t> decode_varint_slow(const uint8_t* p, size_t n);
+
+// Returns {value, bytes used}. Lengths, column tags and small integers
+// are almost always one or two bytes, so those are decoded inline.
+inline std::pair<uint64_t, size_t> decode_varint(const uint8_t* p, size_t n) {
+    if (n >= 2) {
+        if (p[0] < 0x80) return {p[0], 1};
+        if (p[1] < 0x80) return {(p[0] & 0x7FU) | static_cast<uint64_t>(p[1]) << 7U, 2};
+    }
+    return decode_varint_slow(p, n);
+}
+
+} // namespace tinydb
@@ -2,22 +2,60 @@
 #include <cstdint>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
+#include "tinydb/aggregate.hpp"
+#include "tinydb/batch.hpp"
 #include "tinydb/btree.hpp"
 #include "tinydb/catalog.hpp"
 #include "tinydb/record.hpp"
+#include "tinydb/sorter.hpp"
 
 namespace tinydb {
 
+// Every opcode, in dispatch-table order. The comparisons Eq..Ge fall
+// through if reg p1 <op> reg p3 holds and otherwise, NULL operands
+// included, jump to p2: each WHERE term is one test-and-skip. The Idx
+// ops work on cursors opened on index trees (OpenRead with p3 = the
+// index's column count) and on keys built by MakeKey and MakeEntry.
+// AggReset, AggStep and AggNext drive the VM's one HashAggregate, and
+// the Sorter ops its one Sorter.
+#define TINYDB_OPS(X) \
+    X(OpenRead) X(OpenWrite) X(Rewind) X(SeekGE) X(Column) \
+    X(ResultRow) X(Next) X(Integer) X(Insert) X(Halt) \
+    X(Begin) X(Commit) X(Rollback) \
+    X(Rowid) X(Gt) X(Constant) X(MakeRecord) X(Update) X(Delete) X(EraseRange) \
+    X(Null) X(Variable) X(AddImm) X(BatchLoad) X(BatchResult) \
+    X(Eq) X(Ne) X(Lt) X(Le) X(Ge) X(Goto) X(BatchMove) \
+    X(NewRowid) X(Copy) X(MakeKey) X(MakeEntry) X(IdxInsert) X(IdxDelete) \
+    X(IdxSeekGE) X(IdxSeekGT) X(IdxLt) X(IdxLe) X(IdxNext) X(IdxRowid) \
+    X(IdxColumn) X(SeekRowid) X(AggReset) X(AggStep) X(AggNext) X(Count) \
+    X(SorterOpen) X(SorterInsert) X(SorterSort) X(SorterData) X(SorterNext) \
+    X(IfPos) X(DecrJumpZero) X(BatchAggStep) X(RowidBound)
+
 enum class Op : uint8_t {
-    OpenRead, OpenWrite, Rewind, SeekGE, Column,
-    ResultRow, Next, Integer, Insert, Halt
+#define TINYDB_OP_ENUM(name) name,
+    TINYDB_OPS(TINYDB_OP_ENUM)
+#undef TINYDB_OP_ENUM
 };
 
+const char* op_name(Op op);
+
+enum class StepResult : uint8_t { Row, Done, Error };
+
 struct Instr {
     Op op;
     int p1{0}, p2{0}, p3{0};
-    std::string p4;
+};
+
+// Compiled code. It must end in Halt. Operands that are not integers
+// (strings, REAL, wide INT, literal records) live in `consts`. The
+// register and cursor counts are fixed here so execution never resizes.
+struct Program {
+    std::vector<Instr> code;
+    std::vector<Value> consts;
+    int nregs{0};
+    int ncursors{0};
 };
 
 class VM {
@@ -25,16 +63,58 @@ public:
     VM() = default;
     VM(BTree& bt, Catalog& cat) : btree_(&bt), catalog_(&cat) {}
     void set_env(BTree& bt, Catalog& cat) { btree_ = &bt; catalog_ = &cat; }
-    int run(const std::vector<Instr>& prog);
+    // Run `prog` to completion, collecting every result row in results().
+    // `params` are the values of Variable ops, by index - 1.
+    int run(const Program& prog, const std::vector<Value>* params = nullptr);
     const std::vector<std::vector<Value>>& results() const { return results_; }
+
+    // Incremental execution: after start(), each step() runs `prog` up to
+    // its next ResultRow (Row, the values in row()) or to the end. `prog`
+    // and `params` must stay alive until then; row() only until the next
+    // step. Starting another program abandons the current one.
+    void start(const Program& prog, const std::vector<Value>* params = nullptr);
+    StepResult step();
+    const std::vector<Value>& row() const { return row_; }
+    // Stop the current program and release its cursors.
+    void abort();
+    bool running(const Program& prog) const { return prog_ == &prog; }
+    // Bytes of rows an ORDER BY holds in memory (at least
+    // MIN_SORT_MEMORY); beyond that it writes sorted runs to storage from
+    // `make` (by default make_temp_storage()) and merges them.
+    void set_sort_memory(size_t bytes) { sorter_.set_memory(bytes); }
+    void set_temp_storage(TempStorageFn make) { sorter_.set_temp_storage(std::move(make)); }
+    // Sorted runs written so far, by every sort this VM ran.
+    size_t sort_runs() const { return sorter_.spilled(); }
 private:
+    StepResult exec();
+
+    // Decoded layout of the row under each cursor; dropped when it moves.
+    struct RowCache {
+        RowDecoder dec;
+        bool valid{false};
+        bool full{false}; // dec covers the whole payload, overflow included
+        size_t key_cols{0}; // columns of an index cursor's entries
+    };
+
     BTree* btree_{nullptr};
     Catalog* catalog_{nullptr};
     std::vector<Cursor> cursors_;
+    std::vector<RowCache> rows_;
+    std::string rec_; // MakeRecord and MakeKey scratch
+    Batch batch_;     // the leaf a batched scan is on
+    size_t batch_pos_{0}; // next row of batch_ for BatchResult
+    HashAggregate agg_;
+    size_t agg_pos_{0};   // next group for AggNext
+    Sorter sorter_;
+    std::string_view sort_desc_; // per sort key, 1 if descending
+    RowDecoder sort_row_;        // the sorter's current row
     std::vector<Value> regs_;
+    const std::vector<Value>* params_{nullptr};
     std::vector<std::vector<Value>> results_;
+    const Program* prog_{nullptr};
+    size_t pc_{0};
+    std::vector<Value> row_;
     size_t last_row_cols_{0};
-    int64_t next_rowid_{1};
 };
 
 } // namespace tinydb
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "tinydb/storage.hpp"
+
+namespace tinydb {
+
+constexpr uint32_t WAL_AUTOCHECKPOINT = 1000; // frames
+
+// Write-ahead log of whole page images. Frames are appended after a
+// 32-byte header; each carries the page number, a commit marker (the
+// database size in pages, 0 for non-commit frames), the header salts
+// and a checksum chained through every earlier frame. On open the log
+// is replayed up to the last commit frame whose chain verifies, so a
+// torn append is simply ignored.
+class Wal {
+public:
+    explicit Wal(std::unique_ptr<IStorage> log);
+    // Copy the newest logged image of `pgno` into `buf`; false if absent.
+    bool read(uint32_t pgno, uint8_t* buf);
+    bool contains(uint32_t pgno) const {
+        return pending_.count(pgno) || index_.count(pgno);
+    }
+    // Append page images in one vectored write. With `commit` the last
+    // frame becomes a commit frame and the log is synced once for the
+    // whole batch; otherwise the frames stay pending until a commit.
+    void append(const std::vector<std::pair<uint32_t, const uint8_t*>>& pages,
+                bool commit, uint32_t db_pages);
+    bool has_pending() const { return !pending_.empty(); }
+    // Forget every frame appended since the last commit.
+    void discard_pending();
+    // Copy every committed page into `db`, sync it and restart the log.
+    void checkpoint(IStorage& db);
+    uint32_t frames() const { return nframes_; }
+private:
+    void reset();
+    void recover();
+    uint64_t frame_offset(uint32_t frame) const;
+
+    std::unique_ptr<IStorage> log_;
+    uint32_t ckpt_seq_{0};
+    uint32_t salt_[2]{};
+    uint32_t cksum_[2]{};
+    uint32_t nframes_{0};
+    uint32_t commit_frames_{0};   // nframes_ as of the last commit
+    uint32_t commit_cksum_[2]{};  // checksum chain as of the last commit
+    std::unordered_map<uint32_t, uint32_t> index_;   // committed: pgno -> frame
+    std::unordered_map<uint32_t, uint32_t> pending_; // since last commit
+};
+
+} // namespace tinydb
@@ -0,0 +1,160 @@
+#include "tinydb/aggregate.hpp"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <new>
+
+namespace tinydb {
+
+void* Arena::alloc(size_t n, size_t align) {
+    if (!blocks_.empty()) {
+        Block& b = blocks_.back();
+        auto base = reinterpret_cast<uintptr_t>(b.data.get());
+        size_t at = ((base + used_ + align - 1) & ~(uintptr_t(align) - 1)) - base;
+        if (at + n <= b.size) {
+            used_ = at + n;
+            return b.data.get() + at;
+        }
+    }
+    // new[] memory is aligned for any fundamental type, so a fresh block
+    // serves the request from its start.
+    size_t size = std::max(BLOCK, n);
+    blocks_.push_back({std::make_unique<char[]>(size), size});
+    used_ = n;
+    return blocks_.back().data.get();
+}
+
+std::string_view Arena::copy(std::string_view s) {
+    if (s.empty()) return {};
+    char* p = static_cast<char*>(alloc(s.size(), 1));
+    std::memcpy(p, s.data(), s.size());
+    return {p, s.size()};
+}
+
+void Arena::reset() {
+    if (blocks_.size() > 1) blocks_.resize(1);
+    used_ = 0;
+}
+
+void HashAggregate::reset(size_t nkeys, std::string_view ops) {
+    nkeys_ = nkeys;
+    ops_.assign(ops);
+    arena_.reset();
+    groups_.clear();
+    slots_.assign(16, 0);
+    if (nkeys_ == 0) find(nullptr);
+}
+
+HashAggregate::Group& HashAggregate::find(const Value* keys) {
+    key_.clear();
+    for (size_t k = 0; k < nkeys_; ++k) append_key(keys[k], key_);
+    size_t vlen = key_.size();
+    std::string_view values(key_.data(), vlen);
+    uint64_t hash = std::hash<std::string_view>{}(values);
+    size_t mask = slots_.size() - 1;
+    size_t at = hash & mask;
+    for (; slots_[at]; at = (at + 1) & mask) {
+        Group& g = groups_[slots_[at] - 1];
+        if (g.hash == hash && g.entry.substr(0, g.vlen) == values) return g;
+    }
+    // A new group: keep the type bytes too, so result() can give each
+    // key back as first seen; the zero rowid makes it a full entry.
+    finish_key(keys, nkeys_, 0, key_);
+    Acc* acc = static_cast<Acc*>(arena_.alloc(sizeof(Acc) * ops_.size(), alignof(Acc)));
+    for (size_t j = 0; j < ops_.size(); ++j) new (acc + j) Acc{};
+    groups_.push_back({hash, arena_.copy(key_), vlen, acc});
+    slots_[at] = static_cast<uint32_t>(groups_.size());
+    if (groups_.size() * 2 > slots_.size()) grow();
+    return groups_.back();
+}
+
+void HashAggregate::grow() {
+    slots_.assign(slots_.size() * 2, 0);
+    size_t mask = slots_.size() - 1;
+    for (size_t g = 0; g < groups_.size(); ++g) {
+        size_t at = groups_[g].hash & mask;
+        while (slots_[at]) at = (at + 1) & mask;
+        slots_[at] = static_cast<uint32_t>(g + 1);
+    }
+}
+
+bool HashAggregate::step(const Value* in) {
+    Acc* acc = nkeys_ ? find(in).acc : groups_[0].acc;
+    const Value* args = in + nkeys_;
+    for (size_t j = 0; j < ops_.size(); ++j) {
+        Acc& a = acc[j];
+        auto op = static_cast<AggOp>(ops_[j]);
+        if (op == AggOp::CountAll) { ++a.n; continue; }
+        const Value& v = args[j];
+        if (v.tag == ColTag::NIL) continue;
+        ++a.n;
+        switch (op) {
+        case AggOp::Sum: case AggOp::Avg:
+            // Exact while every input is an INT and the total fits. An
+            // INT SUM that does not fit fails, as in SQLite; AVG goes on
+            // as REAL.
+            if (v.tag == ColTag::INT && a.tag != ColTag::REAL) {
+                int64_t sum;
+                if (!__builtin_add_overflow(a.i, v.i, &sum)) {
+                    a.tag = ColTag::INT;
+                    a.i = sum;
+                    break;
+                }
+                if (op == AggOp::Sum) return false;
+            }
+            if (a.tag != ColTag::REAL) {
+                a.r = static_cast<double>(a.i);
+                a.tag = ColTag::REAL;
+            }
+            // TEXT and BLOB add nothing, as non-numeric strings in SQLite.
+            a.r += v.tag == ColTag::REAL ? v.r : v.tag == ColTag::INT ? static_cast<double>(v.i) : 0.0;
+            break;
+        case AggOp::Min: case AggOp::Max: {
+            if (a.tag != ColTag::NIL) {
+                Value held{a.tag, a.i, {}, a.text, a.r};
+                int c = compare_values(v, held);
+                if (op == AggOp::Min ? c >= 0 : c <= 0) break;
+            }
+            a.tag = v.tag;
+            a.i = v.i;
+            a.r = v.r;
+            a.text = v.tag == ColTag::TEXT || v.tag == ColTag::BLOB ? arena_.copy(v.text()) : std::string_view{};
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+void HashAggregate::result(size_t g, Value* out) const {
+    const Group& grp = groups_[g];
+    for (size_t k = 0; k < nkeys_; ++k) key_column(grp.entry, nkeys_, k, out[k]);
+    for (size_t j = 0; j < ops_.size(); ++j) {
+        const Acc& a = grp.acc[j];
+        Value& dst = out[nkeys_ + j];
+        dst.s.clear();
+        dst.ref = {};
+        dst.i = 0;
+        dst.r = 0.0;
+        switch (static_cast<AggOp>(ops_[j])) {
+        case AggOp::CountAll: case AggOp::Count:
+            dst.tag = ColTag::INT;
+            dst.i = a.n;
+            break;
+        case AggOp::Avg:
+            dst.tag = a.n ? ColTag::REAL : ColTag::NIL;
+            dst.r = (a.tag == ColTag::INT ? static_cast<double>(a.i) : a.r) / static_cast<double>(a.n ? a.n : 1);
+            break;
+        default: // Sum, Min, Max: the value held, NULL if none was
+            dst.tag = a.tag;
+            dst.i = a.i;
+            dst.r = a.r;
+            dst.ref = a.text;
+            break;
+        }
+    }
+}
+
+} // namespace tinydb
@@ -1,3 +1,79 @@
 #include "tinydb/ast.hpp"
-// empty on purpose
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <limits>
 
+namespace tinydb {
+
+namespace {
+// An integer literal, or a placeholder (param set), usable as a bound.
+bool int_bound(const Operand& o, long long& v, int& param) {
+    v = 0;
+    param = 0;
+    if (o.column || o.text.empty()) return false;
+    if (o.text[0] == '?') { param = std::stoi(o.text.substr(1)); return true; }
+    if (o.text.find_first_not_of("-0123456789") != std::string::npos) return false;
+    // Literals past the INT range are REAL, compared row by row.
+    const char* end = o.text.data() + o.text.size();
+    auto [ptr, ec] = std::from_chars(o.text.data(), end, v);
+    return ec == std::errc{} && ptr == end;
+}
+
+bool fold(const Expr& e, RowidRange& r) {
+    if (!e.lhs.column || !is_rowid(e.lhs.text)) return false;
+    long long v;
+    int param;
+    if (!int_bound(e.rhs, v, param)) return false;
+    // A placeholder bound cannot be combined with another on the same side.
+    bool lo = e.op == Expr::EQ || e.op == Expr::GT || e.op == Expr::GE;
+    bool hi = e.op == Expr::EQ || e.op == Expr::LT || e.op == Expr::LE;
+    if (!lo && !hi) return false;
+    if (lo && (param ? r.has_lo : r.lo_param != 0)) return false;
+    if (hi && (param ? r.has_hi : r.hi_param != 0)) return false;
+    constexpr long long MIN = std::numeric_limits<long long>::min();
+    constexpr long long MAX = std::numeric_limits<long long>::max();
+    if ((e.op == Expr::GT && !param && v == MAX) || (e.op == Expr::LT && !param && v == MIN))
+        return false; // no key satisfies it; leave it to the row check
+    if (e.op == Expr::GT) ++v;
+    if (e.op == Expr::LT) --v;
+    if (lo) {
+        r.lo = r.has_lo ? std::max(r.lo, v) : v;
+        r.has_lo = true;
+        r.lo_param = param;
+    }
+    if (hi) {
+        r.hi = r.has_hi ? std::min(r.hi, v) : v;
+        r.has_hi = true;
+        r.hi_param = param;
+    }
+    return true;
+}
+} // namespace
+
+bool is_rowid(const std::string& name) {
+    static const char kw[] = "ROWID";
+    if (name.size() != sizeof kw - 1) return false;
+    for (size_t i = 0; i < name.size(); ++i)
+        if (std::toupper(static_cast<unsigned char>(name[i])) != kw[i]) return false;
+    return true;
+}
+
+RowidRange rowid_range(const Expr* where, std::vector<const Expr*>& rest) {
+    RowidRange r;
+    std::vector<const Expr*> todo;
+    if (where) todo.push_back(where);
+    while (!todo.empty()) {
+        const Expr* e = todo.back();
+        todo.pop_back();
+        if (e->kind == Expr::And) {
+            todo.push_back(e->right.get());
+            todo.push_back(e->left.get());
+        } else if (e->kind == Expr::Or || !fold(*e, r)) {
+            rest.push_back(e);
+        }
+    }
+    return r;
+}
+
+} // namespace tinydb
@@ -0,0 +1,68 @@
+#include "tinydb/batch.hpp"
+#include <algorithm>
+
+namespace tinydb {
+
+size_t Batch::load(BTree& bt, Cursor& c, size_t ncols) {
+    if (cells_.empty()) {
+        cells_.resize(BATCH_ROWS);
+        keys_.resize(BATCH_ROWS);
+        width_.resize(BATCH_ROWS);
+    }
+    n_ = bt.leaf_run(c, cells_.data(), BATCH_ROWS);
+    if (ncols != ALL) reserve_columns(ncols);
+    for (size_t k = 0; k < n_; ++k) {
+        const CellView& cell = cells_[k];
+        keys_[k] = cell.key;
+        bool whole = cell.local.size() == cell.total;
+        // As with Column, columns that sit in the leaf are decoded without
+        // reading the overflow pages behind them.
+        if (decode(k, cell.local, ncols, whole)) continue;
+        if (spill_.empty()) spill_.resize(BATCH_ROWS);
+        bt.read_overflow(cell, spill_[k]);
+        decode(k, spill_[k], ncols, true);
+    }
+    return n_;
+}
+
+bool Batch::decode(size_t k, std::string_view payload, size_t ncols, bool whole) {
+    const auto* p = reinterpret_cast<const uint8_t*>(payload.data());
+    if (ncols == ALL) {
+        if (!whole) return false; // the width is only known from the whole row
+        ncols = row_columns(p, payload.size());
+        if (ncols == SIZE_MAX) return false;
+        reserve_columns(ncols);
+    }
+    width_[k] = static_cast<uint32_t>(ncols);
+    ColumnSink out{tag_.data() + k, i_.data() + k, r_.data() + k, text_.data() + k, BATCH_ROWS};
+    return decode_columns(p, payload.size(), ncols, out);
+}
+
+void Batch::reserve_columns(size_t ncols) {
+    if (ncols <= cap_cols_) return;
+    tag_.resize(ncols * BATCH_ROWS);
+    i_.resize(ncols * BATCH_ROWS);
+    r_.resize(ncols * BATCH_ROWS);
+    text_.resize(ncols * BATCH_ROWS);
+    cap_cols_ = ncols;
+}
+
+void Batch::copy_column(size_t from, size_t to) {
+    reserve_columns(std::max(from, to) + 1);
+    size_t src = from * BATCH_ROWS, dst = to * BATCH_ROWS;
+    std::copy_n(tag_.begin() + src, n_, tag_.begin() + dst);
+    std::copy_n(i_.begin() + src, n_, i_.begin() + dst);
+    std::copy_n(r_.begin() + src, n_, r_.begin() + dst);
+    std::copy_n(text_.begin() + src, n_, text_.begin() + dst);
+}
+
+void Batch::get(size_t col, size_t k, Value& out) const {
+    size_t at = col * BATCH_ROWS + k;
+    out.tag = tag_[at];
+    out.i = i_[at];
+    out.r = r_[at];
+    out.s.clear();
+    out.ref = text_[at];
+}
+
+} // namespace tinydb
@@ -1,7 +1,9 @@
 #include "tinydb/btree.hpp"
 #include <algorithm>
+#include <array>
 #include <cstring>
 #include <limits>
+#include <stdexcept>
 #include <vector>
 
 namespace tinydb {
@@ -45,9 +47,149 @@ static void write64(uint8_t* p, int64_t v) {
     for (int i = 0; i < 8; ++i) p[i] = static_cast<uint8_t>((u >> (8 * i)) & 0xFF);
 }
 
+// Slotted leaf layout: an array of u16 cell offsets follows the header
+// and cells are packed from the end of the page towards it, so cell i is
+// one indirection away and the slot array can be binary-searched.
+constexpr size_t LEAF_HDR = 12;   // type, -, ncell, next, content, frag
+constexpr size_t CELL_HDR = 10;   // key i64, local payload length u16
+constexpr size_t SLOT_SIZE = 2;
+
+// A cell whose length field has OVERFLOW_FLAG set keeps only a prefix of
+// its payload in the leaf: [u32 total length][u32 first overflow page]
+// follow the length field, then the prefix. Each overflow page holds
+// [u32 next overflow page][payload bytes].
+constexpr uint16_t OVERFLOW_FLAG = 0x8000;
+constexpr size_t OVERFLOW_HDR = 8;
+constexpr size_t OVERFLOW_DATA = PAGE_SIZE - 4;
+// Payloads up to MAX_INLINE stay whole in the cell, which keeps at least
+// four cells per leaf so a split always has room for both halves.
+constexpr size_t MAX_INLINE = (PAGE_SIZE - LEAF_HDR) / 4 - SLOT_SIZE - CELL_HDR;
+constexpr size_t MIN_LOCAL = MAX_INLINE / 4;
+
+static uint16_t leaf_ncell(const uint8_t* d) { return read16(d + 2); }
+
+static size_t leaf_content(const uint8_t* d) {
+    uint16_t c = read16(d + 8);
+    return c == 0 ? PAGE_SIZE : c;
+}
+
+static const uint8_t* leaf_cell(const uint8_t* d, size_t i) {
+    return d + read16(d + LEAF_HDR + SLOT_SIZE * i);
+}
+
+static int64_t leaf_key(const uint8_t* d, size_t i) {
+    return read64(leaf_cell(d, i));
+}
+
+// A cell's body is everything after its key: the length field, the
+// overflow header if any, and the local payload bytes.
+static size_t body_size(const uint8_t* body) {
+    uint16_t n = read16(body);
+    if (n & OVERFLOW_FLAG) return 2 + OVERFLOW_HDR + (n & ~OVERFLOW_FLAG);
+    return 2 + n;
+}
+
+static std::string_view leaf_body(const uint8_t* d, size_t i) {
+    const uint8_t* body = leaf_cell(d, i) + 8;
+    return std::string_view(reinterpret_cast<const char*>(body), body_size(body));
+}
+
+struct PayloadRef {
+    std::string_view local;
+    uint32_t total{0};
+    uint32_t overflow{0}; // first overflow page, 0 if the payload is whole
+};
+
+static PayloadRef body_payload(std::string_view body) {
+    const uint8_t* b = reinterpret_cast<const uint8_t*>(body.data());
+    uint16_t n = read16(b);
+    if (!(n & OVERFLOW_FLAG)) return {body.substr(2), n, 0};
+    return {body.substr(2 + OVERFLOW_HDR), read32(b + 2), read32(b + 6)};
+}
+
+// Bytes of an overflowing payload kept in the leaf. Like SQLite, size the
+// prefix so the tail fills its last overflow page as fully as possible.
+static size_t local_size(size_t total) {
+    size_t local = MIN_LOCAL + (total - MIN_LOCAL) % OVERFLOW_DATA;
+    return local > MAX_INLINE - OVERFLOW_HDR ? MIN_LOCAL : local;
+}
+
+// Encode `payload` as a cell body in `out`, spilling what does not fit
+// into a freshly written overflow chain allocated near `near`.
+static std::string_view encode_body(Pager& pager, std::string_view payload, uint32_t near,
+                                    std::string& out) {
+    if (payload.size() <= MAX_INLINE) {
+        out.resize(2 + payload.size());
+        write16(reinterpret_cast<uint8_t*>(out.data()), static_cast<uint16_t>(payload.size()));
+        std::memcpy(out.data() + 2, payload.data(), payload.size());
+        return out;
+    }
+    if (payload.size() > std::numeric_limits<uint32_t>::max())
+        throw std::runtime_error("payload too large");
+    size_t local = local_size(payload.size());
+    uint32_t first = 0;
+    PageRef prev;
+    for (size_t off = local; off < payload.size(); off += OVERFLOW_DATA) {
+        uint32_t pgno = pager.alloc(near);
+        near = pgno;
+        PageRef page = pager.acquire(pgno);
+        size_t n = std::min(OVERFLOW_DATA, payload.size() - off);
+        std::memcpy(page->data.data() + 4, payload.data() + off, n);
+        pager.mark_dirty(*page);
+        if (prev) {
+            write32(prev->data.data(), pgno);
+            pager.mark_dirty(*prev);
+        } else {
+            first = pgno;
+        }
+        prev = std::move(page);
+    }
+    out.resize(2 + OVERFLOW_HDR + local);
+    uint8_t* b = reinterpret_cast<uint8_t*>(out.data());
+    write16(b, static_cast<uint16_t>(local | OVERFLOW_FLAG));
+    write32(b + 2, static_cast<uint32_t>(payload.size()));
+    write32(b + 6, first);
+    std::memcpy(b + 2 + OVERFLOW_HDR, payload.data(), local);
+    return out;
+}
+
+static void free_overflow(Pager& pager, std::string_view body) {
+    uint32_t pgno = body_payload(body).overflow;
+    while (pgno != 0) {
+        uint32_t next = read32(pager.view(pgno));
+        pager.free(pgno);
+        pgno = next;
+    }
+}
+
+// Index of the first cell with key >= `key` (ncell if none).
+static size_t leaf_lower_bound(const uint8_t* d, int64_t key) {
+    size_t lo = 0, hi = leaf_ncell(d);
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (leaf_key(d, mid) < key) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+// Every slot must point at a whole cell inside the content area.
+static bool leaf_valid(const uint8_t* d) {
+    size_t ncell = leaf_ncell(d);
+    size_t content = leaf_content(d);
+    if (LEAF_HDR + SLOT_SIZE * ncell > content) return false;
+    for (size_t i = 0; i < ncell; ++i) {
+        size_t off = read16(d + LEAF_HDR + SLOT_SIZE * i);
+        if (off < content || off + CELL_HDR > PAGE_SIZE) return false;
+        if ((read16(d + off + 8) & OVERFLOW_FLAG) && off + CELL_HDR + OVERFLOW_HDR > PAGE_SIZE)
+            return false;
+        if (off + 8 + body_size(d + off + 8) > PAGE_SIZE) return false;
+    }
+    return true;
+}
+
 struct LeafData {
     uint32_t next{0};
-    std::vector<std::pair<int64_t, std::string_view>> cells;
+    std::vector<std::pair<int64_t, std::string_view>> cells; // key, body
 };
 
 struct InternalData {
@@ -58,45 +200,47 @@ struct InternalData {
 static LeafData load_leaf(Page& page) {
     LeafData leaf;
     const uint8_t* d = page.data.data();
-    uint16_t ncell = read16(d + 2);
+    uint16_t ncell = leaf_ncell(d);
     leaf.next = read32(d + 4);
     leaf.cells.reserve(ncell);
-    size_t off = 8;
-    for (uint16_t i = 0; i < ncell; ++i) {
-        int64_t key = read64(d + off);
-        uint16_t len = read16(d + off + 8);
-        leaf.cells.emplace_back(key,
-            std::string_view(reinterpret_cast<const char*>(d + off + 10), len));
-        off += 10 + len;
-    }
+    for (uint16_t i = 0; i < ncell; ++i)
+        leaf.cells.emplace_back(leaf_key(d, i), leaf_body(d, i));
     return leaf;
 }
 
 static void store_leaf(Page& page, const LeafData& leaf) {
-    uint8_t* d = page.data.data();
+    // Cells may still point into `page`, so serialise into a scratch
+    // buffer first instead of overwriting sources mid-copy.
+    std::array<uint8_t, PAGE_SIZE> buf{};
+    uint8_t* d = buf.data();
     d[0] = LEAF;
     write16(d + 2, static_cast<uint16_t>(leaf.cells.size()));
     write32(d + 4, leaf.next);
-    size_t off = 8;
-    for (auto& cell : leaf.cells) {
-        write64(d + off, cell.first);
-        uint16_t len = static_cast<uint16_t>(cell.second.size());
-        write16(d + off + 8, len);
-        std::memcpy(d + off + 10, cell.second.data(), len);
-        off += 10 + len;
+    size_t content = PAGE_SIZE;
+    for (size_t i = 0; i < leaf.cells.size(); ++i) {
+        auto& cell = leaf.cells[i];
+        content -= 8 + cell.second.size();
+        write64(d + content, cell.first);
+        std::memcpy(d + content + 8, cell.second.data(), cell.second.size());
+        write16(d + LEAF_HDR + SLOT_SIZE * i, static_cast<uint16_t>(content));
     }
-    if (off < PAGE_SIZE) std::memset(d + off, 0, PAGE_SIZE - off);
+    write16(d + 8, static_cast<uint16_t>(content));
+    write16(d + 10, 0);
+    page.data = buf;
+}
+
+static size_t leaf_cell_size(size_t body_len) {
+    return SLOT_SIZE + 8 + body_len;
 }
 
 static size_t leaf_size(const LeafData& leaf) {
-    size_t n = 8;
-    for (auto& cell : leaf.cells) n += 10 + cell.second.size();
+    size_t n = LEAF_HDR;
+    for (auto& cell : leaf.cells) n += leaf_cell_size(cell.second.size());
     return n;
 }
 
-static InternalData load_internal(Page& page) {
+static InternalData load_internal(const uint8_t* d) {
     InternalData in;
-    const uint8_t* d = page.data.data();
     uint16_t ncell = read16(d + 2);
     in.child0 = read32(d + 4);
     in.cells.reserve(ncell);
@@ -128,173 +272,483 @@ static size_t internal_size(const InternalData& in) {
     return 8 + in.cells.size() * 12;
 }
 
+// Index of the child of internal page `d` whose subtree holds `key`: a
+// binary search straight over the fixed-stride cells, no copies.
+static size_t internal_child_for(const uint8_t* d, int64_t key) {
+    size_t lo = 0, hi = read16(d + 2);
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (read64(d + 8 + 12 * mid) <= key) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+static uint32_t internal_child(const uint8_t* d, size_t i) {
+    return i == 0 ? read32(d + 4) : read32(d + 8 + 12 * (i - 1) + 8);
+}
+
+// Insert or replace a cell directly in the page bytes: shift the slot
+// array by one entry and carve the cell out of the gap above it. Returns
+// false when the gap is too small, leaving the page untouched for the
+// rebuild/split path.
+static bool leaf_insert_inplace(Page& page, int64_t key, std::string_view body) {
+    uint8_t* d = page.data.data();
+    size_t ncell = leaf_ncell(d);
+    size_t content = leaf_content(d);
+    size_t frag = read16(d + 10);
+    size_t i = leaf_lower_bound(d, key);
+    bool replace = i < ncell && leaf_key(d, i) == key;
+    if (replace) {
+        uint8_t* cell = d + read16(d + LEAF_HDR + SLOT_SIZE * i);
+        size_t old_len = body_size(cell + 8);
+        if (body.size() <= old_len) {
+            std::memmove(cell + 8, body.data(), body.size());
+            write16(d + 10, static_cast<uint16_t>(frag + old_len - body.size()));
+            return true;
+        }
+    }
+    size_t need = 8 + body.size();
+    size_t slots_end = LEAF_HDR + SLOT_SIZE * (replace ? ncell : ncell + 1);
+    if (slots_end > content || content - slots_end < need) return false;
+    if (replace) {
+        frag += 8 + body_size(leaf_cell(d, i) + 8);
+    } else {
+        uint8_t* slot = d + LEAF_HDR + SLOT_SIZE * i;
+        std::memmove(slot + SLOT_SIZE, slot, SLOT_SIZE * (ncell - i));
+        write16(d + 2, static_cast<uint16_t>(ncell + 1));
+    }
+    content -= need;
+    write64(d + content, key);
+    std::memmove(d + content + 8, body.data(), body.size());
+    write16(d + LEAF_HDR + SLOT_SIZE * i, static_cast<uint16_t>(content));
+    write16(d + 8, static_cast<uint16_t>(content));
+    write16(d + 10, static_cast<uint16_t>(frag));
+    d[0] = LEAF;
+    return true;
+}
+
+// First cell of the right half. Appends to the rightmost leaf keep every
+// existing cell on the left page and start the new page with the new
+// cell, so sequential inserts leave full pages behind them.
+static size_t leaf_split_point(const LeafData& leaf, bool appending) {
+    if (appending) return leaf.cells.size() - 1;
+    size_t sz = 0, i = 0;
+    for (; i < leaf.cells.size(); ++i) {
+        size_t cell_sz = leaf_cell_size(leaf.cells[i].second.size());
+        if (sz + cell_sz > (PAGE_SIZE - LEAF_HDR) / 2 && i > 0) break;
+        sz += cell_sz;
+    }
+    return i;
+}
+
 struct InsertResult { bool split{false}; int64_t key{0}; uint32_t pgno{0}; };
 
-static InsertResult insert_node(BTree& t, uint32_t pgno, bool is_root,
-                               Key k, std::string_view payload) {
-    Page& page = t.pager().get(pgno);
-    uint8_t type = page.data[0];
+static InsertResult insert_node(BTree& t, uint32_t pgno, bool is_root, bool rightmost,
+                               Key k, std::string_view body) {
+    PageRef page = t.pager().acquire(pgno);
+    uint8_t type = page->data[0];
     if (type == LEAF || type == 0) {
-        LeafData leaf = load_leaf(page);
+        const uint8_t* d = page->data.data();
+        size_t at = leaf_lower_bound(d, k.rowid);
+        if (at < leaf_ncell(d) && leaf_key(d, at) == k.rowid)
+            free_overflow(t.pager(), leaf_body(d, at));
+        if (leaf_insert_inplace(*page, k.rowid, body)) {
+            t.pager().mark_dirty(*page); return {};
+        }
+        // Slow path: rebuild the page (reclaiming fragmented space) or split.
+        LeafData leaf = load_leaf(*page);
         auto it = std::lower_bound(leaf.cells.begin(), leaf.cells.end(), k.rowid,
             [](const auto& a, int64_t key){ return a.first < key; });
-        if (it != leaf.cells.end() && it->first == k.rowid) it->second = payload;
-        else leaf.cells.insert(it, {k.rowid, payload});
+        bool appending = rightmost && it == leaf.cells.end();
+        if (it != leaf.cells.end() && it->first == k.rowid) it->second = body;
+        else leaf.cells.insert(it, {k.rowid, body});
         if (leaf_size(leaf) <= PAGE_SIZE) {
-            store_leaf(page, leaf); t.pager().mark_dirty(page); return {};
+            store_leaf(*page, leaf); t.pager().mark_dirty(*page); return {};
         }
         if (is_root) {
-            size_t sz = 0, i = 0;
-            for (; i < leaf.cells.size(); ++i) {
-                size_t cell_sz = 10 + leaf.cells[i].second.size();
-                if (sz + cell_sz > PAGE_SIZE / 2 && i > 0) break;
-                sz += cell_sz;
-            }
+            size_t i = leaf_split_point(leaf, appending);
             LeafData left, right;
             left.cells.assign(leaf.cells.begin(), leaf.cells.begin() + i);
             right.cells.assign(leaf.cells.begin() + i, leaf.cells.end());
-            uint32_t left_pg = t.pager().alloc();
-            uint32_t right_pg = t.pager().alloc();
+            uint32_t left_pg = t.pager().alloc(pgno);
+            uint32_t right_pg = t.pager().alloc(left_pg);
             left.next = right_pg;
             right.next = leaf.next;
-            Page& lp = t.pager().get(left_pg);
-            Page& rp = t.pager().get(right_pg);
-            store_leaf(lp, left); t.pager().mark_dirty(lp);
-            store_leaf(rp, right); t.pager().mark_dirty(rp);
+            PageRef lp = t.pager().acquire(left_pg);
+            PageRef rp = t.pager().acquire(right_pg);
+            store_leaf(*lp, left); t.pager().mark_dirty(*lp);
+            store_leaf(*rp, right); t.pager().mark_dirty(*rp);
             InternalData root;
             root.child0 = left_pg;
             root.cells.push_back({right.cells.front().first, right_pg});
-            store_internal(page, root); t.pager().mark_dirty(page);
+            store_internal(*page, root); t.pager().mark_dirty(*page);
             return {};
         } else {
-            size_t sz = 0, i = 0;
-            for (; i < leaf.cells.size(); ++i) {
-                size_t cell_sz = 10 + leaf.cells[i].second.size();
-                if (sz + cell_sz > PAGE_SIZE / 2 && i > 0) break;
-                sz += cell_sz;
-            }
+            size_t i = leaf_split_point(leaf, appending);
             LeafData right;
             right.cells.assign(leaf.cells.begin() + i, leaf.cells.end());
             leaf.cells.erase(leaf.cells.begin() + i, leaf.cells.end());
             right.next = leaf.next;
-            uint32_t new_pgno = t.pager().alloc();
+            uint32_t new_pgno = t.pager().alloc(pgno);
             leaf.next = new_pgno;
-            Page& new_page = t.pager().get(new_pgno);
-            store_leaf(page, leaf); t.pager().mark_dirty(page);
-            store_leaf(new_page, right); t.pager().mark_dirty(new_page);
+            PageRef new_page = t.pager().acquire(new_pgno);
+            store_leaf(*new_page, right); t.pager().mark_dirty(*new_page);
+            store_leaf(*page, leaf); t.pager().mark_dirty(*page);
             return {true, right.cells.front().first, new_pgno};
         }
     } else { // INTERNAL
-        InternalData in = load_internal(page);
-        uint32_t child = in.child0;
-        size_t pos = 0;
-        while (pos < in.cells.size() && k.rowid >= in.cells[pos].first) {
-            child = in.cells[pos].second;
-            ++pos;
-        }
-        auto res = insert_node(t, child, false, k, payload);
+        const uint8_t* d = page->data.data();
+        size_t pos = internal_child_for(d, k.rowid);
+        bool last_child = pos == read16(d + 2);
+        auto res = insert_node(t, internal_child(d, pos), false, rightmost && last_child, k, body);
         if (!res.split) return {};
+        // Only a child split needs the node's cells materialised.
+        InternalData in = load_internal(page->data.data());
         in.cells.insert(in.cells.begin() + pos, {res.key, res.pgno});
+        // Splitting off only the new rightmost child keeps the left node full.
+        bool appending = rightmost && last_child;
         if (internal_size(in) <= PAGE_SIZE) {
-            store_internal(page, in); t.pager().mark_dirty(page); return {};
+            store_internal(*page, in); t.pager().mark_dirty(*page); return {};
         }
         if (is_root) {
-            size_t mid = in.cells.size() / 2;
+            size_t mid = appending ? in.cells.size() - 1 : in.cells.size() / 2;
             InternalData left, right;
             left.child0 = in.child0;
             left.cells.assign(in.cells.begin(), in.cells.begin() + mid);
             right.child0 = in.cells[mid].second;
             right.cells.assign(in.cells.begin() + mid + 1, in.cells.end());
             int64_t up_key = in.cells[mid].first;
-            uint32_t left_pg = t.pager().alloc();
-            uint32_t right_pg = t.pager().alloc();
-            Page& lp = t.pager().get(left_pg);
-            Page& rp = t.pager().get(right_pg);
-            store_internal(lp, left); t.pager().mark_dirty(lp);
-            store_internal(rp, right); t.pager().mark_dirty(rp);
+            uint32_t left_pg = t.pager().alloc(pgno);
+            uint32_t right_pg = t.pager().alloc(left_pg);
+            PageRef lp = t.pager().acquire(left_pg);
+            PageRef rp = t.pager().acquire(right_pg);
+            store_internal(*lp, left); t.pager().mark_dirty(*lp);
+            store_internal(*rp, right); t.pager().mark_dirty(*rp);
             InternalData root;
             root.child0 = left_pg;
             root.cells.push_back({up_key, right_pg});
-            store_internal(page, root); t.pager().mark_dirty(page);
+            store_internal(*page, root); t.pager().mark_dirty(*page);
             return {};
         } else {
-            size_t mid = in.cells.size() / 2;
+            size_t mid = appending ? in.cells.size() - 1 : in.cells.size() / 2;
             InternalData right;
             int64_t up_key = in.cells[mid].first;
             right.child0 = in.cells[mid].second;
             right.cells.assign(in.cells.begin() + mid + 1, in.cells.end());
             in.cells.erase(in.cells.begin() + mid, in.cells.end());
-            uint32_t new_pgno = t.pager().alloc();
-            Page& np = t.pager().get(new_pgno);
-            store_internal(page, in); t.pager().mark_dirty(page);
-            store_internal(np, right); t.pager().mark_dirty(np);
+            uint32_t new_pgno = t.pager().alloc(pgno);
+            PageRef np = t.pager().acquire(new_pgno);
+            store_internal(*page, in); t.pager().mark_dirty(*page);
+            store_internal(*np, right); t.pager().mark_dirty(*np);
             return {true, up_key, new_pgno};
         }
     }
 }
 
-static bool seek_leaf(BTree& t, uint32_t pgno, int64_t key, Cursor& c) {
-    Page& page = t.pager().get(pgno);
-    const uint8_t* d = page.data.data();
-    uint16_t ncell = read16(d + 2);
-    size_t off = 8;
-    for (uint16_t i = 0; i < ncell; ++i) {
-        int64_t k = read64(d + off);
-        if (k >= key) {
-            c.pgno = pgno; c.idx = i; return (k == key);
-        }
-        uint16_t len = read16(d + off + 8);
-        off += 10 + len;
-    }
-    c.pgno = pgno; c.idx = ncell; return false;
+static bool seek_leaf(const uint8_t* d, uint32_t pgno, int64_t key, Cursor& c) {
+    size_t i = leaf_lower_bound(d, key);
+    c.pgno = pgno; c.idx = static_cast<int>(i);
+    return i < leaf_ncell(d) && leaf_key(d, i) == key;
 }
 
 static bool seek_node(BTree& t, uint32_t pgno, int64_t key, Cursor& c) {
-    Page& page = t.pager().get(pgno);
-    uint8_t type = page.data[0];
-    if (type == LEAF || type == 0) return seek_leaf(t, pgno, key, c);
-    InternalData in = load_internal(page);
-    uint32_t child = in.child0;
-    for (auto& cell : in.cells) {
-        if (key < cell.first) break;
-        child = cell.second;
+    while (true) {
+        const uint8_t* d = t.pager().view(pgno);
+        if (d[0] == LEAF || d[0] == 0) return seek_leaf(d, pgno, key, c);
+        pgno = internal_child(d, internal_child_for(d, key));
+    }
+}
+
+// The rightmost leaf of a tree is the only leaf without a right sibling.
+static bool is_rightmost_leaf(const uint8_t* d) {
+    return d[0] == LEAF && read32(d + 4) == 0;
+}
+
+static uint32_t rightmost_leaf(BTree& t, uint32_t root) {
+    uint32_t pgno = root;
+    while (true) {
+        const uint8_t* d = t.pager().view(pgno);
+        if (d[0] != INTERNAL) return pgno;
+        uint16_t ncell = read16(d + 2);
+        pgno = ncell ? read32(d + 8 + 12 * (ncell - 1) + 8) : read32(d + 4);
     }
-    return seek_node(t, child, key, c);
 }
 
-static bool check_node(BTree& t, uint32_t pgno, int64_t min, int64_t max, int64_t& last) {
-    Page& page = t.pager().get(pgno);
-    uint8_t type = page.data[0];
+struct CheckState {
+    int64_t last{std::numeric_limits<int64_t>::min()};
+    uint32_t prev_leaf{0}; // the leaf chain must visit leaves in key order
+};
+
+static bool check_node(BTree& t, uint32_t pgno, bool is_root, int64_t min, int64_t max,
+                       CheckState& st) {
+    PageRef page = t.pager().acquire(pgno);
+    uint8_t type = page->data[0];
     if (type == LEAF || type == 0) {
-        LeafData leaf = load_leaf(page);
+        if (!leaf_valid(page->data.data())) return false;
+        LeafData leaf = load_leaf(*page);
         if (leaf_size(leaf) > PAGE_SIZE) return false;
+        if (leaf.cells.empty() && !is_root) return false;
+        if (st.prev_leaf != 0 && read32(t.pager().view(st.prev_leaf) + 4) != pgno) return false;
+        st.prev_leaf = pgno;
         for (auto& cell : leaf.cells) {
             if (cell.first < min || cell.first > max) return false;
-            if (cell.first < last) return false;
-            last = cell.first;
-        }
-        if (leaf.next != 0) {
-            Page& np = t.pager().get(leaf.next);
-            if (np.data[0] != LEAF) return false;
-            LeafData nl = load_leaf(np);
-            if (!nl.cells.empty() && nl.cells.front().first < last) return false;
+            if (cell.first < st.last) return false;
+            st.last = cell.first;
+            PayloadRef p = body_payload(cell.second);
+            if (p.overflow == 0) continue;
+            if (p.total <= MAX_INLINE || p.local.size() >= p.total) return false;
+            size_t pages = 0;
+            for (uint32_t o = p.overflow; o != 0; o = read32(t.pager().view(o))) {
+                if (++pages > (p.total - p.local.size() + OVERFLOW_DATA - 1) / OVERFLOW_DATA)
+                    return false;
+            }
+            if (pages * OVERFLOW_DATA < p.total - p.local.size()) return false;
         }
         return true;
     } else {
-        InternalData in = load_internal(page);
+        InternalData in = load_internal(page->data.data());
+        page.reset();
         if (internal_size(in) > PAGE_SIZE) return false;
         int64_t prev = min;
         uint32_t child = in.child0;
         for (auto& cell : in.cells) {
             if (cell.first < prev || cell.first > max) return false;
-            if (!check_node(t, child, prev, cell.first, last)) return false;
+            if (!check_node(t, child, false, prev, cell.first, st)) return false;
             child = cell.second;
             prev = cell.first;
         }
-        return check_node(t, child, prev, max, last);
+        return check_node(t, child, false, prev, max, st);
+    }
+}
+
+static size_t child_index(const InternalData& in, uint32_t pgno) {
+    if (in.child0 == pgno) return 0;
+    for (size_t i = 0; i < in.cells.size(); ++i)
+        if (in.cells[i].second == pgno) return i + 1;
+    return SIZE_MAX;
+}
+
+static uint32_t child_at(const InternalData& in, size_t i) {
+    return i == 0 ? in.child0 : in.cells[i - 1].second;
+}
+
+static uint32_t leftmost_leaf(BTree& t, uint32_t pgno) {
+    while (true) {
+        const uint8_t* d = t.pager().view(pgno);
+        if (d[0] != INTERNAL) return pgno;
+        pgno = read32(d + 4);
+    }
+}
+
+// Leaf holding the largest key below `key`, found by descent alone since
+// the leaf chain may be broken while a range erase relinks it. 0 if none.
+static uint32_t leaf_before(BTree& t, uint32_t root, int64_t key) {
+    uint32_t pgno = root, left = 0;
+    while (true) {
+        const uint8_t* d = t.pager().view(pgno);
+        if (d[0] != INTERNAL) {
+            if (leaf_lower_bound(d, key) > 0) return pgno;
+            return left ? rightmost_leaf(t, left) : 0;
+        }
+        size_t i = internal_child_for(d, key);
+        if (i > 0) left = internal_child(d, i - 1);
+        pgno = internal_child(d, i);
     }
 }
 
+// Leaf holding the smallest key above `key`, or 0 if none.
+static uint32_t leaf_after(BTree& t, uint32_t root, int64_t key) {
+    if (key == std::numeric_limits<int64_t>::max()) return 0;
+    uint32_t pgno = root, right = 0;
+    while (true) {
+        const uint8_t* d = t.pager().view(pgno);
+        if (d[0] != INTERNAL) {
+            if (leaf_lower_bound(d, key + 1) < leaf_ncell(d)) return pgno;
+            return right ? leftmost_leaf(t, right) : 0;
+        }
+        size_t i = internal_child_for(d, key);
+        if (i < read16(d + 2)) right = internal_child(d, i + 1);
+        pgno = internal_child(d, i);
+    }
+}
+
+// Bytes used by a leaf's live cells, header and slots included.
+static size_t leaf_used(const uint8_t* d) {
+    return LEAF_HDR + SLOT_SIZE * leaf_ncell(d) + (PAGE_SIZE - leaf_content(d)) - read16(d + 10);
+}
+
+// Pages less than a quarter full are merged with or refilled from a sibling.
+static bool underfull(const uint8_t* d) {
+    if (d[0] == INTERNAL) return 8 + 12 * size_t(read16(d + 2)) < PAGE_SIZE / 4;
+    return leaf_used(d) < PAGE_SIZE / 4;
+}
+
+// Remove cells [a, b) of a leaf in place, freeing their overflow chains.
+// The space they held is counted as fragmented until the next rebuild.
+static void leaf_remove(Pager& pager, Page& page, size_t a, size_t b) {
+    uint8_t* d = page.data.data();
+    size_t ncell = leaf_ncell(d);
+    size_t frag = read16(d + 10);
+    for (size_t i = a; i < b; ++i) {
+        std::string_view body = leaf_body(d, i);
+        free_overflow(pager, body);
+        frag += 8 + body.size();
+    }
+    uint8_t* slot = d + LEAF_HDR + SLOT_SIZE * a;
+    std::memmove(slot, slot + SLOT_SIZE * (b - a), SLOT_SIZE * (ncell - b));
+    ncell -= b - a;
+    write16(d + 2, static_cast<uint16_t>(ncell));
+    if (ncell == 0) {
+        write16(d + 8, static_cast<uint16_t>(PAGE_SIZE));
+        frag = 0;
+    }
+    write16(d + 10, static_cast<uint16_t>(frag));
+    pager.mark_dirty(page);
+}
+
+// Free every page of a subtree, overflow chains included. Returns the
+// number of rows it held; cells are only inspected for overflow chains.
+static uint64_t drop_subtree(Pager& pager, uint32_t pgno) {
+    uint64_t rows = 0;
+    {
+        PageRef page = pager.acquire(pgno);
+        const uint8_t* d = page->data.data();
+        if (d[0] == INTERNAL) {
+            InternalData in = load_internal(d);
+            page.reset();
+            for (size_t i = 0; i <= in.cells.size(); ++i)
+                rows += drop_subtree(pager, child_at(in, i));
+        } else {
+            rows = leaf_ncell(d);
+            for (size_t i = 0; i < rows; ++i) free_overflow(pager, leaf_body(d, i));
+        }
+    }
+    pager.free(pgno);
+    return rows;
+}
+
+// Merge child i of `in` with a neighbour under the same parent, or share
+// their contents evenly if together they overflow a page. The right page
+// of a merged pair is freed; the leaf chain stays intact because the left
+// page inherits the right page's next pointer.
+static void rebalance(Pager& pager, InternalData& in, size_t i) {
+    size_t li = i > 0 ? i - 1 : 0;
+    PageRef lp = pager.acquire(child_at(in, li));
+    PageRef rp = pager.acquire(child_at(in, li + 1));
+    auto& sep = in.cells[li];
+    bool merged = false;
+    if (lp->data[0] == INTERNAL) {
+        InternalData l = load_internal(lp->data.data());
+        InternalData r = load_internal(rp->data.data());
+        l.cells.emplace_back(sep.first, r.child0);
+        l.cells.insert(l.cells.end(), r.cells.begin(), r.cells.end());
+        if (internal_size(l) <= PAGE_SIZE) {
+            store_internal(*lp, l);
+            merged = true;
+        } else {
+            size_t mid = l.cells.size() / 2;
+            InternalData right;
+            right.child0 = l.cells[mid].second;
+            right.cells.assign(l.cells.begin() + mid + 1, l.cells.end());
+            sep.first = l.cells[mid].first;
+            l.cells.erase(l.cells.begin() + mid, l.cells.end());
+            store_internal(*lp, l);
+            store_internal(*rp, right);
+            pager.mark_dirty(*rp);
+        }
+    } else {
+        // Cells are views into both pages; read them from copies.
+        Page lcopy = *lp, rcopy = *rp;
+        LeafData l = load_leaf(lcopy), r = load_leaf(rcopy);
+        l.cells.insert(l.cells.end(), r.cells.begin(), r.cells.end());
+        if (leaf_size(l) <= PAGE_SIZE) {
+            l.next = r.next;
+            store_leaf(*lp, l);
+            merged = true;
+        } else {
+            size_t split = leaf_split_point(l, false);
+            LeafData right;
+            right.cells.assign(l.cells.begin() + split, l.cells.end());
+            l.cells.erase(l.cells.begin() + split, l.cells.end());
+            right.next = r.next;
+            l.next = rp->no;
+            sep.first = right.cells.front().first;
+            store_leaf(*lp, l);
+            store_leaf(*rp, right);
+            pager.mark_dirty(*rp);
+        }
+    }
+    pager.mark_dirty(*lp);
+    if (merged) {
+        uint32_t gone = rp->no;
+        rp.reset();
+        pager.free(gone);
+        in.cells.erase(in.cells.begin() + li);
+    }
+}
+
+struct EraseResult { uint64_t rows{0}; bool empty{false}; };
+
+// Erase keys in [lo, hi] below `pgno`, whose subtree covers [node_lo,
+// node_hi]. Children wholly inside the range are dropped without visiting
+// their cells; the (at most two) partially covered children are recursed
+// into and rebalanced afterwards. Sets `relink` when leaves were removed
+// from the leaf chain.
+static EraseResult erase_node(BTree& t, uint32_t pgno, int64_t lo, int64_t hi,
+                              int64_t node_lo, int64_t node_hi, bool& relink) {
+    Pager& pager = t.pager();
+    PageRef page = pager.acquire(pgno);
+    const uint8_t* d = page->data.data();
+    if (d[0] != INTERNAL) {
+        size_t a = leaf_lower_bound(d, lo);
+        size_t b = hi == std::numeric_limits<int64_t>::max() ? leaf_ncell(d)
+                                                             : leaf_lower_bound(d, hi + 1);
+        if (a >= b) return {};
+        leaf_remove(pager, *page, a, b);
+        return {b - a, leaf_ncell(d) == 0};
+    }
+    InternalData in = load_internal(d);
+    InternalData out;
+    std::vector<uint32_t> partial;
+    EraseResult res;
+    size_t kept = 0;
+    for (size_t i = 0; i <= in.cells.size(); ++i) {
+        int64_t clo = i == 0 ? node_lo : in.cells[i - 1].first;
+        int64_t chi = i == in.cells.size() ? node_hi : in.cells[i].first - 1;
+        uint32_t child = child_at(in, i);
+        if (lo <= clo && chi <= hi) {
+            res.rows += drop_subtree(pager, child);
+            relink = true;
+            continue;
+        }
+        if (clo <= hi && chi >= lo) {
+            EraseResult sub = erase_node(t, child, lo, hi, clo, chi, relink);
+            res.rows += sub.rows;
+            if (sub.empty) {
+                pager.free(child);
+                relink = true;
+                continue;
+            }
+            if (sub.rows) partial.push_back(child);
+        }
+        if (kept++ == 0) out.child0 = child;
+        else out.cells.emplace_back(clo, child);
+    }
+    if (kept == 0) return {res.rows, true};
+    bool changed = kept != in.cells.size() + 1;
+    for (uint32_t child : partial) {
+        size_t i = child_index(out, child);
+        if (out.cells.empty() || i == SIZE_MAX || !underfull(pager.view(child))) continue;
+        rebalance(pager, out, i);
+        changed = true;
+    }
+    if (changed) {
+        store_internal(*page, out);
+        pager.mark_dirty(*page);
+    }
+    return res;
+}
+
 } // namespace
 
 BTree::BTree(Pager& p) : pager_(p) {}
@@ -306,65 +760,306 @@ uint32_t BTree::create_table() {
     d[0] = LEAF;
     write16(d + 2, 0);
     write32(d + 4, 0);
+    write16(d + 8, static_cast<uint16_t>(PAGE_SIZE));
     pager_.mark_dirty(page);
     return pgno;
 }
 
 void BTree::insert(uint32_t root, Key k, std::string_view payload) {
-    insert_node(*this, root, true, k, payload);
+    auto hint = append_hints_.find(root);
+    std::string_view body = encode_body(
+        pager_, payload, hint != append_hints_.end() ? hint->second : root, cell_);
+    if (hint != append_hints_.end()) {
+        // Append fast path: a key above the current maximum belongs on the
+        // rightmost leaf, so skip the descent when the cell fits there.
+        Page& leaf = pager_.get(hint->second);
+        const uint8_t* d = leaf.data.data();
+        uint16_t ncell = leaf_ncell(d);
+        if (is_rightmost_leaf(d) && ncell > 0 && k.rowid > leaf_key(d, ncell - 1) &&
+            leaf_insert_inplace(leaf, k.rowid, body)) {
+            pager_.mark_dirty(leaf);
+            return;
+        }
+    }
+    insert_node(*this, root, true, true, k, body);
+    if (hint == append_hints_.end() || !is_rightmost_leaf(pager_.view(hint->second)))
+        append_hints_[root] = rightmost_leaf(*this, root);
 }
 
-Cursor BTree::open(uint32_t root) { return Cursor{root, root, 0}; }
+// Give `root` the internal levels above `level`, the (first key, page) of
+// each leaf of a bulk load, packing them to `fill` of a page.
+static void build_levels(BTree& t, uint32_t root, std::vector<std::pair<int64_t, uint32_t>> level,
+                         double fill) {
+    Pager& pager = t.pager();
+    // Build internal levels until the remaining entries fit in the root.
+    const size_t max_cells = (PAGE_SIZE - 8) / 12;
+    const size_t target_cells = std::max<size_t>(static_cast<size_t>(fill * max_cells), 1);
+    while (level.size() > max_cells + 1) {
+        std::vector<std::pair<int64_t, uint32_t>> up;
+        for (size_t i = 0; i < level.size(); i += target_cells + 1) {
+            size_t end = std::min(level.size(), i + target_cells + 1);
+            InternalData in;
+            in.child0 = level[i].second;
+            in.cells.assign(level.begin() + i + 1, level.begin() + end);
+            uint32_t pgno = pager.alloc();
+            Page& page = pager.get(pgno);
+            store_internal(page, in);
+            pager.mark_dirty(page);
+            up.emplace_back(level[i].first, pgno);
+        }
+        level.swap(up);
+    }
+    InternalData top;
+    top.child0 = level.front().second;
+    top.cells.assign(level.begin() + 1, level.end());
+    Page& page = pager.get(root);
+    store_internal(page, top);
+    pager.mark_dirty(page);
+}
+
+bool BTree::bulk_load(uint32_t root, const RowSource& next, double fill) {
+    {
+        const uint8_t* d = pager_.get(root).data.data();
+        if (d[0] != LEAF || leaf_ncell(d) != 0) return false;
+    }
+    // A fill past 1 would plan cells beyond the end of the page; 0 puts
+    // one row in each leaf.
+    fill = fill > 0.0 ? std::min(fill, 1.0) : 0.0;
+    const size_t leaf_target = static_cast<size_t>(fill * PAGE_SIZE);
+    // Level above the leaves: (first key, page) of every finished page.
+    std::vector<std::pair<int64_t, uint32_t>> level;
+    // The first leaf is built in the root page itself and only moved out
+    // once a second leaf is needed, so small loads stay a single page.
+    PageRef leaf = pager_.acquire(root);
+    Key k;
+    std::string payload;
+    int64_t prev = 0;
+    bool any = false;
+    try {
+        while (next(k, payload)) {
+            if (any && k.rowid <= prev) throw std::runtime_error("bulk_load: keys not increasing");
+            std::string_view body = encode_body(pager_, payload, leaf->no, cell_);
+            const uint8_t* d = leaf->data.data();
+            uint16_t ncell = leaf_ncell(d);
+            size_t used = LEAF_HDR + SLOT_SIZE * ncell + (PAGE_SIZE - leaf_content(d));
+            if (ncell > 0 && used + leaf_cell_size(body.size()) > leaf_target) {
+                if (leaf->no == root) {
+                    uint32_t moved = pager_.alloc(root);
+                    PageRef copy = pager_.acquire(moved);
+                    copy->data = leaf->data;
+                    pager_.mark_dirty(*copy);
+                    level.emplace_back(leaf_key(d, 0), moved);
+                    leaf = std::move(copy);
+                }
+                uint32_t pgno = pager_.alloc(leaf->no);
+                write32(leaf->data.data() + 4, pgno);
+                pager_.mark_dirty(*leaf);
+                leaf = pager_.acquire(pgno);
+                uint8_t* nd = leaf->data.data();
+                nd[0] = LEAF;
+                write16(nd + 8, static_cast<uint16_t>(PAGE_SIZE));
+                level.emplace_back(k.rowid, pgno);
+            }
+            if (!leaf_insert_inplace(*leaf, k.rowid, body)) {
+                free_overflow(pager_, body);
+                throw std::runtime_error("bulk_load: cell does not fit");
+            }
+            pager_.mark_dirty(*leaf);
+            prev = k.rowid;
+            any = true;
+        }
+    } catch (...) {
+        // Finish the tree over the rows loaded so far, then erase them,
+        // which frees every page the load took.
+        leaf.reset();
+        if (!level.empty()) build_levels(*this, root, std::move(level), fill);
+        erase_range(root, std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max());
+        throw;
+    }
+    append_hints_[root] = leaf->no;
+    leaf.reset();
+    if (!level.empty()) build_levels(*this, root, std::move(level), fill);
+    return true;
+}
+
+Cursor BTree::open(uint32_t root) { return Cursor{root, root, 0, false, {}, {}}; }
+
+const uint8_t* BTree::pin(Cursor& c) {
+    if (c.page && c.page->no == c.pgno) return c.page->data.data();
+    return pager_.view(c.pgno, c.page);
+}
+
+const uint8_t* BTree::leaf_of(const Cursor& c) {
+    if (c.page && c.page->no == c.pgno) return c.page->data.data();
+    return pager_.view(c.pgno);
+}
 
 bool BTree::seek(Cursor& c, int64_t key) {
-    return seek_node(*this, c.root, key, c);
+    c.skip_next = false;
+    bool found = seek_node(*this, c.root, key, c);
+    // Past the end of a leaf: the next key, if any, starts the next leaf.
+    const uint8_t* d = pin(c);
+    if (!found && c.idx >= leaf_ncell(d) && read32(d + 4) != 0) {
+        c.pgno = read32(d + 4);
+        c.idx = 0;
+        pin(c);
+    }
+    return found;
+}
+
+bool BTree::valid(const Cursor& c) {
+    const uint8_t* d = leaf_of(c);
+    return d[0] != INTERNAL && c.idx >= 0 && c.idx < leaf_ncell(d);
+}
+
+bool BTree::last(Cursor& c) {
+    auto hint = append_hints_.find(c.root);
+    if (hint == append_hints_.end() || !is_rightmost_leaf(pager_.view(hint->second)))
+        hint = append_hints_.insert_or_assign(c.root, rightmost_leaf(*this, c.root)).first;
+    c.skip_next = false;
+    c.pgno = hint->second;
+    uint16_t ncell = leaf_ncell(pin(c));
+    c.idx = ncell ? ncell - 1 : 0;
+    return ncell > 0;
 }
 
 bool BTree::next(Cursor& c) {
-    Page& page = pager_.get(c.pgno);
-    const uint8_t* d = page.data.data();
+    if (c.skip_next) {
+        c.skip_next = false;
+        return valid(c);
+    }
+    const uint8_t* d = leaf_of(c);
     uint16_t ncell = read16(d + 2);
     if (c.idx + 1 < ncell) { ++c.idx; return true; }
     uint32_t next = read32(d + 4);
     if (next == 0) return false;
-    c.pgno = next; c.idx = 0; Page& np = pager_.get(c.pgno); return read16(np.data.data() + 2) > 0;
+    c.pgno = next; c.idx = 0;
+    return leaf_ncell(pin(c)) > 0;
 }
 
-std::string_view BTree::read_payload(const Cursor& c) {
-    Page& page = pager_.get(c.pgno);
-    const uint8_t* d = page.data.data();
-    uint16_t ncell = read16(d + 2);
-    size_t off = 8;
-    for (uint16_t i = 0; i < ncell; ++i) {
-        uint16_t len = read16(d + off + 8);
-        if (static_cast<int>(i) == c.idx) {
-            tmp_.assign(reinterpret_cast<const char*>(d + off + 10), len);
-            return tmp_;
-        }
-        off += 10 + len;
+std::string_view BTree::read_payload(Cursor& c, size_t limit) {
+    if (!valid(c)) return {};
+    PayloadRef p = body_payload(leaf_body(pin(c), static_cast<size_t>(c.idx)));
+    size_t want = std::min<size_t>(limit, p.total);
+    if (want <= p.local.size()) return p.local.substr(0, want);
+    c.spill.assign(p.local);
+    // Follow the overflow chain only as far as the caller asked for.
+    append_overflow(p.overflow, want, c.spill);
+    return c.spill;
+}
+
+void BTree::append_overflow(uint32_t pgno, size_t want, std::string& out) {
+    for (uint32_t o = pgno; out.size() < want && o != 0;) {
+        const uint8_t* od = pager_.view(o);
+        out.append(reinterpret_cast<const char*>(od + 4),
+                   std::min(OVERFLOW_DATA, want - out.size()));
+        o = read32(od);
+    }
+}
+
+size_t BTree::leaf_run(Cursor& c, CellView* out, size_t max) {
+    c.skip_next = false;
+    if (!valid(c) || max == 0) return 0;
+    const uint8_t* d = pin(c);
+    size_t first = static_cast<size_t>(c.idx);
+    size_t n = std::min<size_t>(leaf_ncell(d) - first, max);
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t* cell = leaf_cell(d, first + i);
+        PayloadRef p = body_payload(leaf_body(d, first + i));
+        out[i] = CellView{read64(cell), p.local, p.total, p.overflow};
     }
-    tmp_.clear();
-    return tmp_;
+    c.idx = static_cast<int>(first + n - 1);
+    return n;
+}
+
+void BTree::read_overflow(const CellView& cell, std::string& out) {
+    out.assign(cell.local);
+    append_overflow(cell.overflow, cell.total, out);
+}
+
+std::string_view BTree::local_payload(Cursor& c) {
+    if (!valid(c)) return {};
+    return body_payload(leaf_body(pin(c), static_cast<size_t>(c.idx))).local;
+}
+
+size_t BTree::payload_size(const Cursor& c) {
+    if (!valid(c)) return 0;
+    return body_payload(leaf_body(leaf_of(c), static_cast<size_t>(c.idx))).total;
 }
 
 int64_t BTree::key(const Cursor& c) {
-    Page& page = pager_.get(c.pgno);
-    const uint8_t* d = page.data.data();
-    uint16_t ncell = read16(d + 2);
-    size_t off = 8;
-    for (uint16_t i = 0; i < ncell; ++i) {
-        int64_t k = read64(d + off);
-        uint16_t len = read16(d + off + 8);
-        if (static_cast<int>(i) == c.idx) return k;
-        off += 10 + len;
+    if (!valid(c)) return 0;
+    return leaf_key(leaf_of(c), static_cast<size_t>(c.idx));
+}
+
+uint64_t BTree::count(uint32_t root) {
+    uint64_t n = 0;
+    for (uint32_t pgno = leftmost_leaf(*this, root); pgno != 0;) {
+        const uint8_t* d = pager_.view(pgno);
+        n += leaf_ncell(d);
+        pgno = read32(d + 4);
+    }
+    return n;
+}
+
+bool BTree::erase(uint32_t root, int64_t key) {
+    return erase_range(root, key, key) > 0;
+}
+
+void BTree::erase(Cursor& c) {
+    if (!valid(c)) return;
+    int64_t k = key(c);
+    c.page.reset(); // the leaf may be merged away and freed
+    erase_range(c.root, k, k);
+    seek(c, k);
+    c.skip_next = true;
+}
+
+uint64_t BTree::erase_range(uint32_t root, int64_t lo, int64_t hi) {
+    if (lo > hi) return 0;
+    // The rightmost leaf may be merged away and its page reused.
+    append_hints_.erase(root);
+    bool relink = false;
+    EraseResult res = erase_node(*this, root, lo, hi, std::numeric_limits<int64_t>::min(),
+                                 std::numeric_limits<int64_t>::max(), relink);
+    if (res.empty) {
+        Page& page = pager_.get(root);
+        page.data.fill(0);
+        page.data[0] = LEAF;
+        write16(page.data.data() + 8, static_cast<uint16_t>(PAGE_SIZE));
+        pager_.mark_dirty(page);
+    }
+    // The root page number is fixed, so a root left with a single child
+    // takes over that child's contents instead.
+    while (true) {
+        PageRef page = pager_.acquire(root);
+        if (page->data[0] != INTERNAL || read16(page->data.data() + 2) != 0) break;
+        uint32_t child = read32(page->data.data() + 4);
+        page->data = pager_.get(child).data;
+        pager_.mark_dirty(*page);
+        page.reset();
+        pager_.free(child);
+    }
+    // Dropped leaves leave the last leaf before the range pointing at a
+    // freed page; point it at the first leaf after the range instead.
+    if (relink) {
+        uint32_t before = leaf_before(*this, root, lo);
+        uint32_t after = leaf_after(*this, root, hi);
+        if (before != 0 && before != after) {
+            Page& page = pager_.get(before);
+            write32(page.data.data() + 4, after);
+            pager_.mark_dirty(page);
+        }
     }
-    return 0;
+    return res.rows;
 }
 
 bool BTree::check(uint32_t root) {
-    int64_t last = std::numeric_limits<int64_t>::min();
-    return check_node(*this, root, std::numeric_limits<int64_t>::min(),
-                      std::numeric_limits<int64_t>::max(), last);
+    CheckState st;
+    if (!check_node(*this, root, true, std::numeric_limits<int64_t>::min(),
+                    std::numeric_limits<int64_t>::max(), st))
+        return false;
+    return st.prev_leaf == 0 || read32(pager_.view(st.prev_leaf) + 4) == 0;
 }
 
 } // namespace tinydb
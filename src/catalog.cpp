@@ -1,6 +1,8 @@
 #include "tinydb/catalog.hpp"
 #include "tinydb/btree.hpp"
 #include "tinydb/pager.hpp"
+#include "tinydb/record.hpp"
+#include <algorithm>
 #include <cstring>
 #include <limits>
 
@@ -23,6 +25,9 @@ static void write32(uint8_t* p, uint32_t v) {
     p[2] = static_cast<uint8_t>((v >> 16) & 0xFF);
     p[3] = static_cast<uint8_t>((v >> 24) & 0xFF);
 }
+// First byte of an index's name in its schema row; table names never
+// start with it.
+constexpr char INDEX_MARK = '\x01';
 } // namespace
 
 Catalog::Catalog(Pager& pager, BTree& bt) : pager_(&pager), btree_(&bt) {
@@ -33,42 +38,146 @@ Catalog::Catalog(Pager& pager, BTree& bt) : pager_(&pager), btree_(&bt) {
         write32(hdr.data.data() + 4, schema_root_);
         pager_->mark_dirty(hdr);
     }
+    reload();
+}
+
+void Catalog::reload() {
+    tables_.clear();
+    next_rowid_ = 1;
+    ++version_;
+    if (!btree_) return;
     Cursor c = btree_->open(schema_root_);
     btree_->seek(c, std::numeric_limits<int64_t>::min());
     Page& pg = pager_->get(c.pgno);
     if (read16(pg.data.data() + 2) == 0) { return; }
+    std::vector<std::pair<uint32_t, std::vector<std::string>>> indexes;
     while (true) {
         int64_t rowid = btree_->key(c);
         std::string_view payload = btree_->read_payload(c);
         if (payload.size() >= 4) {
             uint32_t root = read32(reinterpret_cast<const uint8_t*>(payload.data()));
-            std::string name(payload.substr(4));
-            tables_.emplace(name, TableInfo{name, root});
+            // Tables: [u32 root][name] followed by a NUL before each column
+            // name. Indexes: [u32 root][INDEX_MARK][name]\0[table]\0[column]...
+            bool index = payload.size() > 4 && payload[4] == INDEX_MARK;
+            std::vector<std::string> parts;
+            size_t start = index ? 5 : 4;
+            while (true) {
+                size_t end = payload.find('\0', start);
+                parts.emplace_back(payload.substr(start, end - start));
+                if (end == std::string_view::npos) break;
+                start = end + 1;
+            }
+            if (index) {
+                indexes.emplace_back(root, std::move(parts));
+            } else {
+                std::string name = parts.front();
+                parts.erase(parts.begin());
+                tables_.emplace(name, TableInfo{name, root, std::move(parts), {}});
+            }
         }
         if (rowid >= next_rowid_) next_rowid_ = rowid + 1;
         if (!btree_->next(c)) break;
     }
+    // An index naming a table or column that is not there is skipped.
+    for (auto& [root, parts] : indexes) {
+        if (parts.size() < 3) continue;
+        auto it = tables_.find(parts[1]);
+        if (it == tables_.end()) continue;
+        IndexInfo info{parts[0], root, {}};
+        for (size_t i = 2; i < parts.size(); ++i) info.cols.push_back(it->second.column(parts[i]));
+        if (std::find(info.cols.begin(), info.cols.end(), -1) != info.cols.end()) continue;
+        it->second.indexes.push_back(std::move(info));
+    }
 }
 
-bool Catalog::create_table(const std::string& name, uint32_t root) {
-    if (!tables_.emplace(name, TableInfo{name, root}).second) return false;
+bool Catalog::create_table(const std::string& name, uint32_t root,
+                           const std::vector<std::string>& cols) {
+    if (!tables_.emplace(name, TableInfo{name, root, cols, {}}).second) return false;
+    ++version_;
     if (btree_ && schema_root_) {
         std::string payload;
         payload.resize(4 + name.size());
         write32(reinterpret_cast<uint8_t*>(payload.data()), root);
         std::memcpy(payload.data() + 4, name.data(), name.size());
+        for (auto& col : cols) {
+            payload.push_back('\0');
+            payload += col;
+        }
         btree_->insert(schema_root_, {next_rowid_++}, payload);
     }
     return true;
 }
 
-uint32_t Catalog::create_table(const std::string& name) {
+uint32_t Catalog::create_table(const std::string& name, const std::vector<std::string>& cols) {
     if (!btree_) return 0;
+    if (tables_.count(name)) return 0;
     uint32_t root = btree_->create_table();
-    if (!create_table(name, root)) return 0;
+    create_table(name, root, cols);
     return root;
 }
 
+uint32_t Catalog::create_index(const std::string& name, const std::string& table,
+                               const std::vector<std::string>& cols) {
+    if (!btree_ || name.empty() || cols.empty()) return 0;
+    auto it = tables_.find(table);
+    if (it == tables_.end()) return 0;
+    for (auto& t : tables_)
+        for (auto& ix : t.second.indexes)
+            if (ix.name == name) return 0;
+    TableInfo& ti = it->second;
+    IndexInfo info{name, 0, {}};
+    for (auto& col : cols) {
+        info.cols.push_back(ti.column(col));
+        if (info.cols.back() < 0) return 0;
+    }
+    // Entries of the existing rows, checked before anything is written
+    // and inserted in key order.
+    std::vector<std::string> entries;
+    {
+        Cursor c = btree_->open(ti.root);
+        std::vector<Value> vals(info.cols.size());
+        RowDecoder dec;
+        Value v;
+        btree_->seek(c, std::numeric_limits<int64_t>::min());
+        for (bool more = btree_->valid(c); more; more = btree_->next(c)) {
+            std::string_view payload = btree_->read_payload(c);
+            dec.reset(reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+            std::string entry;
+            for (size_t i = 0; i < info.cols.size(); ++i) {
+                dec.get(static_cast<size_t>(info.cols[i]), vals[i]);
+                append_key(vals[i], entry);
+            }
+            finish_key(vals.data(), vals.size(), btree_->key(c), entry);
+            if (entry.size() > MAX_INDEX_KEY) return 0;
+            entries.push_back(std::move(entry));
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+    info.root = btree_->create_index();
+    for (auto& e : entries) btree_->index_insert(info.root, e);
+
+    std::string payload(4, '\0');
+    write32(reinterpret_cast<uint8_t*>(payload.data()), info.root);
+    payload.push_back(INDEX_MARK);
+    payload += name;
+    payload.push_back('\0');
+    payload += table;
+    for (auto& col : cols) {
+        payload.push_back('\0');
+        payload += col;
+    }
+    btree_->insert(schema_root_, {next_rowid_++}, payload);
+    ti.indexes.push_back(std::move(info));
+    ++version_;
+    return ti.indexes.back().root;
+}
+
+int TableInfo::column(const std::string& name) const {
+    for (size_t i = 0; i < cols.size(); ++i)
+        if (cols[i] == name) return static_cast<int>(i);
+    return -1;
+}
+
 const TableInfo* Catalog::lookup(const std::string& name) const {
     auto it = tables_.find(name);
     if (it == tables_.end()) return nullptr;
@@ -1,6 +1,13 @@
 #include "tinydb/codegen.hpp"
+#include "tinydb/ast.hpp"
 #include "tinydb/record.hpp"
-#include <type_traits>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <initializer_list>
+#include <limits>
 
 namespace tinydb {
 namespace {
@@ -9,52 +16,778 @@ Value parse_value(const std::string& s) {
     if (!s.empty() && s.front() == '\'' && s.back() == '\'') {
         v.tag = ColTag::TEXT;
         v.s = s.substr(1, s.size() - 2);
+    } else if (s == "NULL") {
+        v.tag = ColTag::NIL;
     } else {
-        v.tag = ColTag::INT;
-        v.i = std::stoll(s);
+        // Integers past the INT range become REAL, as in SQLite.
+        const char* end = s.data() + s.size();
+        int64_t i = 0;
+        auto [ptr, ec] = std::from_chars(s.data(), end, i);
+        if (ec == std::errc{} && ptr == end) {
+            v.tag = ColTag::INT;
+            v.i = i;
+        } else {
+            v.tag = ColTag::REAL;
+            v.r = std::strtod(s.c_str(), nullptr);
+        }
     }
     return v;
 }
+
+int add_const(Program& prog, Value v) {
+    prog.consts.push_back(std::move(v));
+    return static_cast<int>(prog.consts.size() - 1);
+}
+
+// Integer holds values that fit p1; wider ones go to the constant pool.
+void emit_int(Program& prog, int64_t v, int reg) {
+    if (v >= std::numeric_limits<int>::min() && v <= std::numeric_limits<int>::max()) {
+        prog.code.push_back({Op::Integer,static_cast<int>(v),reg,0});
+        return;
+    }
+    prog.code.push_back({Op::Constant,add_const(prog, Value{ColTag::INT, v, {}}),reg,0});
+}
+
+// Load a parse_value() literal or "?N" placeholder into reg.
+void emit_load(Program& prog, const std::string& lit, int reg) {
+    if (!lit.empty() && lit.front() == '?') {
+        prog.code.push_back({Op::Variable,std::stoi(lit.substr(1)),reg,0});
+        return;
+    }
+    Value v = parse_value(lit);
+    switch (v.tag) {
+    case ColTag::INT:
+        emit_int(prog, v.i, reg);
+        break;
+    case ColTag::NIL:
+        prog.code.push_back({Op::Null,0,reg,0});
+        break;
+    default:
+        prog.code.push_back({Op::Constant,add_const(prog, std::move(v)),reg,0});
+    }
+}
+
+// Load one side of a RowidRange: the literal, or the parameter made an
+// integer bound (offset by one for < and >). For a parameter, returns the
+// instruction whose p2 must be patched to where an empty range goes;
+// otherwise SIZE_MAX.
+size_t emit_bound(Program& prog, int param, long long v, int reg, bool lower) {
+    if (!param) { emit_int(prog, v, reg); return SIZE_MAX; }
+    prog.code.push_back({Op::Variable,param,reg,0});
+    prog.code.push_back({Op::RowidBound,reg,0,(v ? 2 : 1) * (lower ? 1 : -1)});
+    return prog.code.size() - 1;
+}
+
+// Raise nregs/ncursors to cover every operand the code uses.
+void size_frame(Program& prog) {
+    int regs = prog.nregs, curs = prog.ncursors;
+    auto reg = [&](int r) { regs = std::max(regs, r + 1); };
+    for (const Instr& in : prog.code) {
+        switch (in.op) {
+        case Op::OpenRead: case Op::OpenWrite: curs = std::max(curs, in.p1 + 1); break;
+        case Op::Column: case Op::SeekGE: case Op::IdxSeekGE: case Op::IdxSeekGT:
+        case Op::IdxLt: case Op::IdxLe: case Op::IdxColumn: case Op::SeekRowid: reg(in.p3); break;
+        case Op::Insert: reg(in.p2); reg(in.p3); break;
+        case Op::Integer: case Op::Constant: case Op::Null: case Op::Variable:
+        case Op::Rowid: case Op::Update: case Op::NewRowid: case Op::IdxRowid:
+        case Op::IdxInsert: case Op::IdxDelete: reg(in.p2); break;
+        case Op::BatchAggStep: reg(in.p1 + in.p3 - 1); break;
+        case Op::AddImm: case Op::RowidBound: case Op::AggStep: case Op::AggNext: case Op::IfPos:
+        case Op::DecrJumpZero: reg(in.p1); break;
+        case Op::Count: reg(in.p2); break;
+        case Op::Copy: reg(in.p1); reg(in.p2); break;
+        case Op::Eq: case Op::Ne: case Op::Lt: case Op::Le: case Op::Gt: case Op::Ge:
+            reg(in.p1); reg(in.p3); break;
+        case Op::ResultRow: reg(in.p1 + in.p2 - 1); break;
+        case Op::MakeRecord: case Op::MakeKey: reg(in.p1 + in.p2 - 1); reg(in.p3); break;
+        case Op::MakeEntry: reg(in.p1 + in.p2); reg(in.p3); break;
+        case Op::SorterInsert: reg(in.p1 + in.p2 - 1); reg(in.p3); break;
+        case Op::SorterData: reg(in.p1 + in.p2 - 1); break;
+        case Op::EraseRange: reg(in.p2); reg(in.p3); break;
+        default: break;
+        }
+    }
+    prog.nregs = regs;
+    prog.ncursors = curs;
+}
+
+// Registers every table scan reserves: rowid bounds and the current
+// rowid. Statement-specific registers follow from R_SCRATCH.
+constexpr int R_LO = 0, R_HI = 1, R_KEY = 2, R_SCRATCH = 3;
+
+Op compare_op(Expr::CmpOp op) {
+    static const Op ops[] = {Op::Eq, Op::Ne, Op::Lt, Op::Le, Op::Gt, Op::Ge};
+    return ops[op];
 }
 
-std::vector<Instr> codegen(const ASTNode& ast, const Catalog& cat) {
-    std::vector<Instr> p;
+// A loop over the rows of cursor 0 that satisfy a WHERE clause. Rowid
+// bounds among its AND terms become a seek and a stop test on the key,
+// so only the leaves inside the range are read; the other terms are
+// tested row by row, each comparison one jump to the next row. Without
+// rowid bounds, the loop may walk an index on cursor 1 instead.
+class Scan {
+public:
+    // Operand kinds besides a column number.
+    static constexpr int LITERAL = -1, ROWID = -2;
+    RowidRange range;
+    std::vector<const Expr*> terms; // checked per row
+
+    // Give every operand of the terms a register, from `first` on. False
+    // if one names a column the table does not have.
+    bool plan(const Expr* where, const TableInfo& ti, int first) {
+        range = rowid_range(where, terms);
+        next_reg_ = first;
+        for (const Expr* t : terms)
+            if (!assign(*t, ti)) return false;
+        return true;
+    }
+    // Walk the index that can seek to the most terms, if any: equalities
+    // on its leading columns, then a range on the next one. The terms
+    // are still checked per row, which keeps NULL comparisons exact. If
+    // the index holds `cols` (the columns read; -1 is all of them) and
+    // every column the terms test, the table is never opened.
+    void use_index(const TableInfo& ti, const std::vector<int>& cols) {
+        if (range.has_lo || range.has_hi) return;
+        int best = 0;
+        for (const IndexInfo& ix : ti.indexes) {
+            std::vector<const Operand*> eq;
+            const Expr *lo = nullptr, *hi = nullptr;
+            for (int col : ix.cols) {
+                if (const Expr* e = bound(col, {Expr::EQ})) { eq.push_back(&e->rhs); continue; }
+                lo = bound(col, {Expr::GT, Expr::GE});
+                hi = bound(col, {Expr::LT, Expr::LE});
+                break;
+            }
+            int score = 2 * static_cast<int>(eq.size()) + (lo != nullptr) + (hi != nullptr);
+            if (score <= best) continue;
+            best = score;
+            index_ = &ix;
+            eq_ = std::move(eq);
+            lo_ = lo;
+            hi_ = hi;
+        }
+        if (!index_) return;
+        auto held = [&](int col) {
+            return std::find(index_->cols.begin(), index_->cols.end(), col) != index_->cols.end();
+        };
+        covering_ = std::all_of(cols.begin(), cols.end(), held);
+        for (auto& [o, slot] : slots_)
+            if (slot.col >= 0 && !held(slot.col)) covering_ = false;
+        lo_reg_ = next_reg_;
+        next_reg_ += static_cast<int>(eq_.size()) * 2 + 2;
+    }
+    int end_reg() const { return next_reg_; }
+    const IndexInfo* index() const { return index_; }
+    bool covering() const { return covering_; }
+
+    // Load the constant operands, position the cursor and start the loop.
+    void open(Program& prog) {
+        auto& p = prog.code;
+        for (auto& [o, slot] : slots_)
+            if (slot.col == LITERAL) emit_load(prog, o->text, slot.reg);
+        if (index_) {
+            open_index(prog);
+        } else if (range.has_lo) {
+            size_t empty = emit_bound(prog, range.lo_param, range.lo, R_LO, true);
+            if (empty != SIZE_MAX) done_.push_back(empty);
+            done_.push_back(p.size());
+            p.push_back({Op::SeekGE,0,0,R_LO});
+        } else {
+            done_.push_back(p.size());
+            p.push_back({Op::Rewind,0,0,0});
+        }
+        if (range.has_hi) {
+            size_t empty = emit_bound(prog, range.hi_param, range.hi, R_HI, false);
+            if (empty != SIZE_MAX) done_.push_back(empty);
+        }
+        top_ = static_cast<int>(p.size());
+        if (range.has_hi) {
+            // Keys are in order: the first one past hi ends the scan.
+            p.push_back({Op::Rowid,0,R_KEY,0});
+            done_.push_back(p.size());
+            p.push_back({Op::Le,R_KEY,0,R_HI});
+        }
+        if (index_) {
+            if (stop_) {
+                done_.push_back(p.size());
+                p.push_back({hi_ && hi_->op == Expr::LT ? Op::IdxLt : Op::IdxLe,1,0,R_HI});
+            }
+            if (!covering_) {
+                p.push_back({Op::IdxRowid,1,R_KEY,0});
+                skip_.push_back(p.size());
+                p.push_back({Op::SeekRowid,0,0,R_KEY});
+            }
+        }
+        for (const Expr* t : terms) jump_unless(prog, *t, skip_);
+    }
+    // Column `col` (-1: all of them, from reg `reg` on) of the current row.
+    void column(Program& prog, int col, int reg) {
+        if (covering_) prog.code.push_back({Op::IdxColumn,1,index_pos(col),reg});
+        else prog.code.push_back({Op::Column,0,col,reg});
+    }
+    void rowid(Program& prog, int reg) {
+        prog.code.push_back({covering_ ? Op::IdxRowid : Op::Rowid,covering_ ? 1 : 0,reg,0});
+    }
+    // Make the jump at `at` skip to the next row.
+    void skip_row(size_t at) { skip_.push_back(at); }
+    // Step to the next row; once there is none, go on after the loop.
+    void end_loop(Program& prog) {
+        auto& p = prog.code;
+        for (size_t at : skip_) p[at].p2 = static_cast<int>(p.size());
+        p.push_back({index_ ? Op::IdxNext : Op::Next,index_ ? 1 : 0,top_,0});
+        for (size_t at : done_) p[at].p2 = static_cast<int>(p.size());
+    }
+    // Step to the next row and end the program.
+    void close(Program& prog) {
+        end_loop(prog);
+        prog.code.push_back({Op::Halt,0,0,0});
+    }
+private:
+    struct Slot { int reg; int col; };
+
+    bool assign(const Expr& e, const TableInfo& ti) {
+        if (e.kind != Expr::Cmp) return assign(*e.left, ti) && assign(*e.right, ti);
+        for (const Operand* o : {&e.lhs, &e.rhs}) {
+            int col = LITERAL;
+            if (o->column) {
+                col = is_rowid(o->text) ? ROWID : ti.column(o->text);
+                if (col == -1) return false;
+            }
+            slots_.emplace_back(o, Slot{next_reg_++, col});
+        }
+        return true;
+    }
+    const Slot* slot_of(const Operand& o) const {
+        for (auto& [op, slot] : slots_)
+            if (op == &o) return &slot;
+        return nullptr;
+    }
+    // A top-level term comparing column `col` with a value by one of `ops`.
+    const Expr* bound(int col, std::initializer_list<Expr::CmpOp> ops) const {
+        for (const Expr* t : terms) {
+            if (t->kind != Expr::Cmp || t->rhs.column || !t->lhs.column) continue;
+            if (slot_of(t->lhs)->col != col) continue;
+            if (std::find(ops.begin(), ops.end(), t->op) != ops.end()) return t;
+        }
+        return nullptr;
+    }
+    int index_pos(int col) const {
+        auto it = std::find(index_->cols.begin(), index_->cols.end(), col);
+        return static_cast<int>(it - index_->cols.begin());
+    }
+    // Seek to the first entry in bounds and build the key that ends them.
+    void open_index(Program& prog) {
+        auto& p = prog.code;
+        int n = static_cast<int>(eq_.size());
+        int lo = lo_reg_, hi = lo_reg_ + n + 1;
+        for (int i = 0; i < n; ++i) emit_load(prog, eq_[i]->text, lo + i);
+        if (lo_) emit_load(prog, lo_->rhs.text, lo + n);
+        p.push_back({Op::MakeKey,lo,n + (lo_ != nullptr),R_LO});
+        done_.push_back(p.size());
+        p.push_back({lo_ && lo_->op == Expr::GT ? Op::IdxSeekGT : Op::IdxSeekGE,1,0,R_LO});
+        stop_ = n > 0 || hi_;
+        if (!stop_) return;
+        for (int i = 0; i < n; ++i) emit_load(prog, eq_[i]->text, hi + i);
+        if (hi_) emit_load(prog, hi_->rhs.text, hi + n);
+        p.push_back({Op::MakeKey,hi,n + (hi_ != nullptr),R_HI});
+    }
+    int load(Program& prog, const Operand& o) {
+        const Slot* slot = slot_of(o);
+        if (!slot) return 0;
+        if (slot->col == ROWID)
+            rowid(prog, slot->reg);
+        else if (slot->col != LITERAL)
+            column(prog, slot->col, slot->reg);
+        return slot->reg;
+    }
+    // Fall through if `e` holds; otherwise jump to where the instructions
+    // added to `fail` are later pointed.
+    void jump_unless(Program& prog, const Expr& e, std::vector<size_t>& fail) {
+        auto& p = prog.code;
+        if (e.kind == Expr::And) {
+            jump_unless(prog, *e.left, fail);
+            jump_unless(prog, *e.right, fail);
+        } else if (e.kind == Expr::Or) {
+            std::vector<size_t> try_right;
+            jump_unless(prog, *e.left, try_right);
+            size_t hold = p.size();
+            p.push_back({Op::Goto,0,0,0}); // left held: skip the right side
+            for (size_t at : try_right) p[at].p2 = static_cast<int>(p.size());
+            jump_unless(prog, *e.right, fail);
+            p[hold].p2 = static_cast<int>(p.size());
+        } else {
+            int a = load(prog, e.lhs), b = load(prog, e.rhs);
+            fail.push_back(p.size());
+            p.push_back({compare_op(e.op),a,0,b});
+        }
+    }
+
+    std::vector<std::pair<const Operand*, Slot>> slots_;
+    int next_reg_{0};
+    const IndexInfo* index_{nullptr};
+    std::vector<const Operand*> eq_; // values of the leading columns
+    const Expr* lo_{nullptr};        // bounds on the column after them
+    const Expr* hi_{nullptr};
+    bool covering_{false};
+    bool stop_{false}; // entries past the bounds end the loop
+    int lo_reg_{0};    // start of the registers the two keys are built in
+    int top_{0};
+    std::vector<size_t> done_; // jumps out of the loop
+    std::vector<size_t> skip_; // jumps to the Next
+};
+
+// Build the entry `ix` holds for the row under cursor 0, from its
+// columns in regs `row`.. or, with row < 0, read from the cursor. Uses
+// the registers from `at` on; returns the one holding the entry.
+int emit_entry(Program& prog, const IndexInfo& ix, int row, int at) {
+    auto& p = prog.code;
+    int m = static_cast<int>(ix.cols.size());
+    for (int j = 0; j < m; ++j) {
+        if (row < 0) p.push_back({Op::Column,0,ix.cols[j],at + j});
+        else p.push_back({Op::Copy,row + ix.cols[j],at + j,0});
+    }
+    p.push_back({Op::Rowid,0,at + m,0});
+    p.push_back({Op::MakeEntry,at,m,at + m + 1});
+    return at + m + 1;
+}
+
+// LIMIT and OFFSET as counters: rows are dropped while the offset lasts,
+// and the row that uses up the limit ends the statement.
+class Limit {
+public:
+    // Load the counters into regs `at` and `at + 1` (`at + 2` is scratch).
+    // A limit of 0 ends the statement before it reads anything.
+    void load(Program& prog, const ASTSelect& sel, int at) {
+        auto& p = prog.code;
+        if (!sel.offset.empty()) {
+            skip_ = at + 1;
+            emit_load(prog, sel.offset, skip_);
+        }
+        if (sel.limit.empty()) return;
+        count_ = at;
+        emit_load(prog, sel.limit, count_);
+        p.push_back({Op::Integer,0,at + 2,0});
+        p.push_back({Op::Eq,count_,static_cast<int>(p.size()) + 2,at + 2});
+        done_.push_back(p.size());
+        p.push_back({Op::Goto,0,0,0});
+    }
+    int count() const { return count_; }
+    int skip() const { return skip_; }
+    // Yield regs row.. (n of them; 0: the row's width) unless the offset
+    // drops the row. Returns the jump taken then, to be pointed at the
+    // next row, or SIZE_MAX if there is no offset.
+    size_t result(Program& prog, int row, int n) {
+        auto& p = prog.code;
+        size_t skipped = SIZE_MAX;
+        if (skip_ >= 0) {
+            skipped = p.size();
+            p.push_back({Op::IfPos,skip_,0,1});
+        }
+        p.push_back({Op::ResultRow,row,n,0});
+        if (count_ >= 0) {
+            done_.push_back(p.size());
+            p.push_back({Op::DecrJumpZero,count_,0,0});
+        }
+        return skipped;
+    }
+    // Point the jumps that end the statement at its Halt, `end`.
+    void finish(Program& prog, int end) {
+        for (size_t at : done_) prog.code[at].p2 = end;
+    }
+private:
+    int count_{-1}, skip_{-1};
+    std::vector<size_t> done_;
+};
+
+// Sort directions for SorterOpen: a byte per ORDER BY term, 1 if DESC.
+int add_directions(Program& prog, const ASTSelect& sel) {
+    Value dirs{ColTag::BLOB, 0, {}};
+    for (auto& term : sel.order_by) dirs.s.push_back(term.second ? 1 : 0);
+    return add_const(prog, std::move(dirs));
+}
+
+// Select-list position named by an ORDER BY term ("2" is the second
+// item) as an index from 0; -1 if the term is not a number.
+int item_position(const std::string& term) {
+    if (term.empty() || term.size() > 9 ||
+        !std::all_of(term.begin(), term.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); }))
+        return -1;
+    return std::stoi(term) - 1;
+}
+
+// Once the sorter has every row: yield its rows in order through regs
+// row.. (ncols of them; 0: each row's width), then end the statement.
+void emit_sorted(Program& prog, Limit& limit, int row, int ncols) {
+    auto& p = prog.code;
+    size_t sort = p.size();
+    p.push_back({Op::SorterSort,0,0,0});
+    int top = static_cast<int>(p.size());
+    p.push_back({Op::SorterData,row,ncols,0});
+    size_t skipped = limit.result(prog, row, ncols);
+    if (skipped != SIZE_MAX) p[skipped].p2 = static_cast<int>(p.size());
+    p.push_back({Op::SorterNext,0,top,0});
+    p[sort].p2 = static_cast<int>(p.size());
+    p.push_back({Op::Halt,0,0,0});
+    limit.finish(prog, static_cast<int>(p.size() - 1));
+}
+
+// SELECT with aggregates or GROUP BY. The rows the WHERE clause passes
+// go to a hash aggregate as their key columns and one argument per
+// aggregate, a leaf at a time when there is no WHERE; its groups are then
+// yielded one at a time. COUNT(*) of a whole table only adds up the
+// leaves' cell counts.
+void emit_aggregate(const ASTSelect& sel, const TableInfo& ti, Program& prog) {
+    auto& p = prog.code;
+    auto fail = [&] { p.push_back({Op::Halt,0,0,0}); };
+    if (!sel.where && sel.group_by.empty() && sel.limit.empty() && sel.cols.size() == 1 &&
+        !sel.aggs.empty() && sel.aggs[0] == AggFn::Count && sel.cols[0] == "*") {
+        p.push_back({Op::Count,static_cast<int>(ti.root),R_SCRATCH,0});
+        p.push_back({Op::ResultRow,R_SCRATCH,1,0});
+        p.push_back({Op::Halt,0,0,0});
+        return;
+    }
+    std::vector<int> keys;
+    for (auto& name : sel.group_by) {
+        keys.push_back(ti.column(name));
+        if (keys.back() < 0) return fail();
+    }
+    // Each item yields one of the group's keys, which a plain column must
+    // be, or one aggregate's result.
+    static const AggOp op_of[] = {AggOp::Count, AggOp::Count, AggOp::Sum, AggOp::Min, AggOp::Max, AggOp::Avg};
+    int nkeys = static_cast<int>(keys.size());
+    std::string ops;
+    std::vector<int> args; // column each aggregate reads; -1 for COUNT(*)
+    std::vector<int> from; // per item, its place among keys then aggregates
+    for (size_t i = 0; i < sel.cols.size(); ++i) {
+        AggFn fn = sel.aggs.empty() ? AggFn::None : sel.aggs[i];
+        bool all = sel.cols[i] == "*";
+        int col = all ? -1 : ti.column(sel.cols[i]);
+        if (all ? fn != AggFn::Count : col < 0) return fail();
+        if (fn == AggFn::None) {
+            auto it = std::find(keys.begin(), keys.end(), col);
+            if (it == keys.end()) return fail();
+            from.push_back(static_cast<int>(it - keys.begin()));
+            continue;
+        }
+        from.push_back(nkeys + static_cast<int>(ops.size()));
+        ops.push_back(static_cast<char>(all ? AggOp::CountAll : op_of[static_cast<int>(fn)]));
+        args.push_back(col);
+    }
+    // ORDER BY a group's key, or an item by position.
+    int width = nkeys + static_cast<int>(ops.size()), ncols = static_cast<int>(from.size());
+    std::vector<int> order; // place among keys then aggregates, or -1 - item
+    for (auto& term : sel.order_by) {
+        int item = item_position(term.first);
+        if (item >= ncols) return fail();
+        if (item >= 0) { order.push_back(-1 - item); continue; }
+        auto it = std::find(keys.begin(), keys.end(), ti.column(term.first));
+        if (it == keys.end()) return fail();
+        order.push_back(static_cast<int>(it - keys.begin()));
+    }
+    Scan scan;
+    if (!scan.plan(sel.where.get(), ti, R_SCRATCH)) return fail();
+    std::vector<int> read = keys;
+    for (int col : args) if (col >= 0) read.push_back(col);
+    scan.use_index(ti, read);
+    // regs: the row's keys and arguments, a group's keys and results,
+    // the items in select-list order, LIMIT counters, then sort keys and
+    // the record sorted
+    int nsort = static_cast<int>(order.size());
+    int in = scan.end_reg(), group = in + width, res = group + width;
+    int lim = res + ncols, sort_key = lim + 3, rec = sort_key + nsort;
+    prog.nregs = rec + 1;
+    Limit limit;
+    limit.load(prog, sel, lim);
+    if (nsort) p.push_back({Op::SorterOpen,limit.count(),limit.skip(),add_directions(prog, sel)});
+    p.push_back({Op::AggReset,nkeys,add_const(prog, Value{ColTag::BLOB, 0, ops}),0});
+    if (!sel.where) {
+        // A whole table goes a leaf at a time: its rows are decoded
+        // column-wise and folded in by one op, the keys and arguments
+        // lined up past the decoded columns unless already in place.
+        std::vector<int> cols = keys;
+        cols.insert(cols.end(), args.begin(), args.end());
+        int decoded = 0;
+        bool in_place = true;
+        for (int i = 0; i < width; ++i) {
+            decoded = std::max(decoded, cols[i] + 1);
+            in_place &= cols[i] == i;
+        }
+        int first = in_place ? 0 : std::max(decoded, 1);
+        p.push_back({Op::OpenRead,0,static_cast<int>(ti.root),0});
+        size_t rewind = p.size();
+        p.push_back({Op::Rewind,0,0,0}); // fixup
+        int top = static_cast<int>(p.size());
+        p.push_back({Op::BatchLoad,0,decoded,0});
+        if (!in_place) // COUNT(*) reads no column; any will do
+            for (int i = 0; i < width; ++i) p.push_back({Op::BatchMove,std::max(cols[i], 0),first + i,0});
+        p.push_back({Op::BatchAggStep,in,first,width});
+        p.push_back({Op::Next,0,top,0});
+        p[rewind].p2 = static_cast<int>(p.size());
+    } else {
+        if (!scan.covering()) p.push_back({Op::OpenRead,0,static_cast<int>(ti.root),0});
+        if (const IndexInfo* ix = scan.index())
+            p.push_back({Op::OpenRead,1,static_cast<int>(ix->root),static_cast<int>(ix->cols.size())});
+        scan.open(prog);
+        for (int k = 0; k < nkeys; ++k) scan.column(prog, keys[k], in + k);
+        for (size_t j = 0; j < args.size(); ++j)
+            if (args[j] >= 0) scan.column(prog, args[j], in + nkeys + static_cast<int>(j));
+        p.push_back({Op::AggStep,in,0,0});
+        scan.end_loop(prog);
+    }
+    int loop = static_cast<int>(p.size());
+    p.push_back({Op::AggNext,group,0,0});
+    for (int i = 0; i < ncols; ++i) p.push_back({Op::Copy,group + from[i],res + i,0});
+    if (nsort) {
+        for (int k = 0; k < nsort; ++k)
+            p.push_back({Op::Copy,order[k] < 0 ? res - 1 - order[k] : group + order[k],sort_key + k,0});
+        p.push_back({Op::MakeRecord,res,ncols,rec});
+        p.push_back({Op::SorterInsert,sort_key,nsort,rec});
+        p.push_back({Op::Goto,0,loop,0});
+        p[loop].p2 = static_cast<int>(p.size());
+        emit_sorted(prog, limit, res, ncols);
+        return;
+    }
+    size_t skipped = limit.result(prog, res, ncols);
+    if (skipped != SIZE_MAX) p[skipped].p2 = static_cast<int>(p.size());
+    p.push_back({Op::Goto,0,loop,0});
+    p[loop].p2 = static_cast<int>(p.size());
+    p.push_back({Op::Halt,0,0,0});
+    limit.finish(prog, static_cast<int>(p.size() - 1));
+}
+
+void generate(const ASTNode& ast, const Catalog& cat, Program& prog) {
+    auto& p = prog.code;
     if (auto ins = dynamic_cast<const ASTInsert*>(&ast)) {
         const TableInfo* ti = cat.lookup(ins->table);
-        if (!ti) { p.push_back({Op::Halt,0,0,0,{}}); return p; }
-        std::vector<Value> vals;
-        for (auto& s : ins->values) vals.push_back(parse_value(s));
-        auto row = encode_row(vals);
-        p.push_back({Op::Insert, static_cast<int>(ti->root),0,0,
-                     std::string(reinterpret_cast<const char*>(row.data()), row.size())});
-        p.push_back({Op::Halt,0,0,0,{}});
-        return p;
-    } else if (auto sel = dynamic_cast<const ASTSelect*>(&ast)) {
-        const TableInfo* ti = cat.lookup(sel->table);
-        if (!ti) { p.push_back({Op::Halt,0,0,0,{}}); return p; }
-        p.push_back({Op::OpenRead,0,static_cast<int>(ti->root),0,{}}); // 0
-        if (sel->where_rowid) {
-            p.push_back({Op::Integer, static_cast<int>(sel->rowid),0,0,{}}); //1
-            p.push_back({Op::SeekGE,0,0,0,{}}); //2 fixup
-            p.push_back({Op::Column,0,-1,0,{}}); //3
-            int ncols = (sel->cols.size()==1 && sel->cols[0]=="*") ? 0 : static_cast<int>(sel->cols.size());
-            p.push_back({Op::ResultRow,0,ncols,0,{}}); //4
-            p.push_back({Op::Halt,0,0,0,{}}); //5
-            p[2].p2 = static_cast<int>(p.size()-1);
+        if (!ti) { p.push_back({Op::Halt,0,0,0}); return; }
+        if (!ti->indexes.empty()) {
+            // regs: the values, the record, the rowid, then per index its
+            // columns, the rowid again and the entry. Every entry is built
+            // (and its length checked) before the row goes in.
+            int n = static_cast<int>(ins->values.size());
+            int rec = n, rowid = n + 1, next = n + 2;
+            for (int i = 0; i < n; ++i) emit_load(prog, ins->values[i], i);
+            p.push_back({Op::NewRowid,static_cast<int>(ti->root),rowid,0});
+            std::vector<int> entries;
+            for (const IndexInfo& ix : ti->indexes) {
+                int m = static_cast<int>(ix.cols.size());
+                for (int j = 0; j < m; ++j) {
+                    // Columns the row leaves out read as INT 0, as from Column.
+                    if (ix.cols[j] < n) p.push_back({Op::Copy,ix.cols[j],next + j,0});
+                    else emit_int(prog, 0, next + j);
+                }
+                p.push_back({Op::Copy,rowid,next + m,0});
+                p.push_back({Op::MakeEntry,next,m,next + m + 1});
+                entries.push_back(next + m + 1);
+                next += m + 2;
+            }
+            p.push_back({Op::MakeRecord,0,n,rec});
+            p.push_back({Op::Insert,static_cast<int>(ti->root),rowid,rec});
+            for (size_t k = 0; k < entries.size(); ++k)
+                p.push_back({Op::IdxInsert,static_cast<int>(ti->indexes[k].root),entries[k],0});
+        } else if (ins->params.empty()) {
+            // All literal: the record is built once, here.
+            std::vector<Value> vals;
+            for (auto& s : ins->values) vals.push_back(parse_value(s));
+            Value rec{ColTag::BLOB, 0, {}};
+            encode_row(vals.data(), vals.size(), rec.s);
+            p.push_back({Op::Constant,add_const(prog, std::move(rec)),0,0});
+            p.push_back({Op::Insert,static_cast<int>(ti->root),-1,0});
         } else {
-            p.push_back({Op::Rewind,0,0,0,{}}); //1 fixup
-            p.push_back({Op::Column,0,-1,0,{}}); //2 loop start
-            int ncols = (sel->cols.size()==1 && sel->cols[0]=="*") ? 0 : static_cast<int>(sel->cols.size());
-            p.push_back({Op::ResultRow,0,ncols,0,{}}); //3
-            p.push_back({Op::Next,0,0,0,{}}); //4 fixup
-            p.push_back({Op::Halt,0,0,0,{}}); //5
+            int n = static_cast<int>(ins->values.size());
+            for (int i = 0; i < n; ++i) emit_load(prog, ins->values[i], i);
+            p.push_back({Op::MakeRecord,0,n,n});
+            p.push_back({Op::Insert,static_cast<int>(ti->root),-1,n});
+        }
+        p.push_back({Op::Halt,0,0,0});
+        return;
+    }
+    if (auto sel = dynamic_cast<const ASTSelect*>(&ast)) {
+        const TableInfo* ti = cat.lookup(sel->table);
+        if (!ti) { p.push_back({Op::Halt,0,0,0}); return; }
+        if (!sel->aggs.empty() || !sel->group_by.empty()) { emit_aggregate(*sel, *ti, prog); return; }
+        bool star = sel->cols.size() == 1 && sel->cols[0] == "*";
+        int ncols = star ? 0 : static_cast<int>(sel->cols.size());
+        // Named tables project by name, others by position.
+        std::vector<int> cols;
+        for (int i = 0; i < ncols; ++i) {
+            cols.push_back(ti->cols.empty() ? i : ti->column(sel->cols[i]));
+            if (cols.back() < 0) { p.push_back({Op::Halt,0,0,0}); return; }
+        }
+        if (!sel->where && sel->order_by.empty() && sel->limit.empty()) {
+            // A leaf at a time: decode its rows column-wise, yield them,
+            // then step the cursor (left on the leaf's last row) onward.
+            int width = ncols ? *std::max_element(cols.begin(), cols.end()) + 1 : -1;
+            int first = 0;
+            for (int i = 0; i < ncols; ++i) if (cols[i] != i) first = width;
+            p.push_back({Op::OpenRead,0,static_cast<int>(ti->root),0});
+            p.push_back({Op::Rewind,0,0,0}); // fixup
+            int loop = static_cast<int>(p.size());
+            p.push_back({Op::BatchLoad,0,width,0});
+            if (first) // line the projection up past the decoded columns
+                for (int i = 0; i < ncols; ++i) p.push_back({Op::BatchMove,cols[i],first + i,0});
+            p.push_back({Op::BatchResult,first,ncols,0});
+            p.push_back({Op::Next,0,loop,0});
+            p.push_back({Op::Halt,0,0,0});
             p[1].p2 = static_cast<int>(p.size()-1);
-            p[4].p2 = 2; // loop back to Column
+            return;
+        }
+        Scan scan;
+        if (!scan.plan(sel->where.get(), *ti, R_SCRATCH)) { p.push_back({Op::Halt,0,0,0}); return; }
+        // ORDER BY a column, the rowid, or an item by position. SELECT *
+        // has as many items as the table has columns, when they are named.
+        int items = ncols ? ncols : ti->cols.empty() ? std::numeric_limits<int>::max() : static_cast<int>(ti->cols.size());
+        std::vector<int> keys;
+        for (auto& term : sel->order_by) {
+            int item = item_position(term.first);
+            int col = item >= 0 ? (item >= items ? -1 : ncols ? cols[item] : item)
+                    : is_rowid(term.first) ? Scan::ROWID
+                    : ti->cols.empty() ? -1 : ti->column(term.first);
+            if (col == -1) { p.push_back({Op::Halt,0,0,0}); return; }
+            keys.push_back(col);
         }
-        return p;
+        std::vector<int> read = ncols ? cols : std::vector<int>{-1};
+        for (int col : keys) if (col >= 0) read.push_back(col);
+        scan.use_index(*ti, read);
+        // A table scan already runs in rowid order.
+        bool sort = !keys.empty() &&
+                    !(keys[0] == Scan::ROWID && !sel->order_by[0].second && !scan.index());
+        // regs: LIMIT counters, sort keys, the record sorted, then the row
+        // (last, as a row can be wider than the table)
+        int nsort = static_cast<int>(keys.size());
+        int lim = scan.end_reg(), sort_key = lim + 3, rec = sort_key + nsort, base = rec + 1;
+        if (ncols == 0) prog.nregs = base + static_cast<int>(ti->cols.size());
+        Limit limit;
+        limit.load(prog, *sel, lim);
+        if (sort) p.push_back({Op::SorterOpen,limit.count(),limit.skip(),add_directions(prog, *sel)});
+        if (!scan.covering()) p.push_back({Op::OpenRead,0,static_cast<int>(ti->root),0});
+        if (const IndexInfo* ix = scan.index())
+            p.push_back({Op::OpenRead,1,static_cast<int>(ix->root),static_cast<int>(ix->cols.size())});
+        scan.open(prog);
+        if (ncols == 0) scan.column(prog, -1, base);
+        for (int i = 0; i < ncols; ++i) scan.column(prog, cols[i], base + i);
+        if (!sort) {
+            size_t skipped = limit.result(prog, base, ncols);
+            if (skipped != SIZE_MAX) scan.skip_row(skipped);
+            scan.close(prog);
+            limit.finish(prog, static_cast<int>(p.size() - 1));
+            return;
+        }
+        for (int k = 0; k < nsort; ++k) {
+            if (keys[k] == Scan::ROWID) scan.rowid(prog, sort_key + k);
+            else scan.column(prog, keys[k], sort_key + k);
+        }
+        p.push_back({Op::MakeRecord,base,ncols,rec});
+        p.push_back({Op::SorterInsert,sort_key,nsort,rec});
+        scan.end_loop(prog);
+        emit_sorted(prog, limit, base, ncols);
+        return;
     }
-    p.push_back({Op::Halt,0,0,0,{}});
-    return p;
+    if (auto del = dynamic_cast<const ASTDelete*>(&ast)) {
+        const TableInfo* ti = cat.lookup(del->table);
+        if (!ti) { p.push_back({Op::Halt,0,0,0}); return; }
+        Scan scan;
+        if (!scan.plan(del->where.get(), *ti, R_SCRATCH)) { p.push_back({Op::Halt,0,0,0}); return; }
+        if (scan.terms.empty() && ti->indexes.empty()) {
+            // Rowid ranges are erased in the tree directly, whole subtrees at once.
+            const RowidRange& w = scan.range;
+            int lo = -1, hi = -1;
+            std::vector<size_t> empty;
+            if (w.has_lo) { lo = R_LO; empty.push_back(emit_bound(prog, w.lo_param, w.lo, lo, true)); }
+            if (w.has_hi) { hi = R_HI; empty.push_back(emit_bound(prog, w.hi_param, w.hi, hi, false)); }
+            p.push_back({Op::EraseRange,static_cast<int>(ti->root),lo,hi});
+            for (size_t at : empty) if (at != SIZE_MAX) p[at].p2 = static_cast<int>(p.size());
+            p.push_back({Op::Halt,0,0,0});
+            return;
+        }
+        p.push_back({Op::OpenWrite,0,static_cast<int>(ti->root),0});
+        scan.open(prog);
+        int next = scan.end_reg();
+        for (const IndexInfo& ix : ti->indexes) {
+            int entry = emit_entry(prog, ix, -1, next);
+            p.push_back({Op::IdxDelete,static_cast<int>(ix.root),entry,0});
+        }
+        p.push_back({Op::Delete,0,0,0}); // Next then lands on the row after it
+        scan.close(prog);
+        return;
+    }
+    if (auto upd = dynamic_cast<const ASTUpdate*>(&ast)) {
+        const TableInfo* ti = cat.lookup(upd->table);
+        if (!ti) { p.push_back({Op::Halt,0,0,0}); return; }
+        // regs: 0 lo, 1 hi, 2 rowid, 3 record, then the WHERE operands,
+        // the old and new entries of each index, then the row being
+        // rewritten (last, as a row can be wider than the table)
+        constexpr int R_REC = R_SCRATCH;
+        std::vector<std::pair<int, const std::string*>> sets;
+        for (auto& s : upd->sets) {
+            int col = ti->column(s.first);
+            if (col < 0) { p.push_back({Op::Halt,0,0,0}); return; }
+            sets.emplace_back(col, &s.second);
+        }
+        Scan scan;
+        if (!scan.plan(upd->where.get(), *ti, R_REC + 1)) { p.push_back({Op::Halt,0,0,0}); return; }
+        int next = scan.end_reg();
+        int base = next;
+        for (const IndexInfo& ix : ti->indexes) base += 2 * (static_cast<int>(ix.cols.size()) + 2);
+        prog.nregs = base + static_cast<int>(ti->cols.size());
+        // A new entry can be too long to store only if the SET reaches its
+        // index. Those are all built in a first pass, so that one failing
+        // ends the statement before any row has changed.
+        std::vector<const IndexInfo*> changed;
+        for (const IndexInfo& ix : ti->indexes)
+            for (auto& s : sets)
+                if (std::find(ix.cols.begin(), ix.cols.end(), s.first) != ix.cols.end()) {
+                    changed.push_back(&ix);
+                    break;
+                }
+        if (!changed.empty()) {
+            Scan check;
+            check.plan(upd->where.get(), *ti, R_REC + 1);
+            p.push_back({Op::OpenRead,0,static_cast<int>(ti->root),0});
+            check.open(prog);
+            p.push_back({Op::Column,0,-1,base});
+            for (auto& s : sets) emit_load(prog, *s.second, base + s.first);
+            for (const IndexInfo* ix : changed) emit_entry(prog, *ix, base, next);
+            check.end_loop(prog);
+        }
+        p.push_back({Op::OpenWrite,0,static_cast<int>(ti->root),0});
+        scan.open(prog);
+        p.push_back({Op::Column,0,-1,base});
+        // Each index trades the row's old entry for its new one.
+        std::vector<std::pair<int, int>> entries; // old, new
+        for (const IndexInfo& ix : ti->indexes) {
+            entries.emplace_back(emit_entry(prog, ix, base, next), 0);
+            next += static_cast<int>(ix.cols.size()) + 2;
+        }
+        for (auto& s : sets) emit_load(prog, *s.second, base + s.first);
+        for (size_t k = 0; k < entries.size(); ++k) {
+            entries[k].second = emit_entry(prog, ti->indexes[k], base, next);
+            next += static_cast<int>(ti->indexes[k].cols.size()) + 2;
+        }
+        p.push_back({Op::MakeRecord,base,static_cast<int>(ti->cols.size()),R_REC});
+        p.push_back({Op::Update,0,R_REC,0});
+        for (size_t k = 0; k < entries.size(); ++k) {
+            int root = static_cast<int>(ti->indexes[k].root);
+            p.push_back({Op::IdxDelete,root,entries[k].first,0});
+            p.push_back({Op::IdxInsert,root,entries[k].second,0});
+        }
+        scan.close(prog);
+        return;
+    }
+    if (auto tx = dynamic_cast<const ASTTransaction*>(&ast)) {
+        Op op = tx->kind == ASTTransaction::Begin ? Op::Begin
+              : tx->kind == ASTTransaction::Commit ? Op::Commit : Op::Rollback;
+        p.push_back({op,0,0,0});
+    }
+    p.push_back({Op::Halt,0,0,0});
+}
+} // namespace
+
+Program codegen(const ASTNode& ast, const Catalog& cat) {
+    Program prog;
+    generate(ast, cat, prog);
+    size_frame(prog);
+    return prog;
 }
 
 } // namespace tinydb
@@ -0,0 +1,444 @@
+#include "tinydb/btree.hpp"
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace tinydb {
+
+namespace {
+
+enum : uint8_t { IDX_LEAF = 3, IDX_INTERNAL = 4 };
+
+static uint16_t read16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0]) |
+           static_cast<uint16_t>(p[1]) << 8;
+}
+
+static void write16(uint8_t* p, uint16_t v) {
+    p[0] = static_cast<uint8_t>(v & 0xFF);
+    p[1] = static_cast<uint8_t>((v >> 8) & 0xFF);
+}
+
+static uint32_t read32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) |
+           static_cast<uint32_t>(p[1]) << 8 |
+           static_cast<uint32_t>(p[2]) << 16 |
+           static_cast<uint32_t>(p[3]) << 24;
+}
+
+static void write32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v & 0xFF);
+    p[1] = static_cast<uint8_t>((v >> 8) & 0xFF);
+    p[2] = static_cast<uint8_t>((v >> 16) & 0xFF);
+    p[3] = static_cast<uint8_t>((v >> 24) & 0xFF);
+}
+
+// Both page types are slotted like table leaves: u16 cell offsets after
+// the header, cells packed from the end of the page. The header's link
+// is the next leaf in a leaf and the leftmost child in an internal page.
+// Leaf cells are [u16 len][key]; internal cells [u32 child][u16 len][key],
+// where the child holds the keys >= key up to the next cell's key.
+constexpr size_t HDR = 12;        // type, -, ncell, link, content, frag
+constexpr size_t SLOT_SIZE = 2;
+
+static bool is_leaf(const uint8_t* d) { return d[0] == IDX_LEAF; }
+static uint16_t ncell(const uint8_t* d) { return read16(d + 2); }
+static uint32_t link(const uint8_t* d) { return read32(d + 4); }
+
+static size_t content(const uint8_t* d) {
+    uint16_t c = read16(d + 8);
+    return c == 0 ? PAGE_SIZE : c;
+}
+
+static size_t key_offset(const uint8_t* d) { return is_leaf(d) ? 2 : 6; }
+
+static const uint8_t* cell(const uint8_t* d, size_t i) {
+    return d + read16(d + HDR + SLOT_SIZE * i);
+}
+
+static std::string_view cell_key(const uint8_t* d, size_t i) {
+    const uint8_t* c = cell(d, i);
+    size_t k = key_offset(d);
+    return std::string_view(reinterpret_cast<const char*>(c + k), read16(c + k - 2));
+}
+
+static std::string_view cell_bytes(const uint8_t* d, size_t i) {
+    const uint8_t* c = cell(d, i);
+    size_t k = key_offset(d);
+    return std::string_view(reinterpret_cast<const char*>(c), k + read16(c + k - 2));
+}
+
+static uint32_t cell_child(const uint8_t* d, size_t i) { return read32(cell(d, i)); }
+
+// Index of the first cell with key >= `key` (ncell if none).
+static size_t lower_bound(const uint8_t* d, std::string_view key) {
+    size_t lo = 0, hi = ncell(d);
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (cell_key(d, mid) < key) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+// Position of the child of an internal page whose subtree holds `key`:
+// 0 for the leftmost child, i for the child of cell i - 1.
+static size_t child_for(const uint8_t* d, std::string_view key) {
+    size_t lo = 0, hi = ncell(d);
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (cell_key(d, mid) <= key) lo = mid + 1; else hi = mid;
+    }
+    return lo;
+}
+
+static uint32_t child_at(const uint8_t* d, size_t pos) {
+    return pos == 0 ? link(d) : cell_child(d, pos - 1);
+}
+
+static void init_page(uint8_t* d, uint8_t type, uint32_t link_to) {
+    std::memset(d, 0, HDR);
+    d[0] = type;
+    write32(d + 4, link_to);
+    write16(d + 8, static_cast<uint16_t>(PAGE_SIZE));
+}
+
+// Insert cell bytes as cell i directly in the page; false when the gap
+// between the slots and the content area is too small.
+static bool insert_inplace(Page& page, size_t i, std::string_view bytes) {
+    uint8_t* d = page.data.data();
+    size_t n = ncell(d);
+    size_t top = content(d);
+    size_t slots_end = HDR + SLOT_SIZE * (n + 1);
+    if (slots_end > top || top - slots_end < bytes.size()) return false;
+    uint8_t* slot = d + HDR + SLOT_SIZE * i;
+    std::memmove(slot + SLOT_SIZE, slot, SLOT_SIZE * (n - i));
+    top -= bytes.size();
+    std::memcpy(d + top, bytes.data(), bytes.size());
+    write16(slot, static_cast<uint16_t>(top));
+    write16(d + 2, static_cast<uint16_t>(n + 1));
+    write16(d + 8, static_cast<uint16_t>(top));
+    return true;
+}
+
+// A page's cells, materialised for a rebuild or a split.
+struct Node {
+    uint8_t type{IDX_LEAF};
+    uint32_t link{0};
+    std::vector<std::string_view> cells; // whole cell bytes
+};
+
+static Node load(const Page& page) {
+    const uint8_t* d = page.data.data();
+    Node node{d[0], link(d), {}};
+    node.cells.reserve(ncell(d));
+    for (size_t i = 0; i < ncell(d); ++i) node.cells.push_back(cell_bytes(d, i));
+    return node;
+}
+
+static size_t node_size(const Node& node, size_t from, size_t to) {
+    size_t n = HDR;
+    for (size_t i = from; i < to; ++i) n += SLOT_SIZE + node.cells[i].size();
+    return n;
+}
+
+// Write cells [from, to) of `node` to `page`, through a scratch buffer
+// since the cells may point into the page itself.
+static void store(Page& page, const Node& node, uint32_t link_to, size_t from, size_t to) {
+    std::array<uint8_t, PAGE_SIZE> buf{};
+    uint8_t* d = buf.data();
+    init_page(d, node.type, link_to);
+    size_t top = PAGE_SIZE;
+    for (size_t i = from; i < to; ++i) {
+        top -= node.cells[i].size();
+        std::memcpy(d + top, node.cells[i].data(), node.cells[i].size());
+        write16(d + HDR + SLOT_SIZE * (i - from), static_cast<uint16_t>(top));
+    }
+    write16(d + 2, static_cast<uint16_t>(to - from));
+    write16(d + 8, static_cast<uint16_t>(top));
+    page.data = buf;
+}
+
+static std::string_view node_key(const Node& node, size_t i) {
+    const auto* c = reinterpret_cast<const uint8_t*>(node.cells[i].data());
+    size_t k = node.type == IDX_LEAF ? 2 : 6;
+    return node.cells[i].substr(k, read16(c + k - 2));
+}
+
+// First cell of the right half: the left one is filled to about half.
+static size_t split_point(const Node& node) {
+    size_t sz = 0, i = 0;
+    for (; i < node.cells.size(); ++i) {
+        size_t cell_sz = SLOT_SIZE + node.cells[i].size();
+        if (sz + cell_sz > (PAGE_SIZE - HDR) / 2 && i > 0) break;
+        sz += cell_sz;
+    }
+    return i;
+}
+
+static std::string internal_cell(uint32_t child, std::string_view key) {
+    std::string c(6 + key.size(), '\0');
+    auto* b = reinterpret_cast<uint8_t*>(c.data());
+    write32(b, child);
+    write16(b + 4, static_cast<uint16_t>(key.size()));
+    std::memcpy(b + 6, key.data(), key.size());
+    return c;
+}
+
+struct Split { bool split{false}; std::string key; uint32_t pgno{0}; };
+
+// Add `bytes` as cell `at` of `page`, splitting it if it does not fit.
+// A split root keeps its page number and moves both halves out; any
+// other page keeps the left half and returns the right one with the
+// separator that goes up.
+static Split add_cell(Pager& pager, Page& page, bool is_root, size_t at, std::string_view bytes) {
+    if (insert_inplace(page, at, bytes)) { pager.mark_dirty(page); return {}; }
+    Node node = load(page);
+    node.cells.insert(node.cells.begin() + at, bytes);
+    size_t n = node.cells.size();
+    if (node_size(node, 0, n) <= PAGE_SIZE) {
+        store(page, node, node.link, 0, n);
+        pager.mark_dirty(page);
+        return {};
+    }
+    bool leaf = node.type == IDX_LEAF;
+    size_t mid = split_point(node);
+    // An internal split sends the middle cell's key up and makes its
+    // child the right page's leftmost.
+    size_t right_from = leaf ? mid : mid + 1;
+    uint32_t right_link = leaf ? node.link : read32(reinterpret_cast<const uint8_t*>(node.cells[mid].data()));
+    std::string up(node_key(node, mid));
+    uint32_t right_pg = pager.alloc(page.no);
+    PageRef rp = pager.acquire(right_pg);
+    store(*rp, node, right_link, right_from, n);
+    pager.mark_dirty(*rp);
+    if (!is_root) {
+        store(page, node, leaf ? right_pg : node.link, 0, mid);
+        pager.mark_dirty(page);
+        return {true, std::move(up), right_pg};
+    }
+    uint32_t left_pg = pager.alloc(page.no);
+    PageRef lp = pager.acquire(left_pg);
+    store(*lp, node, leaf ? right_pg : node.link, 0, mid);
+    pager.mark_dirty(*lp);
+    init_page(page.data.data(), IDX_INTERNAL, left_pg);
+    std::memset(page.data.data() + HDR, 0, PAGE_SIZE - HDR);
+    std::string c = internal_cell(right_pg, up);
+    insert_inplace(page, 0, c);
+    pager.mark_dirty(page);
+    return {};
+}
+
+static Split insert_node(Pager& pager, uint32_t pgno, bool is_root, std::string_view key,
+                         bool& added) {
+    PageRef page = pager.acquire(pgno);
+    const uint8_t* d = page->data.data();
+    if (is_leaf(d)) {
+        size_t at = lower_bound(d, key);
+        if (at < ncell(d) && cell_key(d, at) == key) { added = false; return {}; }
+        std::string c(2 + key.size(), '\0');
+        write16(reinterpret_cast<uint8_t*>(c.data()), static_cast<uint16_t>(key.size()));
+        std::memcpy(c.data() + 2, key.data(), key.size());
+        added = true;
+        return add_cell(pager, *page, is_root, at, c);
+    }
+    size_t pos = child_for(d, key);
+    Split res = insert_node(pager, child_at(d, pos), false, key, added);
+    if (!res.split) return {};
+    return add_cell(pager, *page, is_root, pos, internal_cell(res.pgno, res.key));
+}
+
+// Leaf holding the first key >= `key`, and that key's slot.
+static void descend(Pager& pager, uint32_t root, std::string_view key, Cursor& c) {
+    uint32_t pgno = root;
+    const uint8_t* d = pager.view(pgno);
+    while (!is_leaf(d)) {
+        pgno = child_at(d, child_for(d, key));
+        d = pager.view(pgno);
+    }
+    c.pgno = pgno;
+    c.idx = static_cast<int>(lower_bound(d, key));
+}
+
+static uint32_t rightmost_leaf(Pager& pager, uint32_t pgno) {
+    const uint8_t* d = pager.view(pgno);
+    while (!is_leaf(d)) {
+        pgno = child_at(d, ncell(d));
+        d = pager.view(pgno);
+    }
+    return pgno;
+}
+
+struct Erased { bool found{false}; bool empty{false}; };
+
+// Remove `key` from the subtree at `pgno`; `left` is the subtree just
+// before it, 0 if none. A leaf left empty is unlinked from the leaf chain
+// and freed by its parent, and so is an internal page that loses its last
+// child. The root keeps its page: it becomes an empty leaf instead.
+static Erased erase_entry(Pager& pager, uint32_t pgno, bool is_root, std::string_view key, uint32_t left) {
+    PageRef page = pager.acquire(pgno);
+    uint8_t* d = page->data.data();
+    if (is_leaf(d)) {
+        size_t i = lower_bound(d, key);
+        size_t n = ncell(d);
+        if (i >= n || cell_key(d, i) != key) return {};
+        if (n == 1 && !is_root) {
+            if (left) {
+                Page& prev = pager.get(rightmost_leaf(pager, left));
+                write32(prev.data.data() + 4, link(d));
+                pager.mark_dirty(prev);
+            }
+            return {true, true};
+        }
+        write16(d + 10, static_cast<uint16_t>(read16(d + 10) + cell_bytes(d, i).size()));
+        uint8_t* slot = d + HDR + SLOT_SIZE * i;
+        std::memmove(slot, slot + SLOT_SIZE, SLOT_SIZE * (n - i - 1));
+        write16(d + 2, static_cast<uint16_t>(n - 1));
+        if (n == 1) init_page(d, IDX_LEAF, 0); // reclaim the whole content area
+        pager.mark_dirty(*page);
+        return {true, false};
+    }
+    size_t pos = child_for(d, key);
+    uint32_t child = child_at(d, pos);
+    Erased res = erase_entry(pager, child, false, key, pos > 0 ? child_at(d, pos - 1) : left);
+    if (!res.empty) return res;
+    pager.free(child);
+    Node node = load(*page);
+    if (node.cells.empty()) {
+        if (!is_root) return res;
+        init_page(d, IDX_LEAF, 0);
+    } else {
+        // The next child takes over the gone one's keys.
+        size_t at = pos == 0 ? 0 : pos - 1;
+        if (pos == 0) node.link = read32(reinterpret_cast<const uint8_t*>(node.cells[0].data()));
+        node.cells.erase(node.cells.begin() + static_cast<std::ptrdiff_t>(at));
+        store(*page, node, node.link, 0, node.cells.size());
+    }
+    pager.mark_dirty(*page);
+    return {true, false};
+}
+
+struct CheckState {
+    std::string last;
+    bool any{false};
+    uint32_t prev_leaf{0};
+};
+
+// Keys of the subtree at `pgno` lie in [lo, hi); hi empty is unbounded.
+static bool check_node(Pager& pager, uint32_t pgno, std::string_view lo, std::string_view hi,
+                       bool bounded, CheckState& st) {
+    PageRef page = pager.acquire(pgno);
+    const uint8_t* d = page->data.data();
+    if (d[0] != IDX_LEAF && d[0] != IDX_INTERNAL) return false;
+    size_t n = ncell(d);
+    if (HDR + SLOT_SIZE * n > content(d)) return false;
+    for (size_t i = 0; i < n; ++i) {
+        size_t off = read16(d + HDR + SLOT_SIZE * i);
+        if (off < content(d) || off + key_offset(d) > PAGE_SIZE) return false;
+        if (off + cell_bytes(d, i).size() > PAGE_SIZE) return false;
+        std::string_view k = cell_key(d, i);
+        if (k < lo || (bounded && k >= hi)) return false;
+        if (i > 0 && cell_key(d, i - 1) >= k) return false;
+    }
+    if (is_leaf(d)) {
+        if (st.prev_leaf && read32(pager.view(st.prev_leaf) + 4) != pgno) return false;
+        st.prev_leaf = pgno;
+        for (size_t i = 0; i < n; ++i) {
+            std::string_view k = cell_key(d, i);
+            if (st.any && k <= st.last) return false;
+            st.last.assign(k);
+            st.any = true;
+        }
+        return true;
+    }
+    // Separators are copied: the recursion may evict this page's frame.
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < n; ++i) keys.emplace_back(cell_key(d, i));
+    std::vector<uint32_t> kids;
+    for (size_t i = 0; i <= n; ++i) kids.push_back(child_at(d, i));
+    page.reset();
+    for (size_t i = 0; i <= n; ++i) {
+        std::string_view clo = i == 0 ? lo : std::string_view(keys[i - 1]);
+        bool cb = i < n || bounded;
+        std::string_view chi = i < n ? std::string_view(keys[i]) : hi;
+        if (!check_node(pager, kids[i], clo, chi, cb, st)) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+uint32_t BTree::create_index() {
+    uint32_t pgno = pager_.alloc();
+    Page& page = pager_.get(pgno);
+    init_page(page.data.data(), IDX_LEAF, 0);
+    pager_.mark_dirty(page);
+    return pgno;
+}
+
+bool BTree::index_insert(uint32_t root, std::string_view key) {
+    if (key.size() > MAX_INDEX_KEY) throw std::runtime_error("index key too long");
+    bool added = false;
+    insert_node(pager_, root, true, key, added);
+    return added;
+}
+
+bool BTree::index_erase(uint32_t root, std::string_view key) {
+    if (!erase_entry(pager_, root, true, key, 0).found) return false;
+    // The root page number is fixed, so a root left with a single child
+    // takes over that child's contents instead.
+    while (true) {
+        PageRef page = pager_.acquire(root);
+        const uint8_t* d = page->data.data();
+        if (is_leaf(d) || ncell(d) != 0) break;
+        uint32_t child = link(d);
+        page->data = pager_.get(child).data;
+        pager_.mark_dirty(*page);
+        page.reset();
+        pager_.free(child);
+    }
+    return true;
+}
+
+bool BTree::index_seek(Cursor& c, std::string_view key) {
+    c.skip_next = false;
+    descend(pager_, c.root, key, c);
+    // Past the end of the leaf (or on an emptied one): the next key, if
+    // any, starts the next non-empty leaf.
+    const uint8_t* d = pin(c);
+    while (c.idx >= ncell(d) && link(d) != 0) {
+        c.pgno = link(d);
+        c.idx = 0;
+        d = pin(c);
+    }
+    return c.idx < ncell(d);
+}
+
+bool BTree::index_next(Cursor& c) {
+    const uint8_t* d = leaf_of(c);
+    if (c.idx + 1 < ncell(d)) { ++c.idx; return true; }
+    while (link(d) != 0) {
+        c.pgno = link(d);
+        c.idx = 0;
+        d = pin(c);
+        if (ncell(d) > 0) return true;
+    }
+    c.idx = ncell(d);
+    return false;
+}
+
+std::string_view BTree::index_key(Cursor& c) {
+    const uint8_t* d = leaf_of(c);
+    if (!is_leaf(d) || c.idx < 0 || c.idx >= ncell(d)) return {};
+    return cell_key(pin(c), static_cast<size_t>(c.idx));
+}
+
+bool BTree::index_check(uint32_t root) {
+    CheckState st;
+    if (!check_node(pager_, root, {}, {}, false, st)) return false;
+    return st.prev_leaf == 0 || read32(pager_.view(st.prev_leaf) + 4) == 0;
+}
+
+} // namespace tinydb
@@ -1,8 +1,20 @@
 #include "tinydb/pager.hpp"
+#include "tinydb/wal.hpp"
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
 
 namespace tinydb {
 
 namespace {
+// Enough frames for the deepest pin set a B-tree split can hold.
+constexpr size_t MIN_POOL_FRAMES = 16;
+// Header page fields (next page number and schema root precede these).
+constexpr size_t FREE_TRUNK_OFF = 8;
+constexpr size_t FREE_COUNT_OFF = 12;
+// Free-list trunk page: [u32 next trunk][u32 count][u32 page numbers...]
+constexpr uint32_t FREE_TRUNK_CAPACITY = (PAGE_SIZE - 8) / 4;
+
 static uint32_t read32(const uint8_t* p) {
     return static_cast<uint32_t>(p[0]) |
            static_cast<uint32_t>(p[1]) << 8 |
@@ -18,60 +30,370 @@ static void write32(uint8_t* p, uint32_t v) {
 }
 } // namespace
 
-Pager::Pager(std::unique_ptr<IStorage> s) : storage_(std::move(s)) {
-    auto header = std::make_unique<Page>();
-    header->no = HEADER_PGNO;
-    header->data.fill(0);
-    storage_->read(0, header->data.data(), PAGE_SIZE);
-    next_pgno_ = read32(header->data.data());
+PageRef::PageRef(Pager& pager, Page& page) : pager_(&pager), page_(&page) {
+    pager_->pin(page);
+}
+
+PageRef::PageRef(PageRef&& o) noexcept : pager_(o.pager_), page_(o.page_) {
+    o.pager_ = nullptr;
+    o.page_ = nullptr;
+}
+
+PageRef& PageRef::operator=(PageRef&& o) noexcept {
+    if (this != &o) {
+        reset();
+        pager_ = o.pager_;
+        page_ = o.page_;
+        o.pager_ = nullptr;
+        o.page_ = nullptr;
+    }
+    return *this;
+}
+
+void PageRef::reset() {
+    if (page_) pager_->unpin(*page_);
+    pager_ = nullptr;
+    page_ = nullptr;
+}
+
+Pager::Pager(std::unique_ptr<IStorage> s, size_t frames, std::unique_ptr<IStorage> wal)
+    : storage_(std::move(s)),
+      capacity_(std::max(frames, MIN_POOL_FRAMES)),
+      kin_(std::max<size_t>(capacity_ / 4, 1)),
+      kout_(std::max<size_t>(capacity_ / 2, 1)) {
+    if (wal) wal_ = std::make_unique<Wal>(std::move(wal));
+    frames_.reserve(capacity_);
+    Page& header = get(HEADER_PGNO);
+    pin(header); // the header page stays resident for the pager's lifetime
+    next_pgno_ = read32(header.data.data());
     if (next_pgno_ < 2) next_pgno_ = 2;
-    cache_[HEADER_PGNO] = std::move(header);
+}
+
+Pager::~Pager() {
+    // Fold committed frames back into the database on a clean close; a
+    // failure here just leaves them to be replayed on the next open.
+    if (wal_) {
+        try { wal_->checkpoint(*storage_); } catch (...) {}
+    }
+}
+
+void Pager::read_page(Page& p) {
+    if (wal_ && wal_->read(p.no, p.data.data())) return;
+    storage_->read(static_cast<uint64_t>(p.no - 1) * PAGE_SIZE,
+                   p.data.data(), PAGE_SIZE);
+}
+
+void Pager::write_back(Page& p) {
+    // In WAL mode a dirty victim is spilled as an uncommitted frame so the
+    // database file only ever receives committed pages via checkpoint.
+    if (wal_) wal_->append({{p.no, p.data.data()}}, false, 0);
+    else storage_->write(static_cast<uint64_t>(p.no - 1) * PAGE_SIZE,
+                         p.data.data(), PAGE_SIZE);
+    p.dirty = false;
+}
+
+void Pager::remember_ghost(uint32_t pgno) {
+    a1out_.push_front(pgno);
+    ghosts_[pgno] = a1out_.begin();
+    if (a1out_.size() > kout_) {
+        ghosts_.erase(a1out_.back());
+        a1out_.pop_back();
+    }
+}
+
+bool Pager::evict_from(std::list<size_t>& q, size_t& out) {
+    for (auto it = q.rbegin(); it != q.rend(); ++it) {
+        Frame& f = frames_[*it];
+        if (f.page->pins) continue;
+        if (f.page->dirty) write_back(*f.page);
+        table_.erase(f.page->no);
+        if (&q == &a1in_) remember_ghost(f.page->no);
+        out = *it;
+        q.erase(std::next(it).base());
+        f.queue = Queue::None;
+        return true;
+    }
+    return false;
+}
+
+size_t Pager::grab_frame(uint32_t pgno) {
+    size_t idx = 0;
+    if (!free_frames_.empty()) {
+        idx = free_frames_.back();
+        free_frames_.pop_back();
+    } else if (frames_.size() < capacity_) {
+        idx = frames_.size();
+        frames_.emplace_back();
+        frames_.back().page = std::make_unique<Page>();
+    } else {
+        bool ok = a1in_.size() > kin_
+            ? (evict_from(a1in_, idx) || evict_from(am_, idx))
+            : (evict_from(am_, idx) || evict_from(a1in_, idx));
+        if (!ok) throw std::runtime_error("buffer pool exhausted: all frames pinned");
+    }
+    Frame& f = frames_[idx];
+    auto ghost = ghosts_.find(pgno);
+    if (ghost != ghosts_.end()) {
+        a1out_.erase(ghost->second);
+        ghosts_.erase(ghost);
+        am_.push_front(idx);
+        f.queue = Queue::Am;
+        f.pos = am_.begin();
+    } else {
+        a1in_.push_front(idx);
+        f.queue = Queue::A1in;
+        f.pos = a1in_.begin();
+    }
+    Page& page = *f.page;
+    page.no = pgno;
+    page.data.fill(0);
+    page.dirty = false;
+    page.pins = 0;
+    table_[pgno] = idx;
+    return idx;
 }
 
 Page& Pager::get(uint32_t pgno) {
-    auto it = cache_.find(pgno);
-    if (it == cache_.end()) {
-        auto page = std::make_unique<Page>();
-        page->no = pgno;
-        page->data.fill(0);
-        storage_->read(static_cast<uint64_t>(pgno - 1) * PAGE_SIZE,
-                       page->data.data(), PAGE_SIZE);
-        it = cache_.emplace(pgno, std::move(page)).first;
+    Page* page = nullptr;
+    auto it = table_.find(pgno);
+    if (it != table_.end()) {
+        Frame& f = frames_[it->second];
+        if (f.queue == Queue::Am) am_.splice(am_.begin(), am_, f.pos);
+        page = f.page.get();
+    } else {
+        page = frames_[grab_frame(pgno)].page.get();
+        read_page(*page);
     }
     if (pgno >= next_pgno_) {
         next_pgno_ = pgno + 1;
-        Page& hdr = *cache_[HEADER_PGNO];
+        Page& hdr = get(HEADER_PGNO);
         write32(hdr.data.data(), next_pgno_);
         hdr.dirty = true;
     }
-    return *it->second;
+    return *page;
 }
 
-uint32_t Pager::alloc() {
-    uint32_t pgno = next_pgno_++;
-    auto page = std::make_unique<Page>();
-    page->no = pgno;
-    page->data.fill(0);
-    cache_[pgno] = std::move(page);
+// The page's bytes in the storage's mapping, if it is not resident and
+// the file holds its latest version.
+const uint8_t* Pager::mapped(uint32_t pgno) {
+    if (table_.count(pgno) || pgno >= next_pgno_ || (wal_ && wal_->contains(pgno))) return nullptr;
+    return storage_->view(static_cast<uint64_t>(pgno - 1) * PAGE_SIZE, PAGE_SIZE);
+}
+
+const uint8_t* Pager::view(uint32_t pgno) {
+    if (const uint8_t* m = mapped(pgno)) return m;
+    return get(pgno).data.data();
+}
+
+const uint8_t* Pager::view(uint32_t pgno, PageRef& pin) {
+    pin.reset();
+    if (const uint8_t* m = mapped(pgno)) return m;
+    pin = acquire(pgno);
+    return pin->data.data();
+}
+
+uint32_t Pager::alloc(uint32_t near) {
     Page& hdr = get(HEADER_PGNO);
+    uint32_t pgno = 0;
+    if (read32(hdr.data.data() + FREE_COUNT_OFF) > 0) pgno = take_free(near);
+    if (pgno != 0) {
+        // Reused pages hold stale bytes; hand them out zeroed and dirty.
+        auto it = table_.find(pgno);
+        Page* page = it != table_.end() ? frames_[it->second].page.get()
+                                        : frames_[grab_frame(pgno)].page.get();
+        page->data.fill(0);
+        mark_dirty(*page);
+        return pgno;
+    }
+    pgno = next_pgno_++;
+    grab_frame(pgno);
     write32(hdr.data.data(), next_pgno_);
     mark_dirty(hdr);
     return pgno;
 }
 
-void Pager::mark_dirty(Page& p) { p.dirty = true; }
+// Pop a page off the first trunk: the leaf entry closest to `near`, or
+// the trunk page itself once it has no leaf entries left.
+uint32_t Pager::take_free(uint32_t near) {
+    Page& hdr = get(HEADER_PGNO);
+    uint8_t* h = hdr.data.data();
+    uint32_t trunk_no = read32(h + FREE_TRUNK_OFF);
+    if (trunk_no == 0) return 0;
+    PageRef trunk = acquire(trunk_no);
+    uint8_t* t = trunk->data.data();
+    uint32_t n = read32(t + 4);
+    uint32_t pgno = 0;
+    if (n == 0) {
+        pgno = trunk_no;
+        write32(h + FREE_TRUNK_OFF, read32(t));
+    } else {
+        uint32_t best = n - 1;
+        if (near != 0) {
+            uint32_t best_dist = UINT32_MAX;
+            for (uint32_t i = 0; i < n; ++i) {
+                uint32_t cand = read32(t + 8 + 4 * i);
+                uint32_t dist = cand > near ? cand - near : near - cand;
+                if (dist < best_dist) { best = i; best_dist = dist; }
+            }
+        }
+        pgno = read32(t + 8 + 4 * best);
+        write32(t + 8 + 4 * best, read32(t + 8 + 4 * (n - 1)));
+        write32(t + 4, n - 1);
+        mark_dirty(*trunk);
+    }
+    write32(h + FREE_COUNT_OFF, read32(h + FREE_COUNT_OFF) - 1);
+    mark_dirty(hdr);
+    return pgno;
+}
+
+void Pager::free(uint32_t pgno) {
+    if (pgno <= HEADER_PGNO || pgno >= next_pgno_) return;
+    Page& hdr = get(HEADER_PGNO);
+    uint8_t* h = hdr.data.data();
+    uint32_t trunk_no = read32(h + FREE_TRUNK_OFF);
+    bool full = true;
+    if (trunk_no != 0) {
+        PageRef trunk = acquire(trunk_no);
+        uint8_t* t = trunk->data.data();
+        uint32_t n = read32(t + 4);
+        full = n >= FREE_TRUNK_CAPACITY;
+        if (!full) {
+            write32(t + 8 + 4 * n, pgno);
+            write32(t + 4, n + 1);
+            mark_dirty(*trunk);
+        }
+    }
+    if (full) {
+        // The freed page becomes the new first trunk.
+        Page& page = get(pgno);
+        page.data.fill(0);
+        write32(page.data.data(), trunk_no);
+        mark_dirty(page);
+        write32(h + FREE_TRUNK_OFF, pgno);
+    } else {
+        // A free leaf page's contents are dead; don't write them back.
+        auto it = table_.find(pgno);
+        if (it != table_.end() && frames_[it->second].page->pins == 0) {
+            Frame& f = frames_[it->second];
+            if (f.queue == Queue::A1in) a1in_.erase(f.pos);
+            else if (f.queue == Queue::Am) am_.erase(f.pos);
+            f.queue = Queue::None;
+            f.page->dirty = false;
+            free_frames_.push_back(it->second);
+            table_.erase(it);
+        }
+    }
+    write32(h + FREE_COUNT_OFF, read32(h + FREE_COUNT_OFF) + 1);
+    mark_dirty(hdr);
+}
+
+size_t Pager::pinned() const {
+    size_t n = 0;
+    for (auto& kv : table_) n += frames_[kv.second].page->pins > 0;
+    return n;
+}
+
+uint32_t Pager::free_count() {
+    return read32(get(HEADER_PGNO).data.data() + FREE_COUNT_OFF);
+}
+
+void Pager::mark_dirty(Page& p) {
+    // Capture the committed image the first time a pre-existing page is
+    // dirtied; callers mark pages right after changing them, before any
+    // eviction could have written the change out.
+    if (in_txn_ && !wal_ && p.no < txn_next_pgno_ && !undo_.count(p.no)) {
+        storage_->read(static_cast<uint64_t>(p.no - 1) * PAGE_SIZE,
+                       undo_[p.no].data(), PAGE_SIZE);
+    }
+    p.dirty = true;
+}
 
 void Pager::flush() {
-    for (auto& kv : cache_) {
-        Page& p = *kv.second;
-        if (p.dirty) {
-            storage_->write(static_cast<uint64_t>(p.no - 1) * PAGE_SIZE,
-                             p.data.data(), PAGE_SIZE);
-            p.dirty = false;
+    // Write dirty pages in file order, one vectored write per run of
+    // consecutive page numbers.
+    std::vector<Page*> dirty;
+    for (auto& kv : table_) {
+        Page* p = frames_[kv.second].page.get();
+        if (p->dirty) dirty.push_back(p);
+    }
+    std::sort(dirty.begin(), dirty.end(),
+              [](const Page* a, const Page* b) { return a->no < b->no; });
+    in_txn_ = false;
+    undo_.clear();
+    if (wal_) {
+        commit_wal(dirty);
+        return;
+    }
+    std::vector<IoSlice> run;
+    for (size_t i = 0; i < dirty.size(); ++i) {
+        run.push_back({dirty[i]->data.data(), PAGE_SIZE});
+        if (i + 1 == dirty.size() || dirty[i + 1]->no != dirty[i]->no + 1) {
+            uint32_t first = dirty[i]->no - static_cast<uint32_t>(run.size() - 1);
+            storage_->writev(static_cast<uint64_t>(first - 1) * PAGE_SIZE, run.data(), run.size());
+            run.clear();
         }
+        dirty[i]->dirty = false;
     }
     storage_->sync();
 }
 
-} // namespace tinydb
+void Pager::commit_wal(std::vector<Page*>& dirty) {
+    // Frames spilled earlier need a commit frame even if nothing is
+    // dirty now; the always-resident header page serves as that frame.
+    if (dirty.empty() && wal_->has_pending()) dirty.push_back(&get(HEADER_PGNO));
+    if (dirty.empty()) return;
+    std::vector<std::pair<uint32_t, const uint8_t*>> pages;
+    pages.reserve(dirty.size());
+    for (Page* p : dirty) pages.emplace_back(p->no, p->data.data());
+    // All of the commit's frames go out in one append and one sync.
+    wal_->append(pages, true, next_pgno_ - 1);
+    for (Page* p : dirty) p->dirty = false;
+    if (wal_->frames() >= WAL_AUTOCHECKPOINT) wal_->checkpoint(*storage_);
+}
+
+void Pager::begin() {
+    flush();
+    in_txn_ = true;
+    txn_next_pgno_ = next_pgno_;
+    if (!wal_) undo_[HEADER_PGNO] = get(HEADER_PGNO).data;
+}
+
+void Pager::rollback() {
+    if (wal_) {
+        wal_->discard_pending();
+    } else {
+        for (auto& kv : undo_)
+            storage_->write(static_cast<uint64_t>(kv.first - 1) * PAGE_SIZE,
+                            kv.second.data(), PAGE_SIZE);
+        storage_->sync();
+    }
+    undo_.clear();
+    in_txn_ = false;
+    drop_frames();
+    next_pgno_ = read32(get(HEADER_PGNO).data.data());
+    if (next_pgno_ < 2) next_pgno_ = 2;
+}
 
+// Forget every cached page; pinned ones are reloaded in place.
+void Pager::drop_frames() {
+    for (auto it = table_.begin(); it != table_.end();) {
+        Frame& f = frames_[it->second];
+        if (f.page->pins) {
+            read_page(*f.page);
+            f.page->dirty = false;
+            ++it;
+            continue;
+        }
+        if (f.queue == Queue::A1in) a1in_.erase(f.pos);
+        else if (f.queue == Queue::Am) am_.erase(f.pos);
+        f.queue = Queue::None;
+        free_frames_.push_back(it->second);
+        it = table_.erase(it);
+    }
+}
+
+void Pager::checkpoint() {
+    if (wal_) wal_->checkpoint(*storage_);
+}
+
+} // namespace tinydb
@@ -1,7 +1,9 @@
 #include "tinydb/parser.hpp"
+#include <algorithm>
 #include <cctype>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace tinydb {
@@ -19,9 +21,14 @@ public:
         for (size_t i = 0; i < len; ++i) {
             if (std::toupper(static_cast<unsigned char>(sql[pos + i])) != kw[i]) return false;
         }
+        // Whole words only: OR must not match the start of ORDER.
+        if (pos + len < sql.size() && is_ident_char(sql[pos + len])) return false;
         pos += len;
         return true;
     }
+    static bool is_ident_char(char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    }
     bool consume(char c) {
         skip_ws();
         if (pos < sql.size() && sql[pos] == c) { ++pos; return true; }
@@ -30,7 +37,7 @@ public:
     std::string parse_ident() {
         skip_ws();
         size_t start = pos;
-        while (pos < sql.size() && (std::isalnum(static_cast<unsigned char>(sql[pos])) || sql[pos]=='_')) ++pos;
+        while (pos < sql.size() && is_ident_char(sql[pos])) ++pos;
         return sql.substr(start, pos-start);
     }
     std::string parse_string() {
@@ -48,18 +55,147 @@ public:
         while (pos < sql.size() && std::isdigit(static_cast<unsigned char>(sql[pos]))) ++pos;
         return sql.substr(start, pos-start);
     }
+    // ? (next index), ?N, or :name (same index at every use). Returns the
+    // 1-based index, 0 if there is no placeholder here.
+    int parse_param() {
+        skip_ws();
+        if (pos >= sql.size()) return 0;
+        if (sql[pos] == '?') {
+            ++pos;
+            std::string num = parse_number();
+            if (num.empty()) {
+                params.emplace_back();
+                return static_cast<int>(params.size());
+            }
+            int idx = num.size() > 4 ? 0 : std::stoi(num);
+            if (idx <= 0) return 0;
+            if (params.size() < static_cast<size_t>(idx)) params.resize(idx);
+            return idx;
+        }
+        if (sql[pos] == ':') {
+            ++pos;
+            std::string name = parse_ident();
+            if (name.empty()) return 0;
+            auto it = std::find(params.begin(), params.end(), name);
+            if (it != params.end()) return static_cast<int>(it - params.begin()) + 1;
+            params.push_back(name);
+            return static_cast<int>(params.size());
+        }
+        return 0;
+    }
+    // 'text', NULL, a number with optional sign and fraction, or a
+    // placeholder, which is kept as "?N".
+    std::string parse_value() {
+        skip_ws();
+        if (pos < sql.size() && sql[pos] == '\'') return parse_string();
+        if (int idx = parse_param()) return "?" + std::to_string(idx);
+        if (match_kw("NULL")) return "NULL";
+        std::string sign;
+        if (pos < sql.size() && sql[pos] == '-') { sign = "-"; ++pos; }
+        std::string num = parse_number();
+        if (num.empty()) return {};
+        if (pos + 1 < sql.size() && sql[pos] == '.' &&
+            std::isdigit(static_cast<unsigned char>(sql[pos + 1]))) {
+            ++pos;
+            num += "." + parse_number();
+        }
+        return sign + num;
+    }
+    // WHERE expr, where expr is comparisons (=, ==, !=, <>, <, <=, >, >=,
+    // BETWEEN) joined by AND and OR, AND binding tighter, with parentheses.
+    bool parse_where(std::unique_ptr<Expr>& where) {
+        if (!match_kw("WHERE")) return true;
+        where = parse_or();
+        return where != nullptr;
+    }
+    std::unique_ptr<Expr> parse_or() {
+        auto e = parse_and();
+        while (e && match_kw("OR")) e = join(Expr::Or, std::move(e), parse_and());
+        return e;
+    }
+    std::unique_ptr<Expr> parse_and() {
+        auto e = parse_cmp();
+        while (e && match_kw("AND")) e = join(Expr::And, std::move(e), parse_cmp());
+        return e;
+    }
+    static std::unique_ptr<Expr> join(Expr::Kind k, std::unique_ptr<Expr> l, std::unique_ptr<Expr> r) {
+        if (!l || !r) return nullptr;
+        auto e = std::make_unique<Expr>();
+        e->kind = k;
+        e->left = std::move(l);
+        e->right = std::move(r);
+        return e;
+    }
+    static std::unique_ptr<Expr> cmp(Expr::CmpOp op, Operand a, Operand b) {
+        // Column on the left: 5 < a is a > 5.
+        static const Expr::CmpOp mirror[] = {Expr::EQ, Expr::NE, Expr::GT, Expr::GE, Expr::LT, Expr::LE};
+        if (!a.column && b.column) { std::swap(a, b); op = mirror[op]; }
+        auto e = std::make_unique<Expr>();
+        e->op = op;
+        e->lhs = std::move(a);
+        e->rhs = std::move(b);
+        return e;
+    }
+    std::unique_ptr<Expr> parse_cmp() {
+        if (consume('(')) {
+            auto e = parse_or();
+            if (!e || !consume(')')) return nullptr;
+            return e;
+        }
+        Operand a, b;
+        if (!parse_operand(a)) return nullptr;
+        if (match_kw("BETWEEN")) {
+            Operand lo, hi;
+            if (!parse_operand(lo) || !match_kw("AND") || !parse_operand(hi)) return nullptr;
+            return join(Expr::And, cmp(Expr::GE, a, std::move(lo)), cmp(Expr::LE, a, std::move(hi)));
+        }
+        Expr::CmpOp op;
+        if (consume('<')) op = consume('=') ? Expr::LE : consume('>') ? Expr::NE : Expr::LT;
+        else if (consume('>')) op = consume('=') ? Expr::GE : Expr::GT;
+        else if (consume('=')) { consume('='); op = Expr::EQ; }
+        else if (consume('!') && consume('=')) op = Expr::NE;
+        else return nullptr;
+        if (!parse_operand(b)) return nullptr;
+        return cmp(op, std::move(a), std::move(b));
+    }
+    // A column name or a parse_value() literal.
+    bool parse_operand(Operand& o) {
+        skip_ws();
+        if (pos < sql.size() && (std::isalpha(static_cast<unsigned char>(sql[pos])) || sql[pos] == '_')) {
+            if (match_kw("NULL")) { o = {false, "NULL"}; return true; }
+            o = {true, parse_ident()};
+            return true;
+        }
+        o = {false, parse_value()};
+        return !o.text.empty();
+    }
+    // A select-list item: a column, FN(column) or COUNT(*).
+    bool parse_item(std::string& col, AggFn& fn) {
+        static const std::pair<const char*, AggFn> fns[] = {
+            {"COUNT", AggFn::Count}, {"SUM", AggFn::Sum}, {"MIN", AggFn::Min},
+            {"MAX", AggFn::Max}, {"AVG", AggFn::Avg},
+        };
+        fn = AggFn::None;
+        size_t start = pos;
+        for (auto& [kw, f] : fns) {
+            if (!match_kw(kw)) continue;
+            if (consume('(')) { fn = f; break; }
+            pos = start; // a column named like the function
+        }
+        col = fn == AggFn::Count && consume('*') ? "*" : parse_ident();
+        if (col.empty()) return false;
+        return fn == AggFn::None || consume(')');
+    }
     bool eof() {
         skip_ws();
         return pos >= sql.size();
     }
     const std::string& sql;
     size_t pos;
+    std::vector<std::string> params; // by index - 1; "" for unnamed
 };
 
-} // namespace
-
-std::unique_ptr<ASTNode> parse(const std::string& sql) {
-    Parser p(sql);
+std::unique_ptr<ASTNode> parse_statement(Parser& p) {
     if (p.match_kw("CREATE") && p.match_kw("TABLE")) {
         auto n = std::make_unique<ASTCreate>();
         n->table = p.parse_ident();
@@ -77,16 +213,28 @@ std::unique_ptr<ASTNode> parse(const std::string& sql) {
         return n;
     }
     p.pos = 0; // reset
+    if (p.match_kw("CREATE") && p.match_kw("INDEX")) {
+        auto n = std::make_unique<ASTCreateIndex>();
+        n->name = p.parse_ident();
+        if (n->name.empty() || !p.match_kw("ON")) return nullptr;
+        n->table = p.parse_ident();
+        if (n->table.empty() || !p.consume('(')) return nullptr;
+        do {
+            std::string col = p.parse_ident();
+            if (col.empty()) return nullptr;
+            n->cols.push_back(col);
+        } while (p.consume(','));
+        if (!p.consume(')') || !p.eof()) return nullptr;
+        return n;
+    }
+    p.pos = 0;
     if (p.match_kw("INSERT") && p.match_kw("INTO")) {
         auto n = std::make_unique<ASTInsert>();
         n->table = p.parse_ident();
         if (!p.match_kw("VALUES")) return nullptr;
         if (!p.consume('(')) return nullptr;
         while (true) {
-            p.skip_ws();
-            std::string val;
-            if (p.pos < p.sql.size() && p.sql[p.pos] == '\'') val = p.parse_string();
-            else val = p.parse_number();
+            std::string val = p.parse_value();
             if (val.empty()) return nullptr;
             n->values.push_back(val);
             if (p.consume(')')) break;
@@ -96,30 +244,102 @@ std::unique_ptr<ASTNode> parse(const std::string& sql) {
         return n;
     }
     p.pos = 0;
+    if (p.match_kw("DELETE") && p.match_kw("FROM")) {
+        auto n = std::make_unique<ASTDelete>();
+        n->table = p.parse_ident();
+        if (n->table.empty()) return nullptr;
+        if (!p.parse_where(n->where) || !p.eof()) return nullptr;
+        return n;
+    }
+    p.pos = 0;
+    if (p.match_kw("UPDATE")) {
+        auto n = std::make_unique<ASTUpdate>();
+        n->table = p.parse_ident();
+        if (n->table.empty() || !p.match_kw("SET")) return nullptr;
+        do {
+            std::string col = p.parse_ident();
+            if (col.empty() || !p.consume('=')) return nullptr;
+            std::string val = p.parse_value();
+            if (val.empty()) return nullptr;
+            n->sets.emplace_back(col, val);
+        } while (p.consume(','));
+        if (!p.parse_where(n->where) || !p.eof()) return nullptr;
+        return n;
+    }
+    p.pos = 0;
+    if (p.match_kw("BEGIN")) {
+        p.match_kw("TRANSACTION");
+        if (!p.eof()) return nullptr;
+        auto n = std::make_unique<ASTTransaction>();
+        n->kind = ASTTransaction::Begin;
+        return n;
+    }
+    p.pos = 0;
+    if (p.match_kw("COMMIT") || p.match_kw("END")) {
+        p.match_kw("TRANSACTION");
+        if (!p.eof()) return nullptr;
+        auto n = std::make_unique<ASTTransaction>();
+        n->kind = ASTTransaction::Commit;
+        return n;
+    }
+    p.pos = 0;
+    if (p.match_kw("ROLLBACK")) {
+        p.match_kw("TRANSACTION");
+        if (!p.eof()) return nullptr;
+        auto n = std::make_unique<ASTTransaction>();
+        n->kind = ASTTransaction::Rollback;
+        return n;
+    }
+    p.pos = 0;
     if (p.match_kw("SELECT")) {
         auto n = std::make_unique<ASTSelect>();
         if (p.consume('*')) {
             n->cols.push_back("*");
         } else {
-            std::string col = p.parse_ident();
-            if (col.empty()) return nullptr;
-            n->cols.push_back(col);
-            while (p.consume(',')) {
-                std::string c2 = p.parse_ident();
-                if (c2.empty()) return nullptr;
-                n->cols.push_back(c2);
-            }
+            bool agg = false;
+            do {
+                std::string col;
+                AggFn fn;
+                if (!p.parse_item(col, fn)) return nullptr;
+                n->cols.push_back(col);
+                n->aggs.push_back(fn);
+                agg |= fn != AggFn::None;
+            } while (p.consume(','));
+            if (!agg) n->aggs.clear();
         }
         if (!p.match_kw("FROM")) return nullptr;
         n->table = p.parse_ident();
         if (n->table.empty()) return nullptr;
-        if (p.match_kw("WHERE")) {
-            if (!p.match_kw("ROWID")) return nullptr;
-            if (!p.consume('=')) return nullptr;
-            std::string num = p.parse_number();
-            if (num.empty()) return nullptr;
-            n->where_rowid = true;
-            n->rowid = std::stoll(num);
+        if (!p.parse_where(n->where)) return nullptr;
+        if (p.match_kw("GROUP")) {
+            if (!p.match_kw("BY")) return nullptr;
+            do {
+                std::string col = p.parse_ident();
+                if (col.empty()) return nullptr;
+                n->group_by.push_back(col);
+            } while (p.consume(','));
+        }
+        if (p.match_kw("ORDER")) {
+            if (!p.match_kw("BY")) return nullptr;
+            do {
+                std::string term = p.parse_ident(); // a name, or digits
+                if (term.empty()) return nullptr;
+                bool desc = p.match_kw("DESC");
+                if (!desc) p.match_kw("ASC");
+                n->order_by.emplace_back(term, desc);
+            } while (p.consume(','));
+        }
+        if (p.match_kw("LIMIT")) {
+            n->limit = p.parse_value();
+            if (n->limit.empty()) return nullptr;
+            if (p.match_kw("OFFSET")) {
+                n->offset = p.parse_value();
+                if (n->offset.empty()) return nullptr;
+            } else if (p.consume(',')) { // LIMIT offset, count
+                n->offset = std::move(n->limit);
+                n->limit = p.parse_value();
+                if (n->limit.empty()) return nullptr;
+            }
         }
         if (!p.eof()) return nullptr;
         return n;
@@ -127,5 +347,14 @@ std::unique_ptr<ASTNode> parse(const std::string& sql) {
     return nullptr;
 }
 
+} // namespace
+
+std::unique_ptr<ASTNode> parse(const std::string& sql) {
+    Parser p(sql);
+    auto n = parse_statement(p);
+    if (n) n->params = std::move(p.params);
+    return n;
+}
+
 } // namespace tinydb
 
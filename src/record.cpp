@@ -1,47 +1,373 @@
 #include "tinydb/record.hpp"
 #include "tinydb/varint.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 
 namespace tinydb {
 
-std::vector<uint8_t> encode_row(const std::vector<Value>& cols) {
-    std::vector<uint8_t> out;
-    auto ncols = encode_varint(cols.size());
-    out.insert(out.end(), ncols.begin(), ncols.end());
-    for (auto& v : cols) {
-        out.push_back(static_cast<uint8_t>(v.tag));
-        if (v.tag == ColTag::INT) {
-            auto enc = encode_varint(static_cast<uint64_t>(v.i));
-            out.insert(out.end(), enc.begin(), enc.end());
+namespace {
+constexpr uint64_t ST_NULL = 0;
+constexpr uint64_t ST_REAL = 7;
+constexpr uint64_t ST_ZERO = 8;
+constexpr uint64_t ST_ONE = 9;
+constexpr uint64_t ST_BLOB = 12;
+constexpr uint64_t ST_TEXT = 13;
+constexpr uint8_t INT_WIDTH[7] = {0, 1, 2, 3, 4, 6, 8}; // by serial type
+
+static uint64_t serial_type(const Value& v) {
+    switch (v.tag) {
+    case ColTag::NIL: return ST_NULL;
+    case ColTag::REAL: return ST_REAL;
+    case ColTag::TEXT: return ST_TEXT + 2 * static_cast<uint64_t>(v.text().size());
+    case ColTag::BLOB: return ST_BLOB + 2 * static_cast<uint64_t>(v.text().size());
+    case ColTag::INT: break;
+    }
+    if (v.i == 0) return ST_ZERO;
+    if (v.i == 1) return ST_ONE;
+    uint64_t z = zigzag_encode(v.i);
+    uint64_t t = 1;
+    while (INT_WIDTH[t] < 8 && (z >> (8 * INT_WIDTH[t])) != 0) ++t;
+    return t;
+}
+
+static size_t body_size(uint64_t t) {
+    if (t <= 6) return INT_WIDTH[t];
+    if (t == ST_REAL) return 8;
+    if (t < ST_BLOB) return 0;
+    return static_cast<size_t>((t - ST_BLOB) / 2);
+}
+
+static uint64_t read_le(const uint8_t* p, size_t w) {
+    uint64_t v = 0;
+    for (size_t i = w; i-- > 0;) v = v << 8U | p[i];
+    return v;
+}
+
+static void write_le(uint8_t* p, uint64_t v, size_t w) {
+    for (size_t i = 0; i < w; ++i, v >>= 8U) p[i] = static_cast<uint8_t>(v);
+}
+
+// The value of one column body of serial type t. Fields the type does
+// not use are zeroed.
+static void decode_body(uint64_t t, const uint8_t* b, ColTag& tag, int64_t& i,
+                        double& r, std::string_view& text) {
+    i = 0;
+    r = 0.0;
+    text = {};
+    if (t <= 6) {
+        tag = t == ST_NULL ? ColTag::NIL : ColTag::INT;
+        i = zigzag_decode(read_le(b, INT_WIDTH[t]));
+    } else if (t == ST_REAL) {
+        tag = ColTag::REAL;
+        uint64_t bits = read_le(b, 8);
+        std::memcpy(&r, &bits, sizeof bits);
+    } else if (t < ST_BLOB) {
+        tag = ColTag::INT;
+        i = t == ST_ONE ? 1 : 0; // 10 and 11 are unused
+    } else {
+        tag = t & 1U ? ColTag::TEXT : ColTag::BLOB;
+        text = std::string_view(reinterpret_cast<const char*>(b), body_size(t));
+    }
+}
+
+// Header size including its own varint.
+static size_t header_size(size_t types) {
+    size_t h = types + 1;
+    while (types + varint_size(h) != h) h = types + varint_size(h);
+    return h;
+}
+
+enum : uint8_t { K_NULL = 0x05, K_LOW = 0x14, K_NUM = 0x15, K_HIGH = 0x16, K_TEXT = 0x25, K_BLOB = 0x35 };
+constexpr uint64_t SIGN = uint64_t{1} << 63;
+constexpr double TWO_63 = 9223372036854775808.0;
+
+static void append_be(std::string& out, uint64_t v) {
+    for (int s = 56; s >= 0; s -= 8) out.push_back(static_cast<char>(v >> s));
+}
+
+static uint64_t read_be(const char* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v = v << 8U | static_cast<uint8_t>(p[i]);
+    return v;
+}
+
+// Doubles whose bit patterns sort like their values.
+static uint64_t ordered_bits(double r) {
+    uint64_t bits;
+    std::memcpy(&bits, &r, sizeof bits);
+    return bits & SIGN ? ~bits : bits | SIGN;
+}
+
+static double from_ordered_bits(uint64_t bits) {
+    bits = bits & SIGN ? bits & ~SIGN : ~bits;
+    double r;
+    std::memcpy(&r, &bits, sizeof r);
+    return r;
+}
+
+// Offset just past the value starting at key[pos]; SIZE_MAX if it runs
+// off the end.
+static size_t skip_key_value(std::string_view key, size_t pos) {
+    if (pos >= key.size()) return SIZE_MAX;
+    switch (static_cast<uint8_t>(key[pos])) {
+    case K_NULL: return pos + 1;
+    case K_LOW: case K_HIGH: return pos + 9 <= key.size() ? pos + 9 : SIZE_MAX;
+    case K_NUM:
+        if (pos + 10 > key.size()) return SIZE_MAX;
+        return key[pos + 9] == 0 ? pos + 10 : pos + 18 <= key.size() ? pos + 18 : SIZE_MAX;
+    case K_TEXT: case K_BLOB:
+        for (size_t i = pos + 1; i + 1 < key.size(); ++i) {
+            if (key[i] != 0) continue;
+            if (key[i + 1] == 1) return i + 2;
+            ++i; // escaped 00
+        }
+        return SIZE_MAX;
+    default: return SIZE_MAX;
+    }
+}
+} // namespace
+
+int compare_values(const Value& a, const Value& b) {
+    if (a.tag == ColTag::INT && b.tag == ColTag::INT) return (a.i > b.i) - (a.i < b.i);
+    // Rank by type class: NULL 0, numbers 1, TEXT 2, BLOB 3.
+    auto rank = [](ColTag t) {
+        return t == ColTag::NIL ? 0 : t == ColTag::INT || t == ColTag::REAL ? 1 : t == ColTag::TEXT ? 2 : 3;
+    };
+    int ra = rank(a.tag), rb = rank(b.tag);
+    if (ra != rb) return ra < rb ? -1 : 1;
+    if (ra == 0) return 0;
+    if (ra == 1) {
+        double x = a.tag == ColTag::INT ? static_cast<double>(a.i) : a.r;
+        double y = b.tag == ColTag::INT ? static_cast<double>(b.i) : b.r;
+        return (x > y) - (x < y);
+    }
+    int c = a.text().compare(b.text());
+    return (c > 0) - (c < 0);
+}
+
+void append_key(const Value& v, std::string& out) {
+    switch (v.tag) {
+    case ColTag::NIL:
+        out.push_back(static_cast<char>(K_NULL));
+        return;
+    case ColTag::INT:
+        out.push_back(static_cast<char>(K_NUM));
+        append_be(out, static_cast<uint64_t>(v.i) ^ SIGN);
+        out.push_back(0);
+        return;
+    case ColTag::REAL: {
+        // Integer part and fraction, so that INT and REAL interleave
+        // exactly; values outside the int64 range keep their own classes.
+        if (!(v.r >= -TWO_63) || v.r >= TWO_63) {
+            out.push_back(static_cast<char>(v.r >= TWO_63 ? K_HIGH : K_LOW));
+            append_be(out, ordered_bits(v.r));
+            return;
+        }
+        double f = std::floor(v.r);
+        out.push_back(static_cast<char>(K_NUM));
+        append_be(out, static_cast<uint64_t>(static_cast<int64_t>(f)) ^ SIGN);
+        double frac = v.r - f; // exact, in [0, 1)
+        if (frac == 0) { out.push_back(0); return; }
+        out.push_back(1);
+        append_be(out, ordered_bits(frac));
+        return;
+    }
+    case ColTag::TEXT:
+    case ColTag::BLOB:
+        out.push_back(static_cast<char>(v.tag == ColTag::TEXT ? K_TEXT : K_BLOB));
+        for (char c : v.text()) {
+            out.push_back(c);
+            if (c == 0) out.push_back(static_cast<char>(0xFF));
+        }
+        out.push_back(0);
+        out.push_back(1);
+        return;
+    }
+}
+
+void finish_key(const Value* cols, size_t n, int64_t rowid, std::string& out) {
+    for (size_t i = 0; i < n; ++i) out.push_back(static_cast<char>(cols[i].tag));
+    append_be(out, static_cast<uint64_t>(rowid) ^ SIGN);
+}
+
+bool key_column(std::string_view key, size_t ncols, size_t col, Value& out) {
+    if (col >= ncols || key.size() < ncols + 8) return false;
+    size_t pos = 0;
+    for (size_t i = 0; i < col && pos != SIZE_MAX; ++i) pos = skip_key_value(key, pos);
+    size_t end = skip_key_value(key, pos);
+    size_t tags = key.size() - 8 - ncols;
+    if (end == SIZE_MAX || end > tags) return false;
+    out.tag = static_cast<ColTag>(key[tags + col]);
+    out.i = 0;
+    out.r = 0.0;
+    out.s.clear();
+    out.ref = {};
+    const char* p = key.data() + pos;
+    switch (static_cast<uint8_t>(p[0])) {
+    case K_NULL:
+        return out.tag == ColTag::NIL;
+    case K_LOW: case K_HIGH:
+        out.r = from_ordered_bits(read_be(p + 1));
+        return out.tag == ColTag::REAL;
+    case K_NUM: {
+        auto f = static_cast<int64_t>(read_be(p + 1) ^ SIGN);
+        if (out.tag == ColTag::INT) { out.i = f; return p[9] == 0; }
+        out.r = static_cast<double>(f);
+        if (p[9] != 0) out.r += from_ordered_bits(read_be(p + 10));
+        return out.tag == ColTag::REAL;
+    }
+    default: {
+        std::string_view body = key.substr(pos + 1, end - pos - 3);
+        if (body.find('\0') == std::string_view::npos) {
+            out.ref = body;
         } else {
-            auto len = encode_varint(v.s.size());
-            out.insert(out.end(), len.begin(), len.end());
-            out.insert(out.end(), v.s.begin(), v.s.end());
+            for (size_t i = 0; i < body.size(); ++i) {
+                out.s.push_back(body[i]);
+                if (body[i] == 0) ++i;
+            }
+        }
+        return out.tag == (static_cast<uint8_t>(p[0]) == K_TEXT ? ColTag::TEXT : ColTag::BLOB);
+    }
+    }
+}
+
+int64_t key_rowid(std::string_view key) {
+    if (key.size() < 8) return 0;
+    return static_cast<int64_t>(read_be(key.data() + key.size() - 8) ^ SIGN);
+}
+
+size_t row_size(const Value* cols, size_t n) {
+    size_t types = 0, body = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t t = serial_type(cols[i]);
+        types += varint_size(t);
+        body += body_size(t);
+    }
+    return header_size(types) + body;
+}
+
+void encode_row(const Value* cols, size_t n, std::string& out) {
+    size_t types = 0;
+    for (size_t i = 0; i < n; ++i) types += varint_size(serial_type(cols[i]));
+    size_t hdr = header_size(types);
+    // Size first so the buffer is grown at most once, then written in place.
+    out.resize(row_size(cols, n));
+    auto* h = reinterpret_cast<uint8_t*>(out.data());
+    uint8_t* b = h + hdr;
+    h += encode_varint(hdr, h);
+    for (size_t i = 0; i < n; ++i) {
+        const Value& v = cols[i];
+        uint64_t t = serial_type(v);
+        h += encode_varint(t, h);
+        if (t <= 6) {
+            write_le(b, zigzag_encode(v.i), INT_WIDTH[t]);
+            b += INT_WIDTH[t];
+        } else if (t == ST_REAL) {
+            uint64_t bits;
+            std::memcpy(&bits, &v.r, sizeof bits);
+            write_le(b, bits, 8);
+            b += 8;
+        } else if (t >= ST_BLOB) {
+            std::string_view bytes = v.text();
+            std::memcpy(b, bytes.data(), bytes.size());
+            b += bytes.size();
         }
     }
-    return out;
+}
+
+std::vector<uint8_t> encode_row(const std::vector<Value>& cols) {
+    std::string buf;
+    encode_row(cols.data(), cols.size(), buf);
+    return std::vector<uint8_t>(buf.begin(), buf.end());
 }
 
 std::vector<Value> decode_row(const uint8_t* p, size_t n) {
     std::vector<Value> cols;
-    auto [cnt, used] = decode_varint(p, n);
-    size_t off = used;
-    for (size_t i = 0; i < cnt && off < n; ++i) {
-        Value v;
-        v.tag = static_cast<ColTag>(p[off++]);
-        if (v.tag == ColTag::INT) {
-            auto [ival, u2] = decode_varint(p + off, n - off);
-            v.i = static_cast<int64_t>(ival);
-            off += u2;
-        } else {
-            auto [len, u2] = decode_varint(p + off, n - off);
-            off += u2;
-            v.s.assign(reinterpret_cast<const char*>(p + off), static_cast<size_t>(len));
-            off += static_cast<size_t>(len);
-        }
-        cols.push_back(std::move(v));
+    RowDecoder dec;
+    dec.reset(p, n);
+    cols.reserve(dec.columns());
+    Value v;
+    for (size_t i = 0; i < dec.columns() && dec.get(i, v); ++i) {
+        v.s.assign(v.text());
+        v.ref = {};
+        cols.push_back(v);
     }
     return cols;
 }
 
-} // namespace tinydb
+void RowDecoder::reset(const uint8_t* p, size_t n) {
+    p_ = p;
+    n_ = n;
+    types_.clear();
+    off_.clear();
+    ncols_ = need_ = 0;
+    auto [hdr, used] = decode_varint(p, n);
+    hdr_ = static_cast<size_t>(hdr);
+    next_ = used;
+    truncated_ = used == 0 || (p[used - 1] & 0x80) != 0 || hdr_ > n || hdr_ < used;
+    if (truncated_) {
+        need_ = used && hdr_ > n && (p[used - 1] & 0x80) == 0 ? hdr_ : SIZE_MAX;
+        return;
+    }
+    // Every serial type ends in the one byte with the top bit clear.
+    for (size_t i = used; i < hdr_; ++i) ncols_ += (p[i] & 0x80) == 0;
+    off_.push_back(static_cast<uint32_t>(hdr_));
+}
+
+// Extend the index until it holds the serial type and body offset of
+// column `col` and the end of its body.
+bool RowDecoder::index_to(size_t col) {
+    while (types_.size() <= col) {
+        auto [t, used] = decode_varint(p_ + next_, hdr_ - next_);
+        size_t end = off_.back() + body_size(t);
+        if (end > n_) { need_ = end; return false; }
+        next_ += used;
+        types_.push_back(t);
+        off_.push_back(static_cast<uint32_t>(end));
+    }
+    return true;
+}
+
+bool RowDecoder::get(size_t col, Value& out) {
+    if (truncated_) return false;
+    out.s.clear();
+    if (col >= ncols_) {
+        out.tag = ColTag::INT;
+        out.i = 0;
+        out.r = 0.0;
+        out.ref = {};
+        return true;
+    }
+    if (!index_to(col)) return false;
+    decode_body(types_[col], p_ + off_[col], out.tag, out.i, out.r, out.ref);
+    return true;
+}
 
+size_t row_columns(const uint8_t* p, size_t n) {
+    RowDecoder dec;
+    dec.reset(p, n);
+    return dec.need() ? SIZE_MAX : dec.columns();
+}
+
+bool decode_columns(const uint8_t* p, size_t n, size_t ncols, const ColumnSink& out) {
+    auto [hdr, used] = decode_varint(p, n);
+    if (used == 0 || (p[used - 1] & 0x80) != 0 || hdr > n || hdr < used) return false;
+    // One pass over header and body together; no per-column index kept.
+    size_t h = used, off = static_cast<size_t>(hdr);
+    for (size_t col = 0, at = 0; col < ncols; ++col, at += out.stride) {
+        uint64_t t = ST_ZERO; // columns past the row's end read as INT 0
+        if (h < hdr) {
+            auto [v, u] = decode_varint(p + h, static_cast<size_t>(hdr) - h);
+            t = v;
+            h += u;
+        }
+        size_t w = body_size(t);
+        if (w > n - off) return false;
+        decode_body(t, p + off, out.tag[at], out.i[at], out.r[at], out.text[at]);
+        off += w;
+    }
+    return true;
+}
+
+} // namespace tinydb
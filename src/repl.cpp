@@ -7,35 +7,194 @@
 #include "tinydb/storage.hpp"
 #include "tinydb/pager.hpp"
 #include "tinydb/btree.hpp"
+#include "tinydb/statement.hpp"
 #include <cctype>
+#include <cstdio>
+#include <fstream>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 using namespace tinydb;
 
-extern "C" int tinydb_process_line(const std::string& line, std::string& out) {
+namespace {
+
+std::string trim(const std::string& s) {
+    size_t b = 0, e = s.size();
+    while (b < e && std::isspace(static_cast<unsigned char>(s[b]))) ++b;
+    while (e > b && std::isspace(static_cast<unsigned char>(s[e - 1]))) --e;
+    return s.substr(b, e - b);
+}
+
+// Shell text for one result column; NULL prints as nothing.
+void append_value(std::string& out, const Value& v) {
+    switch (v.tag) {
+    case ColTag::INT: out += std::to_string(v.i); break;
+    case ColTag::NIL: break;
+    case ColTag::REAL: {
+        char buf[32];
+        int n = std::snprintf(buf, sizeof buf, "%.15g", v.r);
+        out.append(buf, static_cast<size_t>(n));
+        if (std::string_view(buf, n).find_first_of(".en") == std::string_view::npos) out += ".0";
+        break;
+    }
+    default: out += v.text();
+    }
+}
+
+// One CSV line -> row values: integers stay INT, anything else (with
+// optional surrounding quotes stripped) becomes TEXT.
+std::vector<Value> parse_csv_row(const std::string& line) {
+    std::vector<Value> row;
+    size_t start = 0;
+    while (true) {
+        size_t comma = line.find(',', start);
+        std::string field = trim(line.substr(start, comma == std::string::npos ? std::string::npos : comma - start));
+        Value v;
+        size_t digits = (!field.empty() && field[0] == '-') ? 1 : 0;
+        bool is_int = field.size() > digits && field.size() - digits <= 18;
+        for (size_t i = digits; i < field.size() && is_int; ++i)
+            is_int = std::isdigit(static_cast<unsigned char>(field[i])) != 0;
+        if (is_int) {
+            v.i = std::stoll(field);
+        } else {
+            if (field.size() >= 2 && (field.front() == '\'' || field.front() == '"') &&
+                field.back() == field.front())
+                field = field.substr(1, field.size() - 2);
+            v.tag = ColTag::TEXT;
+            v.s = std::move(field);
+        }
+        row.push_back(std::move(v));
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    return row;
+}
+
+// .import FILE TABLE: rows get consecutive rowids after the table's
+// current maximum. An empty table is built bottom-up in one pass.
+void import_csv(const std::string& args, BTree& bt, Catalog& cat, std::string& out) {
+    std::string rest = trim(args);
+    size_t sp = rest.find_last_of(" \t");
+    if (sp == std::string::npos) { out += "usage: .import FILE TABLE\n"; return; }
+    std::string path = trim(rest.substr(0, sp));
+    const TableInfo* ti = cat.lookup(trim(rest.substr(sp + 1)));
+    if (!ti) { out += "no such table\n"; return; }
+    std::ifstream in(path);
+    if (!in) { out += "cannot open " + path + "\n"; return; }
+    Cursor c = bt.open(ti->root);
+    int64_t rowid = bt.last(c) ? bt.key(c) : 0;
+    std::string line;
+    std::vector<std::string> entries(ti->indexes.size());
+    std::vector<Value> vals;
+    // Entry x of the row read as rowid `id` into entries[x]; false if it
+    // is too long to store.
+    auto make_entries = [&](const std::vector<Value>& row, int64_t id) {
+        for (size_t x = 0; x < entries.size(); ++x) {
+            const IndexInfo& ix = ti->indexes[x];
+            vals.assign(ix.cols.size(), Value{});
+            for (size_t j = 0; j < ix.cols.size(); ++j)
+                if (static_cast<size_t>(ix.cols[j]) < row.size()) vals[j] = row[ix.cols[j]];
+            entries[x].clear();
+            for (auto& v : vals) append_key(v, entries[x]);
+            finish_key(vals.data(), vals.size(), id, entries[x]);
+            if (entries[x].size() > MAX_INDEX_KEY) return false;
+        }
+        return true;
+    };
+    // The import is all or nothing: a first pass makes sure every index
+    // entry can be stored before any row is added.
+    if (!entries.empty()) {
+        int64_t id = rowid;
+        while (std::getline(in, line)) {
+            if (trim(line).empty()) continue;
+            if (!make_entries(parse_csv_row(line), ++id)) { out += "index key too long\n"; return; }
+        }
+        in.clear();
+        in.seekg(0);
+    }
+    // Index entries go in as each row is read.
+    auto next_row = [&](Key& k, std::string& payload) {
+        while (std::getline(in, line)) {
+            if (trim(line).empty()) continue;
+            auto row = parse_csv_row(line);
+            make_entries(row, rowid + 1);
+            for (size_t x = 0; x < entries.size(); ++x) bt.index_insert(ti->indexes[x].root, entries[x]);
+            k.rowid = ++rowid;
+            encode_row(row.data(), row.size(), payload);
+            return true;
+        }
+        return false;
+    };
+    if (!bt.bulk_load(ti->root, next_row)) {
+        Key k;
+        std::string payload;
+        while (next_row(k, payload)) bt.insert(ti->root, k, payload);
+    }
+    out += "ok\n";
+}
+
+constexpr size_t STREAM_CHUNK = 4096; // bytes of rows handed to emit at once
+
+int process_line(const std::string& line, std::string& out, tinydb_output_fn emit, void* ctx) {
     static std::unique_ptr<Pager> pager;
     static std::unique_ptr<BTree> btree;
     static std::unique_ptr<Catalog> catalog;
     static VM vm;
+    static StatementCache stmts;
 
     if (line.empty()) return 0;
     if (line[0] == '.') {
         if (line.rfind(".open", 0) == 0) {
-            std::string path = line.substr(5);
-            while (!path.empty() && std::isspace(static_cast<unsigned char>(path.front()))) {
-                path.erase(path.begin());
+            // .open [--mmap] [--no-wal] PATH; commits go to PATH-wal by default
+            std::string path = trim(line.substr(5));
+            bool use_mmap = false, use_wal = true;
+            while (path.rfind("--", 0) == 0) {
+                size_t sp = path.find_first_of(" \t");
+                std::string flag = path.substr(0, sp);
+                if (flag == "--mmap") use_mmap = true;
+                else if (flag == "--no-wal") use_wal = false;
+                else { out += "unknown option " + flag + "\n"; return 0; }
+                path = sp == std::string::npos ? std::string() : trim(path.substr(sp));
             }
-            pager = std::make_unique<Pager>(std::make_unique<FileStorage>(path));
+            std::unique_ptr<IStorage> storage;
+            if (use_mmap) storage = std::make_unique<MmapStorage>(path);
+            else storage = std::make_unique<FileStorage>(path);
+            std::unique_ptr<IStorage> wal;
+            if (use_wal) wal = std::make_unique<FileStorage>(path + "-wal");
+            stmts.clear();
+            catalog.reset();
+            btree.reset();
+            pager.reset();
+            pager = std::make_unique<Pager>(std::move(storage), DEFAULT_POOL_FRAMES, std::move(wal));
             btree = std::make_unique<BTree>(*pager);
             catalog = std::make_unique<Catalog>(*pager, *btree);
             vm.set_env(*btree, *catalog);
+        } else if (line == ".checkpoint") {
+            if (!pager) { out += "no db\n"; return 0; }
+            pager->checkpoint();
         } else if (line == ".schema") {
             if (!catalog) { out += "no db\n"; return 0; }
             for (auto& kv : catalog->tables()) {
                 out += kv.second.name;
                 out += '\n';
             }
+        } else if (line.rfind(".import", 0) == 0) {
+            if (!catalog) { out += "no db\n"; return 0; }
+            import_csv(line.substr(7), *btree, *catalog, out);
+            if (!pager->in_transaction()) pager->flush();
+        } else if (line.rfind(".sortmem", 0) == 0) {
+            // .sortmem BYTES: memory a sort may use before it spills runs
+            // to temporary files, at least MIN_SORT_MEMORY
+            std::string arg = trim(line.substr(8));
+            if (arg.empty() || arg.size() > 18 || arg.find_first_not_of("0123456789") != std::string::npos) {
+                out += "usage: .sortmem BYTES\n";
+                return 0;
+            }
+            size_t bytes = std::stoull(arg);
+            if (bytes < MIN_SORT_MEMORY) out += "using the minimum, " + std::to_string(MIN_SORT_MEMORY) + "\n";
+            vm.set_sort_memory(bytes);
         } else if (line == ".quit" || line == ".exit") {
             return 1;
         } else {
@@ -44,26 +203,61 @@ extern "C" int tinydb_process_line(const std::string& line, std::string& out) {
         return 0;
     }
     if (!catalog) { out += "no database open\n"; return 0; }
-    auto ast = parse(line);
-    if (!ast) { out += "parse error\n"; return 0; }
-    if (auto c = dynamic_cast<ASTCreate*>(ast.get())) {
-        catalog->create_table(c->table);
-        if (pager) pager->flush();
-        out += "ok\n";
-        return 0;
+    // Repeated statements come straight from the cache, already compiled.
+    Statement* st = stmts.find(line, *catalog);
+    if (!st) {
+        auto ast = parse(line);
+        if (!ast) { out += "parse error\n"; return 0; }
+        // Outside BEGIN ... COMMIT every statement commits on its own.
+        if (auto c = dynamic_cast<ASTCreate*>(ast.get())) {
+            std::vector<std::string> cols;
+            for (auto& col : c->cols) cols.push_back(col.first);
+            catalog->create_table(c->table, cols);
+            if (pager && !pager->in_transaction()) pager->flush();
+            out += "ok\n";
+            return 0;
+        }
+        if (auto c = dynamic_cast<ASTCreateIndex*>(ast.get())) {
+            bool ok = catalog->create_index(c->name, c->table, c->cols) != 0;
+            if (pager && !pager->in_transaction()) pager->flush();
+            out += ok ? "ok\n" : "index error\n";
+            return 0;
+        }
+        st = stmts.insert(line, Statement::prepare(*ast, *catalog));
     }
-    auto prog = codegen(*ast, *catalog);
-    vm.run(prog);
-    if (pager) pager->flush();
-    if (dynamic_cast<ASTSelect*>(ast.get())) {
-        for (auto& row : vm.results()) {
-            for (size_t i = 0; i < row.size(); ++i) {
-                if (i) out.push_back('|');
-                if (row[i].tag == ColTag::INT) out += std::to_string(row[i].i);
-                else out += row[i].s;
-            }
-            out.push_back('\n');
+    // Rows are formatted as the VM produces them, never all held at once.
+    auto rc = st->step(vm);
+    for (; rc == Statement::Step::Row; rc = st->step(vm)) {
+        if (!st->is_query()) continue;
+        const auto& row = st->row();
+        for (size_t i = 0; i < row.size(); ++i) {
+            if (i) out.push_back('|');
+            append_value(out, row[i]);
         }
+        out.push_back('\n');
+        if (emit && out.size() >= STREAM_CHUNK) {
+            emit(out.data(), out.size(), ctx);
+            out.clear();
+        }
+    }
+    if (rc == Statement::Step::Error && st->is_transaction()) {
+        out += "transaction error\n";
+        return 0;
     }
+    if (rc == Statement::Step::Error) out += "error\n";
+    if (pager && !pager->in_transaction()) pager->flush();
     return 0;
 }
+
+} // namespace
+
+extern "C" int tinydb_process_line(const std::string& line, std::string& out) {
+    return process_line(line, out, nullptr, nullptr);
+}
+
+extern "C" int tinydb_process_line_stream(const std::string& line, tinydb_output_fn emit, void* ctx) {
+    std::string out;
+    int rc = process_line(line, out, emit, ctx);
+    if (!out.empty()) emit(out.data(), out.size(), ctx);
+    return rc;
+}
@@ -0,0 +1,267 @@
+#include "tinydb/sorter.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace tinydb {
+
+namespace {
+
+// Bytes a run reader fetches at a time, and a merge pass writes at a
+// time; the merge fan-in is the budget divided by this, less the output.
+constexpr size_t READ_AHEAD = 64 * 1024;
+constexpr size_t REC_HDR = 8;
+static_assert(MIN_SORT_MEMORY >= 4 * READ_AHEAD);
+
+// Runs never outlive the process, so lengths are stored in native order.
+uint32_t load32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+size_t record_size(const char* rec) {
+    return REC_HDR + load32(rec) + load32(rec + 4);
+}
+
+void append_record(std::string& out, std::string_view key, uint64_t seq, std::string_view row) {
+    auto klen = static_cast<uint32_t>(key.size() + 8), rlen = static_cast<uint32_t>(row.size());
+    size_t at = out.size();
+    out.resize(at + REC_HDR);
+    std::memcpy(&out[at], &klen, 4);
+    std::memcpy(&out[at + 4], &rlen, 4);
+    out.append(key);
+    // Big-endian, so that equal keys order by the sequence number.
+    for (int b = 7; b >= 0; --b) out.push_back(static_cast<char>(seq >> (8 * b)));
+    out.append(row);
+}
+
+bool heap_less(const std::string& a, const std::string& b) {
+    return std::string_view(a.data() + REC_HDR, load32(a.data())) <
+           std::string_view(b.data() + REC_HDR, load32(b.data()));
+}
+
+} // namespace
+
+Sorter::Sorter() : make_temp_(make_temp_storage) {}
+
+std::string_view Sorter::key_of(const char* rec) {
+    return {rec + REC_HDR, load32(rec)};
+}
+
+void Sorter::reset(size_t limit) {
+    limit_ = limit;
+    seq_ = 0;
+    emitted_ = 0;
+    heap_.clear();
+    heap_bytes_ = 0;
+    use_heap_ = limit != SIZE_MAX;
+    buf_.clear();
+    recs_.clear();
+    pos_ = 0;
+    temp_.reset();
+    temp_end_ = 0;
+    runs_.clear();
+    readers_.clear();
+    merge_.clear();
+}
+
+void Sorter::add(std::string_view key, std::string_view row) {
+    if (limit_ == 0) return;
+    if (use_heap_) {
+        rec_.clear();
+        append_record(rec_, key, seq_++, row);
+        push_heap(rec_);
+        return;
+    }
+    make_room(REC_HDR + key.size() + 8 + row.size());
+    append_record(buf_, key, seq_++, row);
+}
+
+// Note where the next record, of `size` bytes, goes in buf_, writing the
+// records there to a run first if it would take them past the budget.
+// The buffer doubles as strings do, but never past the budget either.
+void Sorter::make_room(size_t size) {
+    if (!recs_.empty() && buf_.size() + size + (recs_.size() + 1) * sizeof(size_t) > memory_) spill();
+    size_t need = buf_.size() + size;
+    if (need > buf_.capacity()) {
+        std::string grown;
+        grown.reserve(std::max(need, std::min(2 * buf_.capacity(), memory_)));
+        grown.append(buf_);
+        buf_.swap(grown);
+    }
+    recs_.push_back(buf_.size());
+}
+
+void Sorter::push_heap(std::string_view rec) {
+    if (heap_.size() == limit_) {
+        // Full: a record not below the largest one kept is never output.
+        if (!(key_of(rec.data()) < key_of(heap_.front().data()))) return;
+        std::pop_heap(heap_.begin(), heap_.end(), heap_less);
+        heap_bytes_ -= heap_.back().size() + sizeof(std::string);
+        heap_.back().assign(rec);
+    } else {
+        heap_.emplace_back(rec);
+    }
+    heap_bytes_ += rec.size() + sizeof(std::string);
+    std::push_heap(heap_.begin(), heap_.end(), heap_less);
+    if (heap_bytes_ <= memory_) return;
+    // A limit too large to hold: sort everything, and stop at the limit
+    // on the way out instead.
+    for (auto& r : heap_) {
+        make_room(r.size());
+        buf_.append(r);
+        std::string().swap(r);
+    }
+    std::vector<std::string>().swap(heap_);
+    heap_bytes_ = 0;
+    use_heap_ = false;
+}
+
+void Sorter::spill() {
+    const char* base = buf_.data();
+    std::sort(recs_.begin(), recs_.end(),
+              [base](size_t a, size_t b) { return key_of(base + a) < key_of(base + b); });
+    std::vector<std::string_view> recs;
+    recs.reserve(recs_.size());
+    for (size_t off : recs_) recs.emplace_back(base + off, record_size(base + off));
+    write_run(recs);
+    buf_.clear();
+    recs_.clear();
+}
+
+void Sorter::write_run(const std::vector<std::string_view>& recs) {
+    if (!temp_) temp_ = make_temp_();
+    std::vector<IoSlice> v;
+    v.reserve(recs.size());
+    Run run{temp_end_, 0};
+    for (auto r : recs) {
+        v.push_back({r.data(), r.size()});
+        run.len += r.size();
+    }
+    temp_->writev(run.off, v.data(), v.size());
+    temp_end_ += run.len;
+    runs_.push_back(run);
+    ++spilled_;
+}
+
+bool Sorter::advance(Reader& r) {
+    r.pos += r.len;
+    r.len = 0;
+    auto fill = [&](size_t need) {
+        if (r.buf.size() - r.pos >= need) return true;
+        r.buf.erase(0, r.pos);
+        r.pos = 0;
+        // Topped up to READ_AHEAD, so the buffer keeps its first size
+        // unless a record is longer.
+        size_t want = std::max(need, READ_AHEAD) - r.buf.size();
+        want = static_cast<size_t>(std::min<uint64_t>(want, r.end - r.off));
+        if (r.buf.size() + want < need) return false;
+        size_t have = r.buf.size();
+        r.buf.resize(have + want);
+        temp_->read(r.off, &r.buf[have], want);
+        r.off += want;
+        return true;
+    };
+    if (!fill(REC_HDR)) return false;
+    size_t need = record_size(r.buf.data() + r.pos);
+    if (!fill(need)) return false;
+    r.len = need;
+    return true;
+}
+
+size_t Sorter::fan_in() const {
+    return std::max<size_t>(2, memory_ / READ_AHEAD - 1);
+}
+
+// Readers on runs [first, first + n), the merge heap on those not empty.
+void Sorter::open_readers(size_t first, size_t n) {
+    readers_.assign(n, Reader{});
+    merge_.clear();
+    for (size_t i = 0; i < n; ++i) {
+        readers_[i].off = runs_[first + i].off;
+        readers_[i].end = runs_[first + i].off + runs_[first + i].len;
+        if (advance(readers_[i])) merge_.push_back(i);
+    }
+    std::make_heap(merge_.begin(), merge_.end(),
+                   [this](size_t a, size_t b) { return reader_key(a) > reader_key(b); });
+}
+
+std::string_view Sorter::reader_key(size_t i) const {
+    return key_of(readers_[i].buf.data() + readers_[i].pos);
+}
+
+// Move past the smallest record of the merge.
+void Sorter::step_merge() {
+    auto greater = [this](size_t a, size_t b) { return reader_key(a) > reader_key(b); };
+    std::pop_heap(merge_.begin(), merge_.end(), greater);
+    if (advance(readers_[merge_.back()])) std::push_heap(merge_.begin(), merge_.end(), greater);
+    else merge_.pop_back();
+}
+
+bool Sorter::sort() {
+    emitted_ = 0;
+    if (use_heap_) {
+        // Served in place, smallest first.
+        std::sort_heap(heap_.begin(), heap_.end(), heap_less);
+        pos_ = 0;
+        return !heap_.empty();
+    }
+    if (runs_.empty()) {
+        const char* base = buf_.data();
+        std::sort(recs_.begin(), recs_.end(),
+                  [base](size_t a, size_t b) { return key_of(base + a) < key_of(base + b); });
+        pos_ = 0;
+        return !recs_.empty();
+    }
+    if (!recs_.empty()) spill();
+    // The readers take the budget from here on.
+    std::string().swap(buf_);
+    std::vector<size_t>().swap(recs_);
+    // Merge the oldest runs into one until the rest can be merged at once.
+    std::string out;
+    out.reserve(READ_AHEAD);
+    while (runs_.size() > fan_in()) {
+        size_t n = fan_in();
+        open_readers(0, n);
+        Run run{temp_end_, 0};
+        auto write_out = [&] {
+            temp_->write(run.off + run.len, out.data(), out.size());
+            run.len += out.size();
+            out.clear();
+        };
+        while (!merge_.empty()) {
+            const Reader& r = readers_[merge_.front()];
+            if (!out.empty() && out.size() + r.len > READ_AHEAD) write_out();
+            out.append(r.buf, r.pos, r.len);
+            step_merge();
+        }
+        if (!out.empty()) write_out();
+        temp_end_ += run.len;
+        runs_.erase(runs_.begin(), runs_.begin() + static_cast<std::ptrdiff_t>(n));
+        runs_.push_back(run);
+    }
+    open_readers(0, runs_.size());
+    return !merge_.empty();
+}
+
+bool Sorter::next() {
+    if (++emitted_ >= limit_) return false;
+    if (use_heap_) return ++pos_ < heap_.size();
+    if (runs_.empty()) return ++pos_ < recs_.size();
+    step_merge();
+    return !merge_.empty();
+}
+
+const char* Sorter::current() const {
+    if (use_heap_) return heap_[pos_].data();
+    if (runs_.empty()) return buf_.data() + recs_[pos_];
+    const Reader& r = readers_[merge_.front()];
+    return r.buf.data() + r.pos;
+}
+
+std::string_view Sorter::row() const {
+    const char* rec = current();
+    return {rec + REC_HDR + load32(rec), load32(rec + 4)};
+}
+
+} // namespace tinydb
@@ -0,0 +1,103 @@
+#include "tinydb/statement.hpp"
+#include "tinydb/codegen.hpp"
+#include <algorithm>
+
+namespace tinydb {
+
+std::unique_ptr<Statement> Statement::prepare(const std::string& sql, const Catalog& cat) {
+    auto ast = parse(sql);
+    if (!ast) return nullptr;
+    return prepare(*ast, cat);
+}
+
+std::unique_ptr<Statement> Statement::prepare(const ASTNode& ast, const Catalog& cat) {
+    if (dynamic_cast<const ASTCreate*>(&ast) || dynamic_cast<const ASTCreateIndex*>(&ast)) return nullptr;
+    std::unique_ptr<Statement> st(new Statement());
+    st->prog_ = codegen(ast, cat);
+    st->names_ = ast.params;
+    st->params_.assign(ast.params.size(), Value{ColTag::NIL, 0, {}});
+    st->version_ = cat.version();
+    st->query_ = dynamic_cast<const ASTSelect*>(&ast) != nullptr;
+    st->txn_ = dynamic_cast<const ASTTransaction*>(&ast) != nullptr;
+    return st;
+}
+
+int Statement::param_index(std::string_view name) const {
+    if (name.empty()) return 0;
+    auto it = std::find(names_.begin(), names_.end(), name);
+    return it == names_.end() ? 0 : static_cast<int>(it - names_.begin()) + 1;
+}
+
+bool Statement::bind(int idx, Value v) {
+    if (idx < 1 || static_cast<size_t>(idx) > params_.size()) return false;
+    reset(); // the paused run may be borrowing the old value
+    // Own the bytes: a borrowed view could dangle before the next step.
+    if (!v.ref.empty()) {
+        v.s.assign(v.ref);
+        v.ref = {};
+    }
+    params_[idx - 1] = std::move(v);
+    return true;
+}
+
+void Statement::clear_bindings() {
+    reset();
+    for (auto& v : params_) v = Value{ColTag::NIL, 0, {}};
+}
+
+Statement::Step Statement::step(VM& vm) {
+    if (!ran_) {
+        vm_ = &vm;
+        vm.start(prog_, &params_);
+        ran_ = true;
+        last_ = Step::Error; // if another program preempts this run
+    } else if (vm_ != &vm || !vm.running(prog_)) {
+        return last_;
+    }
+    Step r = vm.step();
+    if (r != Step::Row) last_ = r;
+    return r;
+}
+
+void Statement::reset() {
+    if (vm_ && vm_->running(prog_)) vm_->abort();
+    ran_ = false;
+}
+
+Statement* StatementCache::find(const std::string& sql, const Catalog& cat) {
+    auto it = map_.find(sql);
+    if (it == map_.end()) return nullptr;
+    Statement* st = it->second->second.get();
+    if (st->schema_version() != cat.version()) {
+        lru_.erase(it->second);
+        map_.erase(it);
+        return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    st->reset();
+    return st;
+}
+
+Statement* StatementCache::insert(const std::string& sql, std::unique_ptr<Statement> st) {
+    Statement* raw = st.get();
+    auto it = map_.find(sql);
+    if (it != map_.end()) {
+        it->second->second = std::move(st);
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return raw;
+    }
+    if (map_.size() >= capacity_) {
+        map_.erase(lru_.back().first);
+        lru_.pop_back();
+    }
+    lru_.emplace_front(sql, std::move(st));
+    map_[sql] = lru_.begin();
+    return raw;
+}
+
+void StatementCache::clear() {
+    map_.clear();
+    lru_.clear();
+}
+
+} // namespace tinydb
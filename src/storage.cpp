@@ -1,33 +1,160 @@
 #include "tinydb/storage.hpp"
+#include <algorithm>
 #include <cstring>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
 #include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 namespace tinydb {
 
+namespace {
+
+void pread_full(int fd, uint64_t off, void* buf, size_t n) {
+    uint8_t* p = static_cast<uint8_t*>(buf);
+    size_t done = 0;
+    while (done < n) {
+        ssize_t r = ::pread(fd, p + done, n - done, static_cast<off_t>(off + done));
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) throw std::runtime_error("read failed");
+        if (r == 0) break; // past end of file
+        done += static_cast<size_t>(r);
+    }
+    if (done < n) std::memset(p + done, 0, n - done);
+}
+
+void pwrite_full(int fd, uint64_t off, const void* buf, size_t n) {
+    const uint8_t* p = static_cast<const uint8_t*>(buf);
+    size_t done = 0;
+    while (done < n) {
+        ssize_t w = ::pwrite(fd, p + done, n - done, static_cast<off_t>(off + done));
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) throw std::runtime_error("write failed");
+        done += static_cast<size_t>(w);
+    }
+}
+
+// pwritev in IOV_MAX-sized batches, resuming after short writes.
+void pwritev_full(int fd, uint64_t off, const IoSlice* v, size_t cnt) {
+    std::vector<iovec> iov(cnt);
+    for (size_t i = 0; i < cnt; ++i)
+        iov[i] = iovec{const_cast<void*>(v[i].data), v[i].len};
+    size_t i = 0;
+    while (i < cnt) {
+        int batch = static_cast<int>(std::min<size_t>(cnt - i, IOV_MAX));
+        ssize_t w = ::pwritev(fd, &iov[i], batch, static_cast<off_t>(off));
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) throw std::runtime_error("write failed");
+        off += static_cast<uint64_t>(w);
+        size_t left = static_cast<size_t>(w);
+        while (i < cnt && left >= iov[i].iov_len) left -= iov[i++].iov_len;
+        if (left) {
+            iov[i].iov_base = static_cast<uint8_t*>(iov[i].iov_base) + left;
+            iov[i].iov_len -= left;
+        }
+    }
+}
+
+} // namespace
+
 FileStorage::FileStorage(const std::string& path) : path_(path) {
-    f_ = std::fopen(path.c_str(), "r+b");
-    if (!f_) f_ = std::fopen(path.c_str(), "w+b");
-    if (!f_) throw std::runtime_error("open failed");
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) throw std::runtime_error("open failed");
+}
+
+std::unique_ptr<IStorage> make_temp_storage() {
+    const char* dir = std::getenv("TMPDIR");
+    std::string path = std::string(dir && *dir ? dir : "/tmp") + "/tinydb-XXXXXX";
+    int fd = ::mkstemp(path.data());
+    if (fd < 0) throw std::runtime_error("temp file failed");
+    ::close(fd);
+    auto st = std::make_unique<FileStorage>(path);
+    ::unlink(path.c_str());
+    return st;
 }
 
 FileStorage::~FileStorage() {
-    if (f_) std::fclose(f_);
+    if (fd_ >= 0) ::close(fd_);
 }
 
 void FileStorage::read(uint64_t off, void* buf, size_t n) {
-    std::memset(buf, 0, n);
-    std::fseek(f_, static_cast<long>(off), SEEK_SET);
-    std::fread(buf, 1, n, f_);
+    pread_full(fd_, off, buf, n);
 }
 
 void FileStorage::write(uint64_t off, const void* buf, size_t n) {
-    std::fseek(f_, static_cast<long>(off), SEEK_SET);
-    std::fwrite(buf, 1, n, f_);
+    pwrite_full(fd_, off, buf, n);
+}
+
+void FileStorage::writev(uint64_t off, const IoSlice* v, size_t cnt) {
+    pwritev_full(fd_, off, v, cnt);
 }
 
 void FileStorage::sync() {
-    std::fflush(f_);
+    if (::fsync(fd_) != 0) throw std::runtime_error("fsync failed");
 }
 
-} // namespace tinydb
+MmapStorage::MmapStorage(const std::string& path) : path_(path) {
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd_ < 0) throw std::runtime_error("open failed");
+    struct stat st{};
+    if (::fstat(fd_, &st) != 0) { ::close(fd_); throw std::runtime_error("stat failed"); }
+    size_ = static_cast<uint64_t>(st.st_size);
+    remap(size_);
+}
+
+MmapStorage::~MmapStorage() {
+    if (map_) ::munmap(map_, map_len_);
+    for (auto& m : retired_) ::munmap(m.first, m.second);
+    if (fd_ >= 0) ::close(fd_);
+}
 
+void MmapStorage::remap(uint64_t need) {
+    // Reserve twice what is needed so appends rarely trigger a remap.
+    size_t len = 1u << 20;
+    while (len < need * 2) len <<= 1;
+    void* m = ::mmap(nullptr, len, PROT_READ, MAP_SHARED, fd_, 0);
+    if (m == MAP_FAILED) throw std::runtime_error("mmap failed");
+    if (map_) retired_.emplace_back(map_, map_len_);
+    map_ = static_cast<uint8_t*>(m);
+    map_len_ = len;
+}
+
+void MmapStorage::read(uint64_t off, void* buf, size_t n) {
+    size_t avail = off < size_ ? static_cast<size_t>(std::min<uint64_t>(n, size_ - off)) : 0;
+    if (avail) std::memcpy(buf, map_ + off, avail);
+    if (avail < n) std::memset(static_cast<uint8_t*>(buf) + avail, 0, n - avail);
+}
+
+void MmapStorage::write(uint64_t off, const void* buf, size_t n) {
+    pwrite_full(fd_, off, buf, n);
+    grown(off + n);
+}
+
+void MmapStorage::writev(uint64_t off, const IoSlice* v, size_t cnt) {
+    pwritev_full(fd_, off, v, cnt);
+    size_t n = 0;
+    for (size_t i = 0; i < cnt; ++i) n += v[i].len;
+    grown(off + n);
+}
+
+void MmapStorage::grown(uint64_t end) {
+    if (end <= size_) return;
+    size_ = end;
+    if (size_ > map_len_) remap(size_);
+}
+
+void MmapStorage::sync() {
+    if (::fsync(fd_) != 0) throw std::runtime_error("fsync failed");
+}
+
+const uint8_t* MmapStorage::view(uint64_t off, size_t n) {
+    if (off + n > size_) return nullptr;
+    return map_ + off;
+}
+
+} // namespace tinydb
@@ -3,18 +3,21 @@
 namespace tinydb {
 
 std::vector<uint8_t> encode_varint(uint64_t x) {
-    std::vector<uint8_t> out;
-    do {
-        uint8_t byte = x & 0x7F;
-        x >>= 7U;
-        if (x) byte |= 0x80;
-        out.push_back(byte);
-    } while (x);
+    std::vector<uint8_t> out(MAX_VARINT);
+    out.resize(encode_varint(x, out.data()));
     return out;
 }
 
-std::pair<uint64_t,size_t> decode_varint(const uint8_t* p, size_t n) {
+std::pair<uint64_t,size_t> decode_varint_slow(const uint8_t* p, size_t n) {
     uint64_t v = 0;
+    if (n >= MAX_VARINT) {
+        // Whole varint is in bounds: no length check per byte.
+        for (size_t i = 0; i < MAX_VARINT; ++i) {
+            v |= static_cast<uint64_t>(p[i] & 0x7F) << (7 * i);
+            if ((p[i] & 0x80) == 0) return {v, i + 1};
+        }
+        return {v, MAX_VARINT};
+    }
     size_t i = 0, shift = 0;
     while (i < n) {
         uint8_t b = p[i++];
@@ -26,4 +29,3 @@ std::pair<uint64_t,size_t> decode_varint(const uint8_t* p, size_t n) {
 }
 
 } // namespace tinydb
-
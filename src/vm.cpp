@@ -1,93 +1,668 @@
 #include "tinydb/vm.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <limits>
 
+// Threaded dispatch: each handler jumps straight to the next one through
+// a label table instead of returning to a switch, so the branch predictor
+// sees one indirect jump per opcode. Define TINYDB_NO_COMPUTED_GOTO to
+// fall back to the portable switch loop. Leaving a scope by computed goto
+// does not run destructors: handlers keep such locals in an inner block.
+#if defined(__GNUC__) && !defined(TINYDB_NO_COMPUTED_GOTO)
+#define TINYDB_COMPUTED_GOTO 1
+#else
+#define TINYDB_COMPUTED_GOTO 0
+#endif
+
 namespace tinydb {
 
-int VM::run(const std::vector<Instr>& prog) {
+namespace {
+
+// As `v = Value{}`, but keeping the string's capacity.
+void clear_value(Value& v) {
+    v.tag = ColTag::INT;
+    v.i = 0;
+    v.s.clear();
+    v.ref = {};
+    v.r = 0.0;
+}
+
+} // namespace
+
+const char* op_name(Op op) {
+    static const char* const names[] = {
+#define TINYDB_OP_NAME(name) #name,
+        TINYDB_OPS(TINYDB_OP_NAME)
+#undef TINYDB_OP_NAME
+    };
+    return names[static_cast<size_t>(op)];
+}
+
+int VM::run(const Program& prog, const std::vector<Value>* params) {
     results_.clear();
-    size_t pc = 0;
-    while (pc < prog.size()) {
-        const Instr& ins = prog[pc];
-        switch (ins.op) {
-        case Op::OpenRead:
-        case Op::OpenWrite: {
-            if (!btree_) return 1;
-            if (cursors_.size() <= static_cast<size_t>(ins.p1))
-                cursors_.resize(ins.p1 + 1);
-            cursors_[ins.p1] = btree_->open(static_cast<uint32_t>(ins.p2));
-            ++pc;
-            break;
+    start(prog, params);
+    StepResult r;
+    while ((r = step()) == StepResult::Row) {
+        // Rows borrow from registers and pages; own them to keep them.
+        std::vector<Value> out;
+        out.reserve(row_.size());
+        for (auto& v : row_) out.push_back(Value{v.tag, v.i, std::string(v.text()), {}, v.r});
+        results_.push_back(std::move(out));
+    }
+    return r == StepResult::Error ? 1 : 0;
+}
+
+void VM::start(const Program& prog, const std::vector<Value>* params) {
+    abort();
+    prog_ = &prog;
+    // Sized once per run; registers keep their string capacity across runs.
+    if (regs_.size() < static_cast<size_t>(prog.nregs)) regs_.resize(prog.nregs);
+    cursors_.resize(prog.ncursors);
+    rows_.resize(prog.ncursors);
+    params_ = params;
+    pc_ = 0;
+    // Whole-row reads clear only what the row before left behind, so
+    // nothing may be left over from the previous run.
+    for (auto& r : regs_) clear_value(r);
+    last_row_cols_ = 0;
+}
+
+void VM::abort() {
+    // Cursors pin leaves; release them before the pager can go away.
+    cursors_.clear();
+    rows_.clear();
+    batch_.clear();
+    sorter_.reset(); // and its temporary storage
+    prog_ = nullptr;
+    params_ = nullptr;
+}
+
+StepResult VM::step() {
+    if (!prog_) return StepResult::Done;
+    StepResult r = exec();
+    if (r != StepResult::Row) abort();
+    return r;
+}
+
+#if TINYDB_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+StepResult VM::exec() {
+    const Instr* const code = prog_->code.data();
+    const Instr* ip = code + pc_;
+    Value* const regs = regs_.data();
+#if TINYDB_COMPUTED_GOTO
+    static const void* const labels[] = {
+#define TINYDB_OP_LABEL(name) &&op_##name,
+        TINYDB_OPS(TINYDB_OP_LABEL)
+#undef TINYDB_OP_LABEL
+    };
+#define CASE(name) op_##name:
+#define DISPATCH() goto *labels[static_cast<size_t>(ip->op)]
+    DISPATCH();
+#else
+#define CASE(name) case Op::name:
+#define DISPATCH() continue
+    for (;;) switch (ip->op) {
+#endif
+// Not do/while(0): `continue` must reach the switch loop.
+#define NEXT() { ++ip; DISPATCH(); }
+#define JUMP(target) { ip = code + (target); DISPATCH(); }
+
+    CASE(OpenRead)
+    CASE(OpenWrite) {
+        if (!btree_) return StepResult::Error;
+        cursors_[ip->p1] = btree_->open(static_cast<uint32_t>(ip->p2));
+        rows_[ip->p1].valid = false;
+        rows_[ip->p1].key_cols = static_cast<size_t>(ip->p3);
+        NEXT();
+    }
+    CASE(Rewind) {
+        auto& c = cursors_[ip->p1];
+        rows_[ip->p1].valid = false;
+        btree_->seek(c, std::numeric_limits<int64_t>::min());
+        if (btree_->payload_size(c) == 0) JUMP(ip->p2);
+        NEXT();
+    }
+    CASE(SeekGE) {
+        // Land on the first key >= reg p3; jump to p2 if there is none.
+        auto& c = cursors_[ip->p1];
+        rows_[ip->p1].valid = false;
+        btree_->seek(c, regs[ip->p3].i);
+        if (!btree_->valid(c)) JUMP(ip->p2);
+        NEXT();
+    }
+    CASE(Next) {
+        auto& c = cursors_[ip->p1];
+        rows_[ip->p1].valid = false;
+        if (btree_->next(c)) JUMP(ip->p2);
+        NEXT();
+    }
+    CASE(Column) {
+        auto& c = cursors_[ip->p1];
+        RowCache& row = rows_[ip->p1];
+        if (!row.valid) {
+            // Index the in-leaf bytes first so overflow pages holding
+            // later columns are only read if one of those is asked for.
+            std::string_view local = btree_->local_payload(c);
+            row.dec.reset(reinterpret_cast<const uint8_t*>(local.data()), local.size());
+            row.full = local.size() == btree_->payload_size(c);
+            row.valid = true;
         }
-        case Op::Rewind: {
-            auto& c = cursors_[ins.p1];
-            btree_->seek(c, std::numeric_limits<int64_t>::min());
+        auto fetch_all = [&] {
             std::string_view payload = btree_->read_payload(c);
-            if (payload.empty()) pc = static_cast<size_t>(ins.p2); else ++pc;
-            break;
+            row.dec.reset(reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+            row.full = true;
+        };
+        if (ip->p2 >= 0) {
+            auto col = static_cast<size_t>(ip->p2);
+            if (!row.dec.get(col, regs[ip->p3]) && !row.full) {
+                fetch_all();
+                row.dec.get(col, regs[ip->p3]);
+            }
+            NEXT();
         }
-        case Op::SeekGE: {
-            auto& c = cursors_[ins.p1];
-            int64_t key = 0;
-            if (static_cast<size_t>(ins.p3) < regs_.size()) key = regs_[ins.p3].i;
-            bool found = btree_->seek(c, key);
-            if (!found) pc = static_cast<size_t>(ins.p2); else ++pc;
-            break;
+        if (!row.full) fetch_all();
+        // Whole row into registers p3.. (columns past its end read as the
+        // default value). Only a row wider than its table's declared
+        // columns can outgrow the register file.
+        auto base = static_cast<size_t>(ip->p3);
+        size_t n = row.dec.columns();
+        if (regs_.size() < base + n) {
+            regs_.resize(base + n);
+            pc_ = static_cast<size_t>(ip - code);
+            return exec(); // re-enter with the moved register file
         }
-        case Op::Next: {
-            auto& c = cursors_[ins.p1];
-            bool ok = btree_->next(c);
-            if (ok) pc = static_cast<size_t>(ins.p2); else ++pc;
-            break;
+        size_t prev = last_row_cols_;
+        last_row_cols_ = 0;
+        while (last_row_cols_ < n && row.dec.get(last_row_cols_, regs[base + last_row_cols_]))
+            ++last_row_cols_;
+        // Past this row's end only the previous, wider row left values.
+        for (size_t i = base + last_row_cols_; i < base + prev; ++i) clear_value(regs[i]);
+        NEXT();
+    }
+    CASE(BatchLoad) {
+        // Decode p2 columns (-1: all) of the rest of cursor p1's leaf into
+        // the batch, leaving the cursor on its last row.
+        rows_[ip->p1].valid = false;
+        batch_.load(*btree_, cursors_[ip->p1], ip->p2 < 0 ? Batch::ALL : static_cast<size_t>(ip->p2));
+        batch_pos_ = 0;
+        NEXT();
+    }
+    CASE(BatchMove) {
+        // Copy batch column p1 to column p2, e.g. to line up a projection.
+        batch_.copy_column(static_cast<size_t>(ip->p1), static_cast<size_t>(ip->p2));
+        NEXT();
+    }
+    CASE(BatchResult) {
+        // Yield batch columns p1.. (p2 of them, 0: the row's width) of
+        // each batch row in turn, then fall through. Like ResultRow the
+        // row is borrowed until the next step.
+        if (batch_pos_ == batch_.rows()) NEXT();
+        size_t k = batch_pos_++;
+        auto first = static_cast<size_t>(ip->p1);
+        size_t n = ip->p2 == 0 ? batch_.width(k) - first : static_cast<size_t>(ip->p2);
+        row_.resize(n);
+        for (size_t i = 0; i < n; ++i) batch_.get(first + i, k, row_[i]);
+        pc_ = static_cast<size_t>(ip - code); // resume on this instruction
+        return StepResult::Row;
+    }
+    CASE(Integer) {
+        Value& dst = regs[ip->p2];
+        dst.tag = ColTag::INT;
+        dst.i = ip->p1;
+        dst.s.clear();
+        dst.ref = {};
+        NEXT();
+    }
+    CASE(Constant) {
+        // consts[p1] into reg p2, TEXT and BLOB borrowed from the program.
+        const Value& v = prog_->consts[ip->p1];
+        Value& dst = regs[ip->p2];
+        dst.tag = v.tag;
+        dst.i = v.i;
+        dst.r = v.r;
+        dst.s.clear();
+        dst.ref = v.text();
+        NEXT();
+    }
+    CASE(Null) {
+        Value& dst = regs[ip->p2];
+        dst.tag = ColTag::NIL;
+        dst.s.clear();
+        dst.ref = {};
+        NEXT();
+    }
+    CASE(Variable) {
+        // Bound parameter p1 (1-based; NULL if unbound) into reg p2.
+        // TEXT and BLOB are borrowed: bindings outlive the run.
+        Value& dst = regs[ip->p2];
+        auto idx = static_cast<size_t>(ip->p1);
+        if (params_ && idx >= 1 && idx <= params_->size()) {
+            const Value& v = (*params_)[idx - 1];
+            dst.tag = v.tag;
+            dst.i = v.i;
+            dst.r = v.r;
+            dst.s.clear();
+            dst.ref = v.text();
+        } else {
+            dst.tag = ColTag::NIL;
+            dst.s.clear();
+            dst.ref = {};
         }
-        case Op::Column: {
-            auto& c = cursors_[ins.p1];
-            std::string_view payload = btree_->read_payload(c);
-            auto row = decode_row(reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
-            if (ins.p2 >= 0) {
-                if (regs_.size() <= static_cast<size_t>(ins.p3)) regs_.resize(ins.p3 + 1);
-                if (static_cast<size_t>(ins.p2) < row.size()) regs_[ins.p3] = row[ins.p2];
+        NEXT();
+    }
+    CASE(AddImm) {
+        // Add p2 to reg p1: INT while the sum fits, REAL past that, as
+        // SQL arithmetic goes; NULL and strings are left alone.
+        Value& r = regs[ip->p1];
+        if (r.tag == ColTag::INT) {
+            int64_t sum;
+            if (!__builtin_add_overflow(r.i, static_cast<int64_t>(ip->p2), &sum)) {
+                r.i = sum;
             } else {
-                last_row_cols_ = row.size();
-                if (regs_.size() < last_row_cols_) regs_.resize(last_row_cols_);
-                for (size_t i = 0; i < row.size(); ++i) regs_[i] = row[i];
+                r.r = static_cast<double>(r.i) + ip->p2;
+                r.tag = ColTag::REAL;
             }
-            ++pc;
-            break;
+        } else if (r.tag == ColTag::REAL) {
+            r.r += ip->p2;
         }
-        case Op::Integer: {
-            if (regs_.size() <= static_cast<size_t>(ins.p2)) regs_.resize(ins.p2 + 1);
-            regs_[ins.p2].tag = ColTag::INT;
-            regs_[ins.p2].i = ins.p1;
-            ++pc;
-            break;
+        NEXT();
+    }
+    CASE(RowidBound) {
+        // Make reg p1, a bound parameter, the INT rowid bound it sets: a
+        // lower bound for p3 > 0, an upper one for p3 < 0, strict (> or <)
+        // if |p3| is 2. REAL rounds inward; TEXT and BLOB order after
+        // every number. Jump to p2 if no rowid can satisfy it, as with NULL.
+        Value& r = regs[ip->p1];
+        bool lower = ip->p3 > 0, strict = ip->p3 == 2 || ip->p3 == -2;
+        int64_t v = 0;
+        if (r.tag == ColTag::INT) {
+            v = r.i;
+            if (strict && __builtin_add_overflow(v, lower ? 1 : -1, &v)) JUMP(ip->p2);
+        } else if (r.tag == ColTag::REAL) {
+            double d = r.r;
+            if (d != d) JUMP(ip->p2); // NaN
+            double b = lower ? (strict ? std::floor(d) + 1 : std::ceil(d))
+                             : (strict ? std::ceil(d) - 1 : std::floor(d));
+            if (b >= 9223372036854775808.0) {
+                if (lower) JUMP(ip->p2);
+                v = std::numeric_limits<int64_t>::max();
+            } else if (b < -9223372036854775808.0) {
+                if (!lower) JUMP(ip->p2);
+                v = std::numeric_limits<int64_t>::min();
+            } else {
+                v = static_cast<int64_t>(b);
+            }
+        } else if (r.tag == ColTag::TEXT || r.tag == ColTag::BLOB) {
+            if (lower) JUMP(ip->p2);
+            v = std::numeric_limits<int64_t>::max();
+        } else {
+            JUMP(ip->p2);
+        }
+        r.tag = ColTag::INT;
+        r.i = v;
+        r.s.clear();
+        r.ref = {};
+        NEXT();
+    }
+    CASE(NewRowid) {
+        // The rowid a new row of tree p1 gets, max(rowid) + 1, into reg p2.
+        if (!btree_) return StepResult::Error;
+        {
+            // Computed goto skips destructors, so the cursor has to be
+            // gone before NEXT().
+            Cursor c = btree_->open(static_cast<uint32_t>(ip->p1));
+            Value& dst = regs[ip->p2];
+            dst.tag = ColTag::INT;
+            dst.i = btree_->last(c) ? btree_->key(c) + 1 : 1;
+            dst.s.clear();
+            dst.ref = {};
+        }
+        NEXT();
+    }
+    CASE(Insert) {
+        // Add reg p3 as a row of tree p1 under the rowid in reg p2, or
+        // with p2 < 0 under a new one as NewRowid would pick.
+        if (!btree_) return StepResult::Error;
+        {
+            int64_t rowid = ip->p2 >= 0 ? regs[ip->p2].i : 0;
+            if (ip->p2 < 0) {
+                Cursor c = btree_->open(static_cast<uint32_t>(ip->p1));
+                rowid = btree_->last(c) ? btree_->key(c) + 1 : 1;
+            }
+            btree_->insert(static_cast<uint32_t>(ip->p1), {rowid}, regs[ip->p3].text());
+        }
+        NEXT();
+    }
+    CASE(ResultRow) {
+        // Yield regs p1.. as the current row. Its TEXT is borrowed and
+        // valid until the next step.
+        size_t n = ip->p2 == 0 ? last_row_cols_ : static_cast<size_t>(ip->p2);
+        row_.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            const Value& v = regs[ip->p1 + i];
+            Value& dst = row_[i];
+            dst.tag = v.tag;
+            dst.i = v.i;
+            dst.r = v.r;
+            dst.s.clear();
+            dst.ref = v.text();
         }
-        case Op::Insert: {
-            if (!btree_) return 1;
-            std::string_view payload(ins.p4);
-            btree_->insert(static_cast<uint32_t>(ins.p1), {next_rowid_++}, payload);
-            ++pc;
-            break;
+        pc_ = static_cast<size_t>(ip - code) + 1;
+        return StepResult::Row;
+    }
+    CASE(Begin) {
+        if (!btree_ || btree_->pager().in_transaction()) return StepResult::Error;
+        btree_->pager().begin();
+        NEXT();
+    }
+    CASE(Commit) {
+        if (!btree_ || !btree_->pager().in_transaction()) return StepResult::Error;
+        btree_->pager().flush();
+        NEXT();
+    }
+    CASE(Rollback) {
+        if (!btree_ || !btree_->pager().in_transaction()) return StepResult::Error;
+        btree_->pager().rollback();
+        // Cached tree shapes and schema may describe rolled-back pages.
+        btree_->forget_hints();
+        if (catalog_) catalog_->reload();
+        NEXT();
+    }
+    CASE(Rowid) {
+        Value& dst = regs[ip->p2];
+        dst.tag = ColTag::INT;
+        dst.i = btree_->key(cursors_[ip->p1]);
+        dst.s.clear();
+        dst.ref = {};
+        NEXT();
+    }
+    // Integers, the common case, are compared inline.
+#define COMPARE(name, test) \
+    CASE(name) { \
+        const Value& a = regs[ip->p1]; \
+        const Value& b = regs[ip->p3]; \
+        if (a.tag == ColTag::INT && b.tag == ColTag::INT) { \
+            if (!(a.i test b.i)) JUMP(ip->p2); \
+            NEXT(); \
+        } \
+        if (a.tag == ColTag::NIL || b.tag == ColTag::NIL || !(compare_values(a, b) test 0)) \
+            JUMP(ip->p2); \
+        NEXT(); \
+    }
+    COMPARE(Eq, ==)
+    COMPARE(Ne, !=)
+    COMPARE(Lt, <)
+    COMPARE(Le, <=)
+    COMPARE(Gt, >)
+    COMPARE(Ge, >=)
+#undef COMPARE
+    CASE(Goto) {
+        JUMP(ip->p2);
+    }
+    CASE(MakeRecord) {
+        // Encode p2 registers from p1 (at least the last row's width)
+        // into reg p3. p3 may be one of the inputs, so encode aside and
+        // swap the buffers; both keep their capacity for the next row.
+        size_t n = std::max(static_cast<size_t>(ip->p2), last_row_cols_);
+        encode_row(regs + ip->p1, n, rec_);
+        Value& dst = regs[ip->p3];
+        dst.tag = ColTag::TEXT;
+        dst.i = 0;
+        dst.ref = {};
+        dst.s.swap(rec_);
+        NEXT();
+    }
+    CASE(Update) {
+        // Replace the payload of the row under cursor p1 with reg p2.
+        auto& c = cursors_[ip->p1];
+        rows_[ip->p1].valid = false;
+        int64_t key = btree_->key(c);
+        btree_->insert(c.root, {key}, regs[ip->p2].text());
+        btree_->seek(c, key); // the row may have moved to a split page
+        NEXT();
+    }
+    CASE(Delete) {
+        rows_[ip->p1].valid = false;
+        btree_->erase(cursors_[ip->p1]);
+        NEXT();
+    }
+    CASE(EraseRange) {
+        // Erase rowids in [reg p2, reg p3] of tree p1; -1 is unbounded.
+        int64_t lo = ip->p2 < 0 ? std::numeric_limits<int64_t>::min() : regs[ip->p2].i;
+        int64_t hi = ip->p3 < 0 ? std::numeric_limits<int64_t>::max() : regs[ip->p3].i;
+        btree_->erase_range(static_cast<uint32_t>(ip->p1), lo, hi);
+        NEXT();
+    }
+    CASE(Copy) {
+        // Reg p1 into reg p2; borrowed TEXT stays borrowed.
+        const Value& src = regs[ip->p1];
+        Value& dst = regs[ip->p2];
+        dst.tag = src.tag;
+        dst.i = src.i;
+        dst.r = src.r;
+        dst.s = src.s;
+        dst.ref = src.ref;
+        NEXT();
+    }
+    CASE(MakeKey) {
+        // Key of the p2 values from reg p1 into reg p3, to seek to or
+        // stop at: every entry with those leading values starts with it.
+        rec_.clear();
+        for (int i = 0; i < ip->p2; ++i) append_key(regs[ip->p1 + i], rec_);
+        Value& dst = regs[ip->p3];
+        dst.tag = ColTag::BLOB;
+        dst.ref = {};
+        dst.s.swap(rec_);
+        NEXT();
+    }
+    CASE(MakeEntry) {
+        // Index entry for the p2 values from reg p1 and the rowid in the
+        // register after them, into reg p3. An entry too long to store
+        // fails the statement here; INSERT and UPDATE build every entry
+        // before their first write.
+        rec_.clear();
+        for (int i = 0; i < ip->p2; ++i) append_key(regs[ip->p1 + i], rec_);
+        finish_key(regs + ip->p1, static_cast<size_t>(ip->p2), regs[ip->p1 + ip->p2].i, rec_);
+        if (rec_.size() > MAX_INDEX_KEY) return StepResult::Error;
+        Value& dst = regs[ip->p3];
+        dst.tag = ColTag::BLOB;
+        dst.ref = {};
+        dst.s.swap(rec_);
+        NEXT();
+    }
+    CASE(IdxInsert) {
+        btree_->index_insert(static_cast<uint32_t>(ip->p1), regs[ip->p2].text());
+        NEXT();
+    }
+    CASE(IdxDelete) {
+        btree_->index_erase(static_cast<uint32_t>(ip->p1), regs[ip->p2].text());
+        NEXT();
+    }
+    CASE(IdxSeekGE) {
+        // Land on the first entry >= key reg p3; jump to p2 if none.
+        if (!btree_->index_seek(cursors_[ip->p1], regs[ip->p3].text())) JUMP(ip->p2);
+        NEXT();
+    }
+    CASE(IdxSeekGT) {
+        // Land past every entry starting with key reg p3: no value
+        // encoding starts with FF. Jump to p2 if nothing is left.
+        rec_.assign(regs[ip->p3].text());
+        rec_.push_back(static_cast<char>(0xFF));
+        if (!btree_->index_seek(cursors_[ip->p1], rec_)) JUMP(ip->p2);
+        NEXT();
+    }
+    CASE(IdxLt) {
+        // Fall through while the entry sorts before key reg p3, else jump.
+        if (!(btree_->index_key(cursors_[ip->p1]) < regs[ip->p3].text())) JUMP(ip->p2);
+        NEXT();
+    }
+    CASE(IdxLe) {
+        // As IdxLt, also falling through on entries starting with the key.
+        std::string_view key = regs[ip->p3].text();
+        if (!(btree_->index_key(cursors_[ip->p1]).substr(0, key.size()) <= key)) JUMP(ip->p2);
+        NEXT();
+    }
+    CASE(IdxNext) {
+        if (btree_->index_next(cursors_[ip->p1])) JUMP(ip->p2);
+        NEXT();
+    }
+    CASE(IdxRowid) {
+        Value& dst = regs[ip->p2];
+        dst.tag = ColTag::INT;
+        dst.i = key_rowid(btree_->index_key(cursors_[ip->p1]));
+        dst.s.clear();
+        dst.ref = {};
+        NEXT();
+    }
+    CASE(IdxColumn) {
+        // Column p2 of the entry under index cursor p1 into reg p3, TEXT
+        // borrowed from the leaf: a covering scan never reads the table.
+        auto& c = cursors_[ip->p1];
+        if (!key_column(btree_->index_key(c), rows_[ip->p1].key_cols,
+                        static_cast<size_t>(ip->p2), regs[ip->p3]))
+            return StepResult::Error;
+        NEXT();
+    }
+    CASE(SeekRowid) {
+        // Land on the row whose rowid is reg p3; jump to p2 if absent.
+        rows_[ip->p1].valid = false;
+        if (!btree_->seek(cursors_[ip->p1], regs[ip->p3].i)) JUMP(ip->p2);
+        NEXT();
+    }
+    CASE(AggReset) {
+        // Start grouping on p1 key columns, with the aggregates listed
+        // (one AggOp per byte) in consts[p2].
+        agg_.reset(static_cast<size_t>(ip->p1), prog_->consts[ip->p2].text());
+        agg_pos_ = 0;
+        NEXT();
+    }
+    CASE(AggStep) {
+        // Fold in the row in regs p1..: the key columns, then one
+        // argument per aggregate. An INT SUM that overflows fails the
+        // statement.
+        if (!agg_.step(regs + ip->p1)) return StepResult::Error;
+        NEXT();
+    }
+    CASE(BatchAggStep) {
+        // AggStep for each batch row, given as its batch columns p2..
+        // (p3 of them: the keys, then one argument per aggregate) through
+        // regs p1..
+        auto first = static_cast<size_t>(ip->p2), n = static_cast<size_t>(ip->p3);
+        for (size_t k = 0; k < batch_.rows(); ++k) {
+            for (size_t i = 0; i < n; ++i) batch_.get(first + i, k, regs[ip->p1 + i]);
+            if (!agg_.step(regs + ip->p1)) return StepResult::Error;
         }
-        case Op::ResultRow: {
-            int n = ins.p2 == 0 ? static_cast<int>(last_row_cols_) : ins.p2;
-            std::vector<Value> row;
-            row.reserve(n);
-            for (int i = 0; i < n; ++i) {
-                if (static_cast<size_t>(ins.p1 + i) < regs_.size())
-                    row.push_back(regs_[ins.p1 + i]);
-                else
-                    row.push_back(Value{});
+        NEXT();
+    }
+    CASE(AggNext) {
+        // The next group into regs p1..: its keys, then each aggregate's
+        // result. Jump to p2 once every group has been read.
+        if (agg_pos_ == agg_.groups()) JUMP(ip->p2);
+        agg_.result(agg_pos_++, regs + ip->p1);
+        NEXT();
+    }
+    CASE(Count) {
+        // Number of rows of tree p1 into reg p2, without reading a row.
+        if (!btree_) return StepResult::Error;
+        Value& dst = regs[ip->p2];
+        dst.tag = ColTag::INT;
+        dst.i = static_cast<int64_t>(btree_->count(static_cast<uint32_t>(ip->p1)));
+        dst.s.clear();
+        dst.ref = {};
+        NEXT();
+    }
+    CASE(SorterOpen) {
+        // Start a sort whose keys run as consts[p3] says, a byte per key
+        // (1: descending). Given a LIMIT in reg p1 and an OFFSET in reg
+        // p2 (-1: none), only the first limit + offset rows are kept.
+        size_t keep = SIZE_MAX;
+        if (ip->p1 >= 0 && regs[ip->p1].tag == ColTag::INT && regs[ip->p1].i >= 0) {
+            keep = static_cast<size_t>(regs[ip->p1].i);
+            if (ip->p2 >= 0 && regs[ip->p2].tag == ColTag::INT && regs[ip->p2].i > 0) {
+                auto skip = static_cast<size_t>(regs[ip->p2].i);
+                keep = skip > SIZE_MAX - keep ? SIZE_MAX : keep + skip;
             }
-            results_.push_back(std::move(row));
-            ++pc;
-            break;
         }
-        case Op::Halt:
-            return 0;
+        sorter_.reset(keep);
+        sort_desc_ = prog_->consts[ip->p3].text();
+        NEXT();
+    }
+    CASE(SorterInsert) {
+        // Add the record in reg p3 under the key of the p2 values from
+        // reg p1. Key encodings are prefix-free, so inverting a value's
+        // bytes reverses its order: that is DESC, NULLs last.
+        rec_.clear();
+        for (int i = 0; i < ip->p2; ++i) {
+            size_t at = rec_.size();
+            append_key(regs[ip->p1 + i], rec_);
+            if (static_cast<size_t>(i) < sort_desc_.size() && sort_desc_[i])
+                for (size_t b = at; b < rec_.size(); ++b) rec_[b] = static_cast<char>(~rec_[b]);
+        }
+        sorter_.add(rec_, regs[ip->p3].text());
+        NEXT();
+    }
+    CASE(SorterSort) {
+        // Land on the first row in order; jump to p2 if there is none.
+        if (!sorter_.sort()) JUMP(ip->p2);
+        NEXT();
+    }
+    CASE(SorterNext) {
+        if (sorter_.next()) JUMP(ip->p2);
+        NEXT();
+    }
+    CASE(SorterData) {
+        // Columns of the current sorted row into regs p1..: p2 of them,
+        // or with p2 = 0 the whole row as Column -1 reads it. TEXT is
+        // borrowed from the sorter until SorterNext.
+        std::string_view rec = sorter_.row();
+        sort_row_.reset(reinterpret_cast<const uint8_t*>(rec.data()), rec.size());
+        auto base = static_cast<size_t>(ip->p1);
+        size_t n = ip->p2 ? static_cast<size_t>(ip->p2) : sort_row_.columns();
+        if (regs_.size() < base + n) {
+            regs_.resize(base + n);
+            pc_ = static_cast<size_t>(ip - code);
+            return exec(); // re-enter with the moved register file
+        }
+        for (size_t i = 0; i < n; ++i) sort_row_.get(i, regs[base + i]);
+        if (ip->p2 == 0) {
+            for (size_t i = base + n; i < base + last_row_cols_; ++i) clear_value(regs[i]);
+            last_row_cols_ = n;
+        }
+        NEXT();
+    }
+    CASE(IfPos) {
+        // If reg p1 is positive, take p3 from it and jump to p2.
+        Value& r = regs[ip->p1];
+        if (r.tag == ColTag::INT && r.i > 0) {
+            r.i -= ip->p3;
+            JUMP(ip->p2);
         }
+        NEXT();
+    }
+    CASE(DecrJumpZero) {
+        // Decrement reg p1 and jump to p2 if that makes it zero, so a
+        // negative or NULL counter never runs out.
+        Value& r = regs[ip->p1];
+        if (r.tag == ColTag::INT && --r.i == 0) JUMP(ip->p2);
+        NEXT();
+    }
+    CASE(Halt) {
+        return StepResult::Done;
     }
-    return 0;
+#if !TINYDB_COMPUTED_GOTO
+    }
+#endif
+#undef CASE
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
 }
+#if TINYDB_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
 
 } // namespace tinydb
-
@@ -0,0 +1,184 @@
+#include "tinydb/wal.hpp"
+#include "tinydb/pager.hpp"
+#include <algorithm>
+#include <random>
+
+namespace tinydb {
+
+namespace {
+constexpr uint32_t WAL_MAGIC = 0x6C617774; // "twal"
+constexpr uint32_t WAL_VERSION = 1;
+constexpr size_t WAL_HDR = 32;   // magic, version, page size, ckpt seq, salt x2, cksum x2
+constexpr size_t FRAME_HDR = 24; // pgno, commit size, salt x2, cksum x2
+
+static uint32_t read32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) |
+           static_cast<uint32_t>(p[1]) << 8 |
+           static_cast<uint32_t>(p[2]) << 16 |
+           static_cast<uint32_t>(p[3]) << 24;
+}
+
+static void write32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v & 0xFF);
+    p[1] = static_cast<uint8_t>((v >> 8) & 0xFF);
+    p[2] = static_cast<uint8_t>((v >> 16) & 0xFF);
+    p[3] = static_cast<uint8_t>((v >> 24) & 0xFF);
+}
+
+// Fletcher-style running checksum over 8-byte blocks (n % 8 == 0).
+static void checksum(const uint8_t* p, size_t n, uint32_t* s) {
+    for (size_t i = 0; i < n; i += 8) {
+        s[0] += read32(p + i) + s[1];
+        s[1] += read32(p + i + 4) + s[0];
+    }
+}
+} // namespace
+
+Wal::Wal(std::unique_ptr<IStorage> log) : log_(std::move(log)) {
+    recover();
+}
+
+uint64_t Wal::frame_offset(uint32_t frame) const {
+    return WAL_HDR + static_cast<uint64_t>(frame) * (FRAME_HDR + PAGE_SIZE);
+}
+
+void Wal::reset() {
+    ++ckpt_seq_;
+    salt_[0] += 1;
+    salt_[1] = std::random_device{}();
+    uint8_t hdr[WAL_HDR]{};
+    write32(hdr, WAL_MAGIC);
+    write32(hdr + 4, WAL_VERSION);
+    write32(hdr + 8, PAGE_SIZE);
+    write32(hdr + 12, ckpt_seq_);
+    write32(hdr + 16, salt_[0]);
+    write32(hdr + 20, salt_[1]);
+    cksum_[0] = cksum_[1] = 0;
+    checksum(hdr, 24, cksum_);
+    write32(hdr + 24, cksum_[0]);
+    write32(hdr + 28, cksum_[1]);
+    log_->write(0, hdr, WAL_HDR);
+    log_->sync();
+    nframes_ = commit_frames_ = 0;
+    commit_cksum_[0] = cksum_[0];
+    commit_cksum_[1] = cksum_[1];
+    index_.clear();
+    pending_.clear();
+}
+
+void Wal::recover() {
+    uint8_t hdr[WAL_HDR];
+    log_->read(0, hdr, WAL_HDR);
+    uint32_t ck[2] = {0, 0};
+    checksum(hdr, 24, ck);
+    if (read32(hdr) != WAL_MAGIC || read32(hdr + 4) != WAL_VERSION ||
+        read32(hdr + 8) != PAGE_SIZE || read32(hdr + 24) != ck[0] || read32(hdr + 28) != ck[1]) {
+        reset();
+        return;
+    }
+    ckpt_seq_ = read32(hdr + 12);
+    salt_[0] = read32(hdr + 16);
+    salt_[1] = read32(hdr + 20);
+    cksum_[0] = commit_cksum_[0] = ck[0];
+    cksum_[1] = commit_cksum_[1] = ck[1];
+    std::vector<uint8_t> buf(FRAME_HDR + PAGE_SIZE);
+    std::unordered_map<uint32_t, uint32_t> txn;
+    for (uint32_t f = 0;; ++f) {
+        log_->read(frame_offset(f), buf.data(), buf.size());
+        const uint8_t* h = buf.data();
+        uint32_t pgno = read32(h);
+        if (pgno == 0 || read32(h + 8) != salt_[0] || read32(h + 12) != salt_[1]) break;
+        checksum(h, 8, ck);
+        checksum(h + FRAME_HDR, PAGE_SIZE, ck);
+        if (read32(h + 16) != ck[0] || read32(h + 20) != ck[1]) break;
+        txn[pgno] = f;
+        if (read32(h + 4) != 0) {
+            for (auto& kv : txn) index_[kv.first] = kv.second;
+            txn.clear();
+            nframes_ = commit_frames_ = f + 1;
+            cksum_[0] = commit_cksum_[0] = ck[0];
+            cksum_[1] = commit_cksum_[1] = ck[1];
+        }
+    }
+}
+
+bool Wal::read(uint32_t pgno, uint8_t* buf) {
+    auto it = pending_.find(pgno);
+    if (it == pending_.end()) {
+        it = index_.find(pgno);
+        if (it == index_.end()) return false;
+    }
+    log_->read(frame_offset(it->second) + FRAME_HDR, buf, PAGE_SIZE);
+    return true;
+}
+
+void Wal::append(const std::vector<std::pair<uint32_t, const uint8_t*>>& pages,
+                 bool commit, uint32_t db_pages) {
+    if (pages.empty()) return;
+    std::vector<uint8_t> hdrs(pages.size() * FRAME_HDR);
+    std::vector<IoSlice> slices;
+    slices.reserve(pages.size() * 2);
+    for (size_t i = 0; i < pages.size(); ++i) {
+        uint8_t* h = hdrs.data() + i * FRAME_HDR;
+        bool last = i + 1 == pages.size();
+        write32(h, pages[i].first);
+        write32(h + 4, commit && last ? db_pages : 0);
+        write32(h + 8, salt_[0]);
+        write32(h + 12, salt_[1]);
+        checksum(h, 8, cksum_);
+        checksum(pages[i].second, PAGE_SIZE, cksum_);
+        write32(h + 16, cksum_[0]);
+        write32(h + 20, cksum_[1]);
+        slices.push_back({h, FRAME_HDR});
+        slices.push_back({pages[i].second, PAGE_SIZE});
+    }
+    log_->writev(frame_offset(nframes_), slices.data(), slices.size());
+    for (size_t i = 0; i < pages.size(); ++i)
+        pending_[pages[i].first] = nframes_ + static_cast<uint32_t>(i);
+    nframes_ += static_cast<uint32_t>(pages.size());
+    if (commit) {
+        log_->sync();
+        for (auto& kv : pending_) index_[kv.first] = kv.second;
+        pending_.clear();
+        commit_frames_ = nframes_;
+        commit_cksum_[0] = cksum_[0];
+        commit_cksum_[1] = cksum_[1];
+    }
+}
+
+void Wal::discard_pending() {
+    // The next append overwrites the discarded frames; replay would have
+    // ignored them anyway since no commit frame follows.
+    pending_.clear();
+    nframes_ = commit_frames_;
+    cksum_[0] = commit_cksum_[0];
+    cksum_[1] = commit_cksum_[1];
+}
+
+void Wal::checkpoint(IStorage& db) {
+    // Uncommitted frames may be the only copy of a spilled page.
+    if (!pending_.empty() || nframes_ == 0) return;
+    std::vector<std::pair<uint32_t, uint32_t>> pages(index_.begin(), index_.end());
+    std::sort(pages.begin(), pages.end());
+    constexpr size_t BATCH = 64;
+    std::vector<uint8_t> buf(BATCH * PAGE_SIZE);
+    std::vector<IoSlice> run;
+    for (size_t base = 0; base < pages.size(); base += BATCH) {
+        size_t n = std::min(BATCH, pages.size() - base);
+        for (size_t i = 0; i < n; ++i) {
+            uint8_t* dst = buf.data() + i * PAGE_SIZE;
+            log_->read(frame_offset(pages[base + i].second) + FRAME_HDR, dst, PAGE_SIZE);
+            run.push_back({dst, PAGE_SIZE});
+            uint32_t pgno = pages[base + i].first;
+            if (i + 1 == n || pages[base + i + 1].first != pgno + 1) {
+                uint32_t first = pgno - static_cast<uint32_t>(run.size() - 1);
+                db.writev(static_cast<uint64_t>(first - 1) * PAGE_SIZE, run.data(), run.size());
+                run.clear();
+            }
+        }
+    }
+    db.sync();
+    reset();
+}
+
+} // namespace tinydb
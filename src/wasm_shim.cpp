@@ -9,6 +9,8 @@
 extern "C" {
 // Your existing CLI entry points you call inside main.cpp, refactor them if needed:
 int tinydb_process_line(const std::string& line, std::string& out); 
+typedef void (*tinydb_output_fn)(const char* data, size_t n, void* ctx);
+int tinydb_process_line_stream(const std::string& line, tinydb_output_fn emit, void* ctx);
 // ^ Implement by extracting the REPL's single-line handling from your CLI.
 // Should append to `out` (including newlines) and return 0 on success.
 }
@@ -35,6 +37,20 @@ const char* tinydb_eval_script(const char* script_cstr) {
     return buf;
 }
 
+// Like tinydb_eval_script, but output goes to `emit` (e.g. a JS function
+// added with addFunction) as it is produced, so large results never sit
+// in one buffer. Chunks are not NUL-terminated. Returns 0.
+int tinydb_eval_script_stream(const char* script_cstr, tinydb_output_fn emit, void* ctx) {
+    if (!script_cstr || !emit) return 0;
+    std::istringstream in(script_cstr);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty()) continue;
+        tinydb_process_line_stream(line, emit, ctx);
+    }
+    return 0;
+}
+
 void tinydb_free(const char* p) {
     free((void*)p);
 }
@@ -2,8 +2,12 @@
 #include "tinydb/storage.hpp"
 #include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <limits>
 #include <memory>
 #include <random>
+#include <set>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -48,6 +52,407 @@ int main() {
             else assert(!t.next(c));
         }
     }
+
+    // tree larger than a tiny buffer pool
+    {
+        const char* small_path = "btree_pool_test.db";
+        std::remove(small_path);
+        auto st = std::make_unique<tinydb::FileStorage>(small_path);
+        tinydb::Pager pager(std::move(st), 16);
+        tinydb::BTree t(pager);
+        uint32_t r = t.create_table();
+        std::mt19937_64 rng(7);
+        std::vector<int64_t> ks;
+        for (int i = 0; i < 3000; ++i) {
+            int64_t k = static_cast<int64_t>(rng() % 1000000);
+            ks.push_back(k);
+            t.insert(r, {k}, std::string(40, static_cast<char>('a' + k % 26)));
+        }
+        assert(t.check(r));
+        std::sort(ks.begin(), ks.end());
+        ks.erase(std::unique(ks.begin(), ks.end()), ks.end());
+        auto c = t.open(r);
+        t.seek(c, ks.front());
+        for (size_t i = 0; i < ks.size(); ++i) {
+            assert(t.key(c) == ks[i]);
+            assert(t.read_payload(c) == std::string(40, static_cast<char>('a' + ks[i] % 26)));
+            if (i + 1 < ks.size()) assert(t.next(c));
+        }
+        std::remove(small_path);
+    }
+
+    // overwriting cells in place with shorter and longer payloads
+    {
+        const char* upd_path = "btree_update_test.db";
+        std::remove(upd_path);
+        auto st = std::make_unique<tinydb::FileStorage>(upd_path);
+        tinydb::Pager pager(std::move(st));
+        tinydb::BTree t(pager);
+        uint32_t r = t.create_table();
+        std::vector<std::string> want(500);
+        std::mt19937_64 rng(99);
+        for (int round = 0; round < 4; ++round) {
+            for (int k = 0; k < 500; ++k) {
+                want[k] = std::string(rng() % 120, static_cast<char>('a' + (k + round) % 26));
+                t.insert(r, {k}, want[k]);
+            }
+            assert(t.check(r));
+        }
+        auto c = t.open(r);
+        assert(t.seek(c, 0));
+        for (int k = 0; k < 500; ++k) {
+            assert(t.key(c) == k);
+            assert(t.read_payload(c) == want[k]);
+            if (k + 1 < 500) assert(t.next(c));
+        }
+        std::remove(upd_path);
+    }
+
+    // sequential appends fill leaves instead of leaving them half empty
+    {
+        const char* seq_path = "btree_append_test.db";
+        std::remove(seq_path);
+        auto st = std::make_unique<tinydb::FileStorage>(seq_path);
+        tinydb::Pager pager(std::move(st));
+        tinydb::BTree t(pager);
+        uint32_t r = t.create_table();
+        const int n = 20000;
+        std::string payload(30, 'p');
+        for (int k = 1; k <= n; ++k) t.insert(r, {k}, payload);
+        assert(t.check(r));
+        auto c = t.open(r);
+        assert(t.last(c) && t.key(c) == n);
+        assert(t.seek(c, 1));
+        size_t leaves = 1;
+        uint32_t pg = c.pgno;
+        for (int k = 1; k <= n; ++k) {
+            assert(t.key(c) == k);
+            if (c.pgno != pg) { ++leaves; pg = c.pgno; }
+            if (k < n) assert(t.next(c));
+        }
+        size_t per_leaf = (tinydb::PAGE_SIZE - 12) / (2 + 10 + payload.size());
+        assert(leaves <= n / per_leaf + 1);
+        std::remove(seq_path);
+    }
+
+    // bulk load builds a valid, densely packed tree in one pass
+    {
+        const char* bulk_path = "btree_bulk_test.db";
+        std::remove(bulk_path);
+        auto st = std::make_unique<tinydb::FileStorage>(bulk_path);
+        tinydb::Pager pager(std::move(st), 64);
+        tinydb::BTree t(pager);
+        uint32_t r = t.create_table();
+        const int64_t n = 200000;
+        int64_t k = 0;
+        bool ok = t.bulk_load(r, [&](tinydb::Key& key, std::string& payload) {
+            if (k == n) return false;
+            key.rowid = ++k * 2;
+            payload.assign(static_cast<size_t>(k % 50), 'b');
+            return true;
+        });
+        assert(ok);
+        assert(t.check(r));
+        auto c = t.open(r);
+        assert(t.seek(c, 2));
+        for (int64_t i = 1; i <= n; ++i) {
+            assert(t.key(c) == i * 2);
+            assert(t.read_payload(c).size() == static_cast<size_t>(i % 50));
+            if (i < n) assert(t.next(c));
+            else assert(!t.next(c));
+        }
+        assert(!t.seek(c, 7) && t.key(c) == 8);
+        // already populated: refuse, and further inserts still work
+        assert(!t.bulk_load(r, [](tinydb::Key&, std::string&) { return false; }));
+        t.insert(r, {2 * n + 1}, "tail");
+        t.insert(r, {3}, "mid");
+        assert(t.check(r));
+        assert(t.last(c) && t.key(c) == 2 * n + 1);
+        // a load that fits one page stays in the root
+        uint32_t small = t.create_table();
+        int64_t m = 0;
+        assert(t.bulk_load(small, [&](tinydb::Key& key, std::string& payload) {
+            if (m == 10) return false;
+            key.rowid = ++m;
+            payload = "x";
+            return true;
+        }));
+        assert(t.check(small));
+        auto sc = t.open(small);
+        assert(t.last(sc) && t.key(sc) == 10 && sc.pgno == small);
+        // a fill above 1 packs pages full, never past their end
+        uint32_t packed = t.create_table();
+        int64_t p = 0;
+        assert(t.bulk_load(packed, [&](tinydb::Key& key, std::string& payload) {
+            if (p == 500) return false;
+            key.rowid = ++p;
+            payload.assign(300, 'p');
+            return true;
+        }, 1.5));
+        assert(t.check(packed) && t.count(packed) == 500);
+        // a key out of order throws, freeing every page the load took
+        uint32_t failed = t.create_table();
+        uint32_t free_before = pager.free_count();
+        auto rows = [](int64_t count, bool bad_last) {
+            return [count, bad_last, i = int64_t{0}](tinydb::Key& key, std::string& payload) mutable {
+                if (i == count + (bad_last ? 1 : 0)) return false;
+                ++i;
+                key.rowid = i > count ? 1 : i;
+                payload.assign(i % 100 == 0 ? 9000 : 40, 'f');
+                return true;
+            };
+        };
+        bool threw = false;
+        try {
+            t.bulk_load(failed, rows(5000, true));
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        assert(threw && t.check(failed) && t.count(failed) == 0);
+        assert(pager.free_count() > free_before);
+        assert(t.bulk_load(failed, rows(5000, false)));
+        assert(t.check(failed) && t.count(failed) == 5000 && pager.free_count() == free_before);
+        std::remove(bulk_path);
+    }
+
+    // large payloads spill into overflow chains that are read lazily and
+    // freed when the cell is overwritten
+    {
+        const char* ovf_path = "btree_overflow_test.db";
+        std::remove(ovf_path);
+        auto st = std::make_unique<tinydb::FileStorage>(ovf_path);
+        tinydb::Pager pager(std::move(st), 16);
+        tinydb::BTree t(pager);
+        uint32_t r = t.create_table();
+        auto blob = [](int k, size_t n) {
+            std::string s(n, '\0');
+            for (size_t i = 0; i < n; ++i) s[i] = static_cast<char>('a' + (k + i) % 26);
+            return s;
+        };
+        std::vector<size_t> sizes{0, 1000, 1009, 1010, 4096, 4097, 12000, 70000};
+        for (int k = 0; k < 200; ++k) t.insert(r, {k}, blob(k, sizes[k % sizes.size()]));
+        assert(t.check(r));
+        auto c = t.open(r);
+        assert(t.seek(c, 0));
+        for (int k = 0; k < 200; ++k) {
+            size_t n = sizes[k % sizes.size()];
+            assert(t.payload_size(c) == n);
+            assert(t.read_payload(c) == blob(k, n));
+            assert(t.read_payload(c, 5000) == blob(k, n).substr(0, 5000));
+            assert(t.local_payload(c).size() <= n);
+            assert(blob(k, n).compare(0, t.local_payload(c).size(), t.local_payload(c)) == 0);
+            if (k + 1 < 200) assert(t.next(c));
+        }
+        // leaf runs hand out the same rows a leaf at a time
+        {
+            std::vector<tinydb::CellView> cells(64);
+            auto lc = t.open(r);
+            t.seek(lc, 3);
+            int k = 3;
+            size_t runs = 0;
+            std::string whole;
+            do {
+                size_t n = t.leaf_run(lc, cells.data(), cells.size());
+                assert(n > 0 && t.key(lc) == cells[n - 1].key);
+                ++runs;
+                for (size_t i = 0; i < n; ++i, ++k) {
+                    size_t len = sizes[k % sizes.size()];
+                    assert(cells[i].key == k && cells[i].total == len);
+                    assert((cells[i].overflow == 0) == (cells[i].local.size() == len));
+                    t.read_overflow(cells[i], whole);
+                    assert(whole == blob(k, len));
+                }
+            } while (t.next(lc));
+            assert(k == 200 && runs > 1);
+        }
+        pager.flush();
+        uint32_t freed = pager.free_count();
+        t.insert(r, {7}, "small now");
+        assert(pager.free_count() == freed + 70000 / (tinydb::PAGE_SIZE - 4));
+        t.insert(r, {7}, blob(7, 70000)); // reuses the freed chain
+        assert(pager.free_count() == freed);
+        assert(t.check(r));
+        assert(t.seek(c, 7) && t.read_payload(c) == blob(7, 70000));
+        std::remove(ovf_path);
+    }
+
+    // erase: single keys, cursor deletes and range deletes that drop whole
+    // subtrees, with underfull pages merged and freed pages reused
+    {
+        const char* del_path = "btree_erase_test.db";
+        std::remove(del_path);
+        auto st = std::make_unique<tinydb::FileStorage>(del_path);
+        tinydb::Pager pager(std::move(st), 32);
+        tinydb::BTree t(pager);
+        uint32_t r = t.create_table();
+        const int n = 60000;
+        std::set<int64_t> want;
+        for (int k = 1; k <= n; ++k) {
+            t.insert(r, {k}, std::string(k % 97 == 0 ? 5000 : 40, 'e'));
+            want.insert(k);
+        }
+        auto verify = [&] {
+            assert(t.check(r) && t.count(r) == want.size());
+            auto c = t.open(r);
+            t.seek(c, std::numeric_limits<int64_t>::min());
+            bool more = t.valid(c);
+            for (int64_t k : want) {
+                assert(more && t.key(c) == k);
+                more = t.next(c);
+            }
+            assert(!more);
+        };
+        assert(!t.erase(r, 0));
+        for (int k = 1; k <= n; k += 3) { assert(t.erase(r, k)); want.erase(k); }
+        verify();
+        assert(t.erase_range(r, 1000, 50000) == 32667);
+        for (int k = 1000; k <= 50000; ++k) want.erase(k);
+        verify();
+        // deleting under a cursor keeps the scan on track
+        auto c = t.open(r);
+        t.seek(c, 0);
+        while (t.valid(c)) {
+            if (t.key(c) % 2 == 0) { want.erase(t.key(c)); t.erase(c); }
+            if (!t.next(c)) break;
+        }
+        verify();
+        uint32_t freed = pager.free_count();
+        assert(freed > 0);
+        for (int k = n + 1; k <= n + 2000; ++k) { t.insert(r, {k}, std::string(40, 'f')); want.insert(k); }
+        assert(pager.free_count() < freed);
+        verify();
+        assert(t.erase_range(r, std::numeric_limits<int64_t>::min(),
+                             std::numeric_limits<int64_t>::max()) == want.size());
+        want.clear();
+        verify();
+        t.insert(r, {5}, "again");
+        want.insert(5);
+        verify();
+        std::remove(del_path);
+    }
+
+    // cursors hand out views into their pinned leaf, valid until they move
+    {
+        const char* zc_path = "btree_zero_copy_test.db";
+        std::remove(zc_path);
+        auto st = std::make_unique<tinydb::FileStorage>(zc_path);
+        tinydb::Pager pager(std::move(st), 16);
+        tinydb::BTree t(pager);
+        uint32_t r = t.create_table();
+        for (int k = 1; k <= 5000; ++k) t.insert(r, {k}, "row" + std::to_string(k));
+        t.insert(r, {6000}, std::string(9000, 'o'));
+        pager.flush();
+        size_t base = pager.pinned();
+        {
+            auto c = t.open(r);
+            assert(t.seek(c, 10));
+            assert(pager.pinned() == base + 1);
+            std::string_view v = t.read_payload(c);
+            const char* page_bytes = reinterpret_cast<const char*>(c.page->data.data());
+            assert(v.data() >= page_bytes && v.data() < page_bytes + tinydb::PAGE_SIZE);
+            // churn the pool with another cursor; the pinned view survives
+            auto other = t.open(r);
+            t.seek(other, 1);
+            while (t.next(other)) (void)t.read_payload(other);
+            assert(v == "row10");
+            assert(pager.pinned() == base + 2);
+            assert(t.seek(c, 6000) && t.read_payload(c) == std::string(9000, 'o'));
+            assert(t.read_payload(c, 3) == "ooo");
+        }
+        assert(pager.pinned() == base);
+        std::remove(zc_path);
+    }
+
+    // on a mapped file, cursors read clean leaves from the mapping without
+    // taking frames, and pin a leaf once it is resident
+    {
+        const char* mc_path = "btree_mapped_cursor_test.db";
+        std::remove(mc_path);
+        uint32_t mc_root = 0;
+        {
+            tinydb::Pager pager(std::make_unique<tinydb::FileStorage>(mc_path), 16);
+            tinydb::BTree t(pager);
+            mc_root = t.create_table();
+            for (int k = 1; k <= 5000; ++k) t.insert(mc_root, {k}, "row" + std::to_string(k));
+            pager.flush();
+        }
+        tinydb::Pager pager(std::make_unique<tinydb::MmapStorage>(mc_path), 16);
+        tinydb::BTree t(pager);
+        size_t base = pager.pinned(), resident = pager.resident();
+        auto c = t.open(mc_root);
+        assert(t.seek(c, 1));
+        int k = 1;
+        do {
+            assert(t.key(c) == k && t.read_payload(c) == "row" + std::to_string(k));
+            ++k;
+        } while (t.next(c));
+        assert(k == 5001 && pager.pinned() == base && !c.page);
+        assert(pager.resident() == resident);
+        assert(t.seek(c, 42) && !c.page);
+        t.insert(mc_root, {42}, "new");
+        assert(t.read_payload(c) == "new" && c.page && pager.pinned() == base + 1);
+        std::remove(mc_path);
+    }
+
+    // index trees: variable-length keys kept in memcmp order through
+    // splits, erases that empty and free whole leaves, and seeks between
+    // keys
+    {
+        const char* ix_path = "btree_index_test.db";
+        std::remove(ix_path);
+        tinydb::Pager pager(std::make_unique<tinydb::FileStorage>(ix_path), 32);
+        tinydb::BTree t(pager);
+        uint32_t r = t.create_index();
+        std::mt19937 rng(7);
+        std::set<std::string> want;
+        for (int i = 0; i < 6000; ++i) {
+            size_t len = i % 97 == 0 ? tinydb::MAX_INDEX_KEY : 1 + rng() % 40;
+            std::string k(len, '\0');
+            for (auto& ch : k) ch = static_cast<char>(rng() % 4 == 0 ? 0 : 0xF0 + rng() % 16);
+            assert(t.index_insert(r, k) == want.insert(k).second);
+        }
+        assert(!t.index_insert(r, *want.begin()));
+        assert(t.index_check(r));
+        auto scan = [&] {
+            std::vector<std::string> got;
+            auto c = t.open(r);
+            for (bool more = t.index_seek(c, ""); more; more = t.index_next(c))
+                got.emplace_back(t.index_key(c));
+            return got;
+        };
+        assert(scan() == std::vector<std::string>(want.begin(), want.end()));
+        // drop every key below a midpoint and every other one above it
+        std::string mid = *std::next(want.begin(), static_cast<long>(want.size() / 2));
+        size_t n = 0;
+        for (auto it = want.begin(); it != want.end();) {
+            if (*it < mid || n++ % 2 == 0) {
+                assert(t.index_erase(r, *it));
+                it = want.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        assert(!t.index_erase(r, "missing"));
+        assert(t.index_check(r));
+        assert(scan() == std::vector<std::string>(want.begin(), want.end()));
+        auto c = t.open(r);
+        assert(t.index_seek(c, "") && t.index_key(c) == *want.begin());
+        std::string between = *want.begin() + std::string(1, '\0');
+        assert(t.index_seek(c, between) && t.index_key(c) == *want.upper_bound(between));
+        assert(!t.index_seek(c, std::string(3, '\xFF')) && t.index_key(c).empty());
+        // emptied leaves are freed: erasing every key leaves the root alone,
+        // and a refill reuses the pages
+        c = t.open(r);
+        uint32_t freed = pager.free_count();
+        assert(freed > 0);
+        for (auto& k : want) assert(t.index_erase(r, k));
+        assert(t.index_check(r) && !t.index_seek(c, ""));
+        freed = pager.free_count();
+        for (auto& k : want) assert(t.index_insert(r, k));
+        assert(pager.free_count() < freed && t.index_check(r) && scan().size() == want.size());
+        for (auto it = want.rbegin(); it != want.rend(); ++it) assert(t.index_erase(r, *it));
+        assert(pager.free_count() == freed && t.index_check(r));
+        std::remove(ix_path);
+    }
     return 0;
 }
-
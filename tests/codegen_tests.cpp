@@ -6,6 +6,7 @@
 #include "tinydb/btree.hpp"
 #include <cassert>
 #include <memory>
+#include <string>
 
 int main() {
     using namespace tinydb;
@@ -15,10 +16,20 @@ int main() {
     cat.create_table("t");
     auto ast = parse("SELECT * FROM t");
     auto prog = codegen(*ast, cat);
-    assert(!prog.empty());
+    assert(!prog.code.empty() && prog.code.back().op == Op::Halt);
+    assert(prog.ncursors == 1 && prog.nregs >= 0);
     auto ast2 = parse("INSERT INTO t VALUES(1,'x')");
     auto prog2 = codegen(*ast2, cat);
-    assert(prog2.size() >= 2);
+    assert(prog2.code.size() >= 2);
+    // the literal record lives in the constant pool, loaded into a register
+    assert(prog2.consts.size() == 1 && prog2.code[0].op == Op::Constant);
+    assert(prog2.nregs == 1 && prog2.ncursors == 0);
+    cat.create_table("w", {"a", "b", "c"});
+    auto upd = codegen(*parse("UPDATE w SET b = 'long text', c = 5000000000 WHERE rowid < ?"), cat);
+    assert(upd.code.back().op == Op::Halt);
+    assert(upd.nregs == 4 + 3); // lo, hi, rowid, record, then the row
+    assert(upd.consts.size() == 2);
+    for (auto& in : upd.code) assert(std::string(op_name(in.op)) != "");
     pager.flush();
     return 0;
 }
@@ -5,8 +5,38 @@
 #include "tinydb/pager.hpp"
 #include "tinydb/btree.hpp"
 #include "tinydb/vm.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <cstring>
 #include <memory>
+#include <string>
+
+namespace {
+// Counts page reads, to see which parts of a tree a query touched.
+class CountingStorage : public tinydb::FileStorage {
+public:
+    using FileStorage::FileStorage;
+    void read(uint64_t off, void* buf, size_t n) override { ++reads; FileStorage::read(off, buf, n); }
+    size_t reads{0};
+};
+
+// Temporary storage for sorts, kept in memory.
+class MemStorage : public tinydb::IStorage {
+public:
+    explicit MemStorage(size_t& written) : written_(written) {}
+    void read(uint64_t off, void* buf, size_t n) override { std::memcpy(buf, bytes_.data() + off, n); }
+    void write(uint64_t off, const void* buf, size_t n) override {
+        if (bytes_.size() < off + n) bytes_.resize(off + n);
+        std::memcpy(&bytes_[off], buf, n);
+        written_ += n;
+    }
+    void sync() override {}
+private:
+    std::string bytes_;
+    size_t& written_;
+};
+} // namespace
 
 int main() {
     using namespace tinydb;
@@ -22,5 +52,443 @@ int main() {
     assert(vm.results()[0][0].i == 2);
     assert(vm.results()[0][1].s == "b");
     pager.flush();
+
+    // rolled-back inserts and tables disappear; committed ones stay
+    assert(vm.run(codegen(*parse("COMMIT"), cat)) != 0);
+    assert(vm.run(codegen(*parse("BEGIN"), cat)) == 0);
+    assert(vm.run(codegen(*parse("BEGIN"), cat)) != 0);
+    for (int i = 0; i < 2000; ++i)
+        vm.run(codegen(*parse("INSERT INTO t VALUES(9,'rolled back')"), cat));
+    cat.create_table("gone");
+    assert(vm.run(codegen(*parse("ROLLBACK"), cat)) == 0);
+    assert(!cat.lookup("gone") && cat.lookup("t"));
+    vm.run(codegen(*parse("SELECT * FROM t"), cat));
+    size_t committed = vm.results().size();
+    assert(vm.results().back()[1].s != "rolled back");
+    assert(bt.check(cat.lookup("t")->root));
+    vm.run(codegen(*parse("BEGIN"), cat));
+    vm.run(codegen(*parse("INSERT INTO t VALUES(3,'c')"), cat));
+    vm.run(codegen(*parse("COMMIT"), cat));
+    vm.run(codegen(*parse("SELECT * FROM t"), cat));
+    assert(vm.results().size() == committed + 1);
+    assert(vm.results().back()[1].s == "c");
+
+    // rows larger than a page round-trip through overflow pages
+    cat.create_table("docs");
+    std::string doc(20000, 'j');
+    vm.run(codegen(*parse("INSERT INTO docs VALUES(42,'" + doc + "')"), cat));
+    vm.run(codegen(*parse("SELECT * FROM docs"), cat));
+    assert(vm.results().size() == 1 && vm.results()[0][1].s == doc);
+    vm.run(codegen(*parse("SELECT id FROM docs"), cat));
+    assert(vm.results().size() == 1 && vm.results()[0].size() == 1);
+    assert(vm.results()[0][0].i == 42);
+    assert(bt.check(cat.lookup("docs")->root));
+
+    // DELETE and UPDATE by rowid range
+    cat.create_table("log", {"id", "msg"});
+    for (int i = 1; i <= 3000; ++i)
+        vm.run(codegen(*parse("INSERT INTO log VALUES(" + std::to_string(i) + ",'m')"), cat));
+    vm.run(codegen(*parse("DELETE FROM log WHERE rowid <= 2000"), cat));
+    vm.run(codegen(*parse("UPDATE log SET msg = 'changed' WHERE rowid BETWEEN 2991 AND 2995"), cat));
+    vm.run(codegen(*parse("DELETE FROM log WHERE rowid = 2500"), cat));
+    vm.run(codegen(*parse("SELECT * FROM log"), cat));
+    assert(vm.results().size() == 999);
+    assert(vm.results().front()[0].i == 2001);
+    for (auto& row : vm.results()) {
+        assert(row[0].i != 2500);
+        bool changed = row[0].i >= 2991 && row[0].i <= 2995;
+        assert(row[1].s == (changed ? "changed" : "m"));
+    }
+    vm.run(codegen(*parse("UPDATE log SET nosuch = 1"), cat));
+    vm.run(codegen(*parse("SELECT * FROM log WHERE rowid=2500"), cat));
+    assert(vm.results().empty());
+    vm.run(codegen(*parse("DELETE FROM log"), cat));
+    vm.run(codegen(*parse("SELECT * FROM log"), cat));
+    assert(vm.results().empty());
+    assert(bt.check(cat.lookup("log")->root));
+
+    // NULL, negative and REAL literals, inserted and set by UPDATE
+    cat.create_table("m", {"a", "b", "c"});
+    vm.run(codegen(*parse("INSERT INTO m VALUES(-5, 2.5, NULL)"), cat));
+    vm.run(codegen(*parse("UPDATE m SET a = null, c = -0.25"), cat));
+    vm.run(codegen(*parse("SELECT * FROM m"), cat));
+    assert(vm.results().size() == 1);
+    auto& mrow = vm.results()[0];
+    assert(mrow[0].tag == ColTag::NIL);
+    assert(mrow[1].tag == ColTag::REAL && mrow[1].r == 2.5);
+    assert(mrow[2].tag == ColTag::REAL && mrow[2].r == -0.25);
+
+    // WHERE on any column: comparisons of every type, AND/OR, NULLs that
+    // match nothing, and named projections in any order
+    cat.create_table("p", {"id", "name", "score"});
+    for (int i = 1; i <= 1000; ++i) {
+        std::string score = i % 7 == 0 ? "NULL" : std::to_string(i / 2) + ".5";
+        vm.run(codegen(*parse("INSERT INTO p VALUES(" + std::to_string(i) + ", 'n" +
+                              std::to_string(i % 10) + "', " + score + ")"), cat));
+    }
+    auto ids = [&](const std::string& where) {
+        vm.run(codegen(*parse("SELECT id FROM p WHERE " + where), cat));
+        std::vector<int64_t> out;
+        for (auto& row : vm.results()) out.push_back(row[0].i);
+        return out;
+    };
+    std::vector<int64_t> want;
+    for (int i = 801; i <= 1000; ++i) if (i % 10 == 3 && i % 7 != 0) want.push_back(i);
+    assert(ids("score > 400 AND name = 'n3'") == want);
+    assert(ids("id < 3 OR id BETWEEN 998 AND 1000 OR name = 'n1' AND id > 990") ==
+           (std::vector<int64_t>{1, 2, 991, 998, 999, 1000}));
+    assert(ids("(id = 5 OR id = 6) AND (name = 'n6' OR name = 'n7')") == std::vector<int64_t>{6});
+    assert(ids("score = NULL").empty() && ids("score != 1.5").size() == 1000 - 142 - 2);
+    assert(ids("name >= 'n9' AND id <= 30") == (std::vector<int64_t>{9, 19, 29}));
+    assert(ids("score < id AND rowid <> 2 AND rowid < 5") == (std::vector<int64_t>{1, 3, 4}));
+    // integer literals past the INT range are REAL
+    assert(ids("rowid > 99999999999999999999").empty() && ids("id < -99999999999999999999").empty());
+    assert(ids("rowid < 99999999999999999999 AND id >= 999") == (std::vector<int64_t>{999, 1000}));
+    cat.create_table("wide", {"v"});
+    vm.run(codegen(*parse("INSERT INTO wide VALUES(-99999999999999999999)"), cat));
+    vm.run(codegen(*parse("SELECT v FROM wide"), cat));
+    assert(vm.results().size() == 1 && vm.results()[0][0].tag == ColTag::REAL && vm.results()[0][0].r == -1e20);
+    vm.run(codegen(*parse("SELECT score, id FROM p WHERE rowid = 3"), cat));
+    assert(vm.results().size() == 1 && vm.results()[0][0].r == 1.5 && vm.results()[0][1].i == 3);
+    vm.run(codegen(*parse("SELECT name, id FROM p"), cat));
+    assert(vm.results().size() == 1000 && vm.results()[41][0].s == "n2" && vm.results()[41][1].i == 42);
+    vm.run(codegen(*parse("SELECT * FROM p WHERE nosuch = 1"), cat));
+    assert(vm.results().empty());
+    vm.run(codegen(*parse("UPDATE p SET name = 'low' WHERE score < 10 AND rowid > 5"), cat));
+    vm.run(codegen(*parse("DELETE FROM p WHERE name = 'n0' OR score = 2.5"), cat));
+    assert(ids("name = 'low'") == (std::vector<int64_t>{6, 8, 9, 10, 11, 12, 13, 15, 16, 17, 18, 19}));
+    assert(ids("id <= 10") == (std::vector<int64_t>{1, 2, 3, 6, 7, 8, 9, 10}));
+    assert(bt.check(cat.lookup("p")->root));
+
+    // secondary indexes answer the same as full scans, kept up to date by
+    // INSERT, UPDATE and DELETE; a covering one never opens the table
+    {
+        uint32_t ix = cat.create_index("p_name_score", "p", {"name", "score"});
+        assert(ix != 0 && cat.create_index("p_name_score", "p", {"id"}) == 0);
+        assert(cat.create_index("p_bad", "p", {"nosuch"}) == 0 && cat.create_index("p_bad", "q", {"id"}) == 0);
+        auto uses_index = [&](const std::string& sql, bool covering) {
+            auto prog = codegen(*parse(sql), cat);
+            bool index = false, table = false;
+            for (auto& in : prog.code) {
+                index |= in.op == Op::OpenRead && in.p1 == 1;
+                table |= in.op == Op::OpenRead && in.p1 == 0;
+            }
+            return index && table != covering;
+        };
+        // the same terms OR'd with a false one cannot use the index
+        auto check = [&](const std::string& where) {
+            auto got = ids(where);
+            std::sort(got.begin(), got.end());
+            assert(got == ids("(" + where + ") OR id = -1"));
+            return got.size();
+        };
+        auto verify = [&] {
+            assert(check("name = 'n3'") == check("name = 'n3' AND score >= 0") + 14);
+            assert(check("name = 'n5' AND score > 100.5 AND score <= 300") ==
+                   check("name = 'n5' AND score >= 100.5 AND score < 300"));
+            assert(check("name > 'n7'") > 0 && check("name < 'n2' AND id > 500") > 0);
+            check("name = 'low' AND score BETWEEN 3 AND 6");
+            check("name = NULL");
+            check("name >= 'n8' AND name < 'n9' AND score < 50");
+            assert(bt.index_check(ix));
+        };
+        assert(uses_index("SELECT id FROM p WHERE name = 'n3'", false));
+        assert(uses_index("SELECT name, score FROM p WHERE name = 'n3' AND rowid <> 3", true));
+        assert(!uses_index("SELECT id FROM p WHERE score = 3.5", false));
+        verify();
+        assert(check("name = 'n5' AND score > 100.5 AND score <= 300") == 34);
+        vm.run(codegen(*parse("SELECT score, name FROM p WHERE name = 'n4' AND score < 20"), cat));
+        assert(vm.results().size() == 2 && vm.results()[0][1].s == "n4");
+        assert(vm.results()[0][0].r == 12.5 && vm.results()[1][0].r == 17.5);
+        for (int i = 0; i < 300; ++i)
+            vm.run(codegen(*parse("INSERT INTO p VALUES(" + std::to_string(2000 + i) + ", 'n" +
+                                  std::to_string(i % 4) + "', " + std::to_string(i) + ")"), cat));
+        vm.run(codegen(*parse("UPDATE p SET name = 'n5', score = 150 WHERE name = 'n1' AND id > 2100"), cat));
+        vm.run(codegen(*parse("DELETE FROM p WHERE score > 280 AND score < 400"), cat));
+        verify();
+        assert(check("name = 'n5' AND score > 100.5 AND score <= 300") == 34 - 3 + 50);
+        // an entry too long for the index fails the INSERT before any change
+        std::string huge(2000, 'h');
+        assert(vm.run(codegen(*parse("INSERT INTO p VALUES(1, '" + huge + "', 0)"), cat)) != 0);
+        assert(ids("rowid > 0").size() == check("id > 0 OR id <= 0"));
+        // an UPDATE whose new entry is too long for one row only fails
+        // before any row changes
+        cat.create_table("w", {"a", "b"});
+        uint32_t wix = cat.create_index("w_ab", "w", {"a", "b"});
+        vm.run(codegen(*parse("INSERT INTO w VALUES(1, 'x')"), cat));
+        vm.run(codegen(*parse("INSERT INTO w VALUES(1.5, 'y')"), cat));
+        std::string wide(975, 'w');
+        assert(vm.run(codegen(*parse("UPDATE w SET b = '" + wide + "'"), cat)) != 0);
+        vm.run(codegen(*parse("SELECT b FROM w"), cat));
+        assert(vm.results().size() == 2 && vm.results()[0][0].s == "x" && vm.results()[1][0].s == "y");
+        assert(bt.index_check(wix));
+        assert(vm.run(codegen(*parse("UPDATE w SET b = '" + wide.substr(0, 900) + "'"), cat)) == 0);
+        vm.run(codegen(*parse("SELECT b FROM w WHERE a >= 1"), cat));
+        assert(vm.results().size() == 2 && vm.results()[1][0].s.size() == 900);
+        // the index is part of the schema
+        Catalog again(pager, bt);
+        assert(again.lookup("p")->indexes.size() == 1 && again.lookup("p")->indexes[0].root == ix);
+        // a stored index on a column the table lacks is left out
+        uint32_t schema;
+        std::memcpy(&schema, pager.get(HEADER_PGNO).data.data() + 4, 4); // little-endian host
+        std::string bad("\x05\0\0\0\x01p_gone\0p\0name\0nosuch", 25);
+        bt.insert(schema, {1000}, bad);
+        Catalog stale(pager, bt);
+        assert(stale.lookup("p")->indexes.size() == 1 && stale.lookup("p")->indexes[0].root == ix);
+        assert(bt.erase(schema, 1000));
+    }
+
+    // aggregates over groups or the whole table: NULL arguments skipped,
+    // SUM exact over INTs and REAL once a REAL is added, groups in the
+    // order they first appear
+    {
+        cat.create_table("s", {"region", "qty", "price"});
+        std::vector<int64_t> rows(4), qty(4), priced(4), max_qty(4, -1);
+        std::vector<double> sum(4), lo(4, 1e9);
+        for (int i = 0; i < 3000; ++i) {
+            int r = (i * 7) % 4;
+            double price = i % 100 + 0.25;
+            vm.run(codegen(*parse("INSERT INTO s VALUES('r" + std::to_string(r) + "', " + std::to_string(i) + ", " +
+                                  (i % 5 == 0 ? "NULL" : std::to_string(price)) + ")"), cat));
+            ++rows[r];
+            qty[r] += i;
+            max_qty[r] = i;
+            if (i % 5 == 0) continue;
+            ++priced[r];
+            sum[r] += price;
+            lo[r] = std::min(lo[r], price);
+        }
+        // without WHERE the rows are folded in a leaf at a time
+        std::string items = "SELECT region, COUNT(*), SUM(qty), count(price), MIN(price), MAX(qty), AVG(price) FROM s";
+        auto grouped = codegen(*parse(items + " GROUP BY region"), cat);
+        assert(std::any_of(grouped.code.begin(), grouped.code.end(),
+                           [](const Instr& in) { return in.op == Op::BatchAggStep; }));
+        vm.run(codegen(*parse(items + " WHERE qty >= 0 GROUP BY region"), cat));
+        auto by_row = vm.results();
+        vm.run(grouped);
+        assert(vm.results().size() == 4);
+        int order[] = {0, 3, 2, 1};
+        for (int g = 0; g < 4; ++g) {
+            const auto& row = vm.results()[g];
+            int r = order[g];
+            assert(row.size() == 7 && row[0].s == "r" + std::to_string(r));
+            assert(row[1].i == rows[r] && row[2].tag == ColTag::INT && row[2].i == qty[r]);
+            assert(row[3].i == priced[r] && row[4].r == lo[r] && row[5].i == max_qty[r]);
+            assert(row[6].tag == ColTag::REAL && row[6].r == sum[r] / static_cast<double>(priced[r]));
+            for (size_t c = 0; c < row.size(); ++c)
+                assert(compare_values(row[c], by_row[g][c]) == 0 && row[c].tag == by_row[g][c].tag);
+        }
+        vm.run(codegen(*parse("SELECT COUNT(*) FROM s LIMIT 2"), cat));
+        assert(vm.results().size() == 1 && vm.results()[0][0].i == 3000);
+        vm.run(codegen(*parse("SELECT MAX(price), COUNT(*), region FROM s GROUP BY region"), cat));
+        assert(vm.results().size() == 4 && vm.results()[0][2].s == "r0" && vm.results()[0][1].i == rows[0]);
+        // COUNT(*) of a whole table only counts cells
+        auto count_all = codegen(*parse("SELECT COUNT(*) FROM s"), cat);
+        assert(count_all.code[0].op == Op::Count);
+        vm.run(count_all);
+        assert(vm.results().size() == 1 && vm.results()[0][0].i == 3000);
+        vm.run(codegen(*parse("SELECT MIN(region), COUNT(*), SUM(price) FROM s WHERE qty >= 2990"), cat));
+        assert(vm.results().size() == 1 && vm.results()[0][0].s == "r0" && vm.results()[0][1].i == 10);
+        assert(vm.results()[0][2].tag == ColTag::REAL && vm.results()[0][2].r == 762.0);
+        // no rows: one row of counts and NULLs, but no groups
+        vm.run(codegen(*parse("SELECT COUNT(*), SUM(qty), AVG(qty), MAX(region), COUNT(qty) FROM s WHERE qty < 0"), cat));
+        assert(vm.results().size() == 1 && vm.results()[0][0].i == 0 && vm.results()[0][4].i == 0);
+        for (int c = 1; c < 4; ++c) assert(vm.results()[0][c].tag == ColTag::NIL);
+        vm.run(codegen(*parse("SELECT region, COUNT(*) FROM s WHERE qty < 0 GROUP BY region"), cat));
+        assert(vm.results().empty());
+        // GROUP BY alone lists each group once; an index can feed it
+        assert(cat.create_index("s_region", "s", {"region"}) != 0);
+        auto by_index = codegen(*parse("SELECT region, COUNT(*) FROM s WHERE region >= 'r2' GROUP BY region"), cat);
+        assert(std::none_of(by_index.code.begin(), by_index.code.end(),
+                            [](const Instr& in) { return in.op == Op::OpenRead && in.p1 == 0; }));
+        vm.run(by_index);
+        assert(vm.results().size() == 2 && vm.results()[0][0].s == "r2" && vm.results()[1][1].i == rows[3]);
+        vm.run(codegen(*parse("SELECT region FROM s WHERE qty < 6 GROUP BY region"), cat));
+        assert(vm.results().size() == 4 && vm.results()[1][0].s == "r3");
+        // INT and REAL keys that are equal share a group; an INT SUM too
+        // large for 64 bits fails the statement, as in SQLite, while AVG
+        // goes on as REAL
+        cat.create_table("kv", {"k", "v"});
+        for (const char* row : {"1, 9223372036854775807", "2, 3", "1.0, 1", "'1', NULL"})
+            vm.run(codegen(*parse(std::string("INSERT INTO kv VALUES(") + row + ")"), cat));
+        assert(vm.run(codegen(*parse("SELECT SUM(v), k, COUNT(v) FROM kv GROUP BY k"), cat)) != 0);
+        assert(vm.run(codegen(*parse("SELECT SUM(v) FROM kv"), cat)) != 0);
+        vm.run(codegen(*parse("SELECT SUM(v), k, COUNT(v), AVG(v) FROM kv WHERE k > 1 GROUP BY k"), cat));
+        assert(vm.results().size() == 2);
+        assert(vm.results()[0][0].tag == ColTag::INT && vm.results()[0][0].i == 3);
+        assert(vm.results()[1][1].s == "1" && vm.results()[1][0].tag == ColTag::NIL);
+        vm.run(codegen(*parse("SELECT AVG(v), k, COUNT(v) FROM kv GROUP BY k"), cat));
+        assert(vm.results().size() == 3);
+        assert(vm.results()[0][0].tag == ColTag::REAL && vm.results()[0][0].r == 4611686018427387904.0);
+        assert(vm.results()[0][1].tag == ColTag::INT && vm.results()[0][2].i == 2);
+        // a plain column must be grouped on
+        for (const char* bad : {"SELECT qty, COUNT(*) FROM s GROUP BY region", "SELECT * FROM s GROUP BY region",
+                                "SELECT SUM(nosuch) FROM s", "SELECT COUNT(*) FROM s GROUP BY nosuch"}) {
+            vm.run(codegen(*parse(bad), cat));
+            assert(vm.results().empty());
+        }
+    }
+
+    // ORDER BY any column or position, ASC or DESC with NULLs first, ties
+    // in rowid order; LIMIT and OFFSET with or without it
+    {
+        cat.create_table("o", {"a", "b", "c", "d"});
+        std::string pad(250, 'd'); // so that the rows outgrow a small budget
+        struct Row { int64_t a; std::string b; bool null; double c; };
+        std::vector<Row> rows;
+        for (int i = 0; i < 5000; ++i) {
+            Row r{(i * 7919) % 1000, "b" + std::to_string(i % 37), i % 11 == 0, (i % 101) * 0.5};
+            vm.run(codegen(*parse("INSERT INTO o VALUES(" + std::to_string(r.a) + ", '" + r.b + "', " +
+                                  (r.null ? "NULL" : std::to_string(r.c)) + ", '" + pad + "')"), cat));
+            rows.push_back(r);
+        }
+        auto by_b_a_desc = [](const Row& x, const Row& y) { return x.b != y.b ? x.b < y.b : x.a > y.a; };
+        std::vector<Row> want = rows;
+        std::stable_sort(want.begin(), want.end(), by_b_a_desc);
+        auto same = [&](const std::vector<Row>& expect, size_t from, size_t n) {
+            assert(vm.results().size() == n);
+            for (size_t k = 0; k < n; ++k) {
+                const auto& got = vm.results()[k];
+                const Row& r = expect[from + k];
+                assert(got[0].i == r.a && got[1].s == r.b);
+                assert(r.null ? got[2].tag == ColTag::NIL : got[2].r == r.c);
+            }
+        };
+        vm.run(codegen(*parse("SELECT * FROM o ORDER BY b, a DESC"), cat));
+        same(want, 0, rows.size());
+        vm.run(codegen(*parse("SELECT a, b, c FROM o WHERE a < 500 ORDER BY 2 ASC, a desc LIMIT 10 OFFSET 5"), cat));
+        std::vector<Row> low;
+        for (auto& r : want) if (r.a < 500) low.push_back(r);
+        same(low, 5, 10);
+        vm.run(codegen(*parse("SELECT c, a FROM o ORDER BY c DESC LIMIT 2, 3"), cat));
+        assert(vm.results().size() == 3 && vm.results()[0][0].r == 50.0 && vm.results()[2][0].r == 50.0);
+        vm.run(codegen(*parse("SELECT c FROM o ORDER BY c LIMIT 500"), cat));
+        assert(vm.results()[454][0].tag == ColTag::NIL && vm.results()[455][0].r == 0.0);
+        // without ORDER BY the rows come in rowid order, as with ORDER BY rowid
+        vm.run(codegen(*parse("SELECT a, b, c FROM o LIMIT 4 OFFSET 2"), cat));
+        same(rows, 2, 4);
+        auto by_rowid = codegen(*parse("SELECT a, b, c FROM o WHERE a >= 0 ORDER BY rowid LIMIT ?"), cat);
+        assert(std::none_of(by_rowid.code.begin(), by_rowid.code.end(),
+                            [](const Instr& in) { return in.op == Op::SorterOpen; }));
+        std::vector<Value> lim{Value{ColTag::INT, 3, {}}};
+        vm.run(by_rowid, &lim);
+        same(rows, 0, 3);
+        lim[0].i = -1; // no limit
+        vm.run(by_rowid, &lim);
+        same(rows, 0, rows.size());
+        vm.run(codegen(*parse("SELECT * FROM o ORDER BY a LIMIT 0"), cat));
+        assert(vm.results().empty());
+        vm.run(codegen(*parse("SELECT a FROM o ORDER BY nosuch"), cat));
+        assert(vm.results().empty());
+        for (const char* sql : {"SELECT a FROM o ORDER BY 2", "SELECT * FROM o ORDER BY 5", "SELECT * FROM o ORDER BY 0"}) {
+            vm.run(codegen(*parse(sql), cat));
+            assert(vm.results().empty());
+        }
+        vm.run(codegen(*parse("SELECT * FROM o ORDER BY 3 DESC LIMIT 1"), cat));
+        assert(vm.results().size() == 1 && vm.results()[0][2].r == 50.0);
+        vm.run(codegen(*parse("SELECT b, COUNT(*), MAX(a) FROM o GROUP BY b ORDER BY 2 DESC, b LIMIT 3"), cat));
+        assert(vm.results().size() == 3 && vm.results()[0][0].s == "b0" && vm.results()[0][1].i == 136);
+        assert(vm.results()[1][0].s == "b1" && vm.results()[2][0].s == "b2" && vm.results()[2][1].i == 136);
+
+        // past the memory budget, sorted runs go to temporary storage and
+        // are merged back, several passes deep here; a LIMIT that fits
+        // the budget sorts in a heap without spilling
+        size_t written = 0;
+        vm.set_sort_memory(4096); // taken as MIN_SORT_MEMORY
+        vm.set_temp_storage([&written] { return std::make_unique<MemStorage>(written); });
+        size_t runs = vm.sort_runs();
+        vm.run(codegen(*parse("SELECT * FROM o ORDER BY b, a DESC"), cat));
+        same(want, 0, rows.size());
+        assert(vm.sort_runs() > runs + 4 && written > 2 * 5000 * pad.size());
+        runs = vm.sort_runs();
+        vm.run(codegen(*parse("SELECT a, b, c FROM o WHERE a < 500 ORDER BY b, a DESC LIMIT 10 OFFSET 5"), cat));
+        same(low, 5, 10);
+        assert(vm.sort_runs() == runs);
+        vm.run(codegen(*parse("SELECT * FROM o ORDER BY b, a DESC LIMIT 1000"), cat));
+        same(want, 0, 1000);
+        assert(vm.sort_runs() > runs);
+        // and by default to files that are gone once the sort is
+        VM files(bt, cat);
+        files.set_sort_memory(8192);
+        files.run(codegen(*parse("SELECT b, a, c, d FROM o ORDER BY 1, 2 DESC"), cat));
+        assert(files.results().size() == rows.size() && files.sort_runs() > 1);
+        for (size_t k = 0; k < rows.size(); ++k)
+            assert(files.results()[k][0].s == want[k].b && files.results()[k][1].i == want[k].a);
+        vm.set_sort_memory(DEFAULT_SORT_MEMORY);
+    }
+
+    // rowid ranges seek to their first leaf and stop after the last one
+    {
+        const char* path = "integration_range.db";
+        std::remove(path);
+        {
+            Pager wp(std::make_unique<FileStorage>(path));
+            BTree wbt(wp);
+            Catalog wcat(wp, wbt);
+            wcat.create_table("big", {"v"});
+            VM wvm(wbt, wcat);
+            auto ins = codegen(*parse("INSERT INTO big VALUES(?)"), wcat);
+            std::vector<Value> params(1);
+            for (int i = 0; i < 50000; ++i) {
+                params[0] = Value{ColTag::INT, i, {}};
+                wvm.run(ins, &params);
+            }
+            wp.flush();
+        }
+        auto st = std::make_unique<CountingStorage>(path);
+        CountingStorage* counter = st.get();
+        Pager rp(std::move(st));
+        BTree rbt(rp);
+        Catalog rcat(rp, rbt);
+        VM rvm(rbt, rcat);
+        size_t before = counter->reads;
+        rvm.run(codegen(*parse("SELECT v FROM big WHERE rowid BETWEEN 30000 AND 30400 AND v >= 30010"), rcat));
+        assert(rvm.results().size() == 390 && rvm.results()[0][0].i == 30010);
+        size_t range_reads = counter->reads - before;
+        rvm.run(codegen(*parse("SELECT v FROM big WHERE v < 0"), rcat));
+        assert(rvm.results().empty());
+        assert(range_reads * 20 < counter->reads - before);
+        std::remove(path);
+    }
+    // an index seek reads only the leaves inside its bounds; a covering
+    // scan reads no table pages at all
+    {
+        const char* path = "integration_index.db";
+        std::remove(path);
+        {
+            Pager wp(std::make_unique<FileStorage>(path));
+            BTree wbt(wp);
+            Catalog wcat(wp, wbt);
+            wcat.create_table("big", {"v", "w"});
+            assert(wcat.create_index("big_v", "big", {"v"}) != 0);
+            VM wvm(wbt, wcat);
+            auto ins = codegen(*parse("INSERT INTO big VALUES(?, ?)"), wcat);
+            std::vector<Value> params(2);
+            for (int i = 0; i < 20000; ++i) {
+                params[0] = Value{ColTag::INT, (i * 7919) % 20000, {}};
+                params[1] = Value{ColTag::TEXT, 0, "w" + std::to_string(i)};
+                wvm.run(ins, &params);
+            }
+            wp.flush();
+        }
+        auto st = std::make_unique<CountingStorage>(path);
+        CountingStorage* counter = st.get();
+        Pager rp(std::move(st));
+        BTree rbt(rp);
+        Catalog rcat(rp, rbt);
+        VM rvm(rbt, rcat);
+        size_t before = counter->reads;
+        rvm.run(codegen(*parse("SELECT v FROM big WHERE v BETWEEN 12000 AND 12400"), rcat));
+        assert(rvm.results().size() == 401);
+        for (int64_t i = 0; i < 401; ++i) assert(rvm.results()[i][0].i == 12000 + i);
+        size_t covering_reads = counter->reads - before;
+        rvm.run(codegen(*parse("SELECT w FROM big WHERE v = 7919"), rcat));
+        assert(rvm.results().size() == 1 && rvm.results()[0][0].s == "w1");
+        before = counter->reads;
+        rvm.run(codegen(*parse("SELECT v FROM big WHERE w = 'none'"), rcat));
+        assert(rvm.results().empty());
+        assert(covering_reads * 20 < counter->reads - before);
+        std::remove(path);
+    }
     return 0;
 }
@@ -4,6 +4,8 @@
 #include <cstdio>
 #include <cstring>
 #include <memory>
+#include <stdexcept>
+#include <vector>
 
 int main() {
     const char* path = "pager_test.db";
@@ -27,5 +29,201 @@ int main() {
         assert(std::memcmp(buf, "hello pager", 12) == 0);
     }
     std::remove(path);
+
+    // bounded pool: dirty victims are written back and re-read on demand
+    const char* pool_path = "pager_pool_test.db";
+    std::remove(pool_path);
+    {
+        auto st = std::make_unique<tinydb::FileStorage>(pool_path);
+        tinydb::Pager pager(std::move(st), 16);
+        uint32_t first = 0;
+        for (uint32_t i = 0; i < 200; ++i) {
+            uint32_t no = pager.alloc();
+            if (i == 0) first = no;
+            auto& pg = pager.get(no);
+            std::memcpy(pg.data.data(), &no, sizeof(no));
+            pager.mark_dirty(pg);
+            assert(pager.resident() <= pager.capacity());
+        }
+        // a pinned page survives a full scan of cold pages
+        tinydb::PageRef held = pager.acquire(first);
+        for (uint32_t no = first + 1; no < first + 200; ++no) {
+            auto& pg = pager.get(no);
+            uint32_t v = 0;
+            std::memcpy(&v, pg.data.data(), sizeof(v));
+            assert(v == no);
+        }
+        assert(held->no == first);
+        held.reset();
+        // every frame pinned: further loads must fail loudly
+        std::vector<tinydb::PageRef> pins;
+        bool exhausted = false;
+        try {
+            for (uint32_t no = first; no < first + 200; ++no) pins.push_back(pager.acquire(no));
+        } catch (const std::runtime_error&) {
+            exhausted = true;
+        }
+        assert(exhausted);
+        pins.clear();
+        pager.flush();
+    }
+    {
+        auto st = std::make_unique<tinydb::FileStorage>(pool_path);
+        tinydb::Pager pager(std::move(st), 16);
+        for (uint32_t no = 2; no < 202; ++no) {
+            auto& pg = pager.get(no);
+            uint32_t v = 0;
+            std::memcpy(&v, pg.data.data(), sizeof(v));
+            assert(v == no);
+        }
+    }
+    std::remove(pool_path);
+
+    // memory-mapped storage: zero-copy views survive file growth
+    const char* map_path = "pager_mmap_test.db";
+    std::remove(map_path);
+    {
+        tinydb::MmapStorage st(map_path);
+        uint8_t page[tinydb::PAGE_SIZE];
+        std::memset(page, 7, sizeof(page));
+        st.write(0, page, sizeof(page));
+        const uint8_t* v = st.view(0, sizeof(page));
+        assert(v && v[0] == 7 && v[tinydb::PAGE_SIZE - 1] == 7);
+        assert(!st.view(tinydb::PAGE_SIZE, sizeof(page)));
+        for (uint64_t i = 1; i < 1024; ++i) st.write(i * tinydb::PAGE_SIZE, page, sizeof(page));
+        assert(v[0] == 7);
+        const uint8_t* far = st.view(1023ull * tinydb::PAGE_SIZE, sizeof(page));
+        assert(far && far[0] == 7);
+        uint8_t buf[16];
+        st.read(1024ull * tinydb::PAGE_SIZE - 8, buf, sizeof(buf));
+        assert(buf[0] == 7 && buf[15] == 0);
+    }
+    std::remove(map_path);
+    {
+        auto st = std::make_unique<tinydb::MmapStorage>(map_path);
+        tinydb::Pager pager(std::move(st), 16);
+        for (uint32_t i = 0; i < 100; ++i) {
+            uint32_t no = pager.alloc();
+            auto& pg = pager.get(no);
+            std::memcpy(pg.data.data(), &no, sizeof(no));
+            pager.mark_dirty(pg);
+        }
+        pager.flush();
+    }
+    {
+        auto st = std::make_unique<tinydb::MmapStorage>(map_path);
+        tinydb::Pager pager(std::move(st), 16);
+        for (uint32_t no = 2; no < 102; ++no) {
+            uint32_t v = 0;
+            std::memcpy(&v, pager.view(no), sizeof(v));
+            assert(v == no);
+        }
+        // reading through the mapping does not occupy buffer frames
+        assert(pager.resident() == 1);
+    }
+    std::remove(map_path);
+
+    // vectored writes, offsets past 4 GiB and short reads at end of file
+    const char* io_path = "pager_io_test.db";
+    std::remove(io_path);
+    {
+        tinydb::FileStorage st(io_path);
+        char a[5] = "aaaa", b[5] = "bbbb", c[5] = "cccc";
+        tinydb::IoSlice v[] = {{a, 4}, {b, 4}, {c, 4}};
+        st.writev(8, v, 3);
+        char out[24];
+        st.read(4, out, sizeof(out));
+        assert(std::memcmp(out, "\0\0\0\0aaaabbbbcccc", 16) == 0);
+        assert(out[16] == 0 && out[23] == 0);
+        const uint64_t big = 5ull << 30;
+        st.write(big, "far", 3);
+        char far[4]{};
+        st.read(big, far, 3);
+        assert(std::memcmp(far, "far", 3) == 0);
+    }
+    std::remove(io_path);
+
+    // rollback restores pages even after they were evicted mid-transaction
+    const char* tx_path = "pager_tx_test.db";
+    const char* tx_wal = "pager_tx_test.db-wal";
+    for (bool use_wal : {false, true}) {
+        std::remove(tx_path);
+        std::remove(tx_wal);
+        auto open = [&] {
+            std::unique_ptr<tinydb::IStorage> wal;
+            if (use_wal) wal = std::make_unique<tinydb::FileStorage>(tx_wal);
+            return std::make_unique<tinydb::Pager>(
+                std::make_unique<tinydb::FileStorage>(tx_path), 16, std::move(wal));
+        };
+        auto pager = open();
+        std::vector<uint32_t> pages;
+        for (int i = 0; i < 40; ++i) {
+            uint32_t no = pager->alloc();
+            auto& pg = pager->get(no);
+            pg.data[0] = 1;
+            pager->mark_dirty(pg);
+            pages.push_back(no);
+        }
+        pager->flush();
+        pager->begin();
+        assert(pager->in_transaction());
+        for (uint32_t no : pages) {
+            auto& pg = pager->get(no);
+            pg.data[0] = 2;
+            pager->mark_dirty(pg);
+        }
+        uint32_t extra = pager->alloc();
+        pager->rollback();
+        assert(!pager->in_transaction());
+        for (uint32_t no : pages) assert(pager->get(no).data[0] == 1);
+        assert(pager->alloc() == extra); // allocation counter rolled back too
+        pager->flush();
+        pager.reset();
+        pager = open();
+        for (uint32_t no : pages) assert(pager->get(no).data[0] == 1);
+        // committed transactions persist
+        pager->begin();
+        for (uint32_t no : pages) {
+            auto& pg = pager->get(no);
+            pg.data[0] = 3;
+            pager->mark_dirty(pg);
+        }
+        pager->flush();
+        pager.reset();
+        pager = open();
+        for (uint32_t no : pages) assert(pager->get(no).data[0] == 3);
+    }
+    std::remove(tx_path);
+    std::remove(tx_wal);
+
+    // freed pages are reused before the file grows, nearest-first, and the
+    // free list survives a reopen and rolls back with its transaction
+    const char* fl_path = "pager_freelist_test.db";
+    std::remove(fl_path);
+    {
+        tinydb::Pager pager(std::make_unique<tinydb::FileStorage>(fl_path), 16);
+        std::vector<uint32_t> pages;
+        for (int i = 0; i < 1100; ++i) pages.push_back(pager.alloc());
+        for (int i = 0; i < 1100; i += 2) pager.free(pages[i]);
+        assert(pager.free_count() == 550);
+        uint32_t reused = pager.alloc(pages[701]);
+        assert(reused == pages[700] || reused == pages[702]);
+        auto& pg = pager.get(reused);
+        for (uint8_t b : pg.data) assert(b == 0);
+        pager.flush();
+    }
+    {
+        tinydb::Pager pager(std::make_unique<tinydb::FileStorage>(fl_path), 16);
+        assert(pager.free_count() == 549);
+        pager.begin();
+        uint32_t a = pager.alloc();
+        assert(a < 1102);
+        pager.rollback();
+        assert(pager.free_count() == 549);
+        for (int i = 0; i < 549; ++i) assert(pager.alloc() < 1102);
+        assert(pager.free_count() == 0);
+        assert(pager.alloc() == 1102); // only now does the file grow
+    }
+    std::remove(fl_path);
     return 0;
 }
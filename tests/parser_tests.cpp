@@ -1,5 +1,7 @@
 #include "tinydb/parser.hpp"
+#include "tinydb/ast.hpp"
 #include <cassert>
+#include <vector>
 
 int main() {
     using namespace tinydb;
@@ -8,8 +10,104 @@ int main() {
     auto n3 = parse("SELECT * FROM t WHERE rowid=1");
     assert(dynamic_cast<ASTCreate*>(n1.get()));
     assert(dynamic_cast<ASTInsert*>(n2.get()));
+    auto n2b = parse("INSERT INTO t VALUES(-12, 3.25, null)");
+    auto lit = dynamic_cast<ASTInsert*>(n2b.get());
+    assert(lit && lit->values.size() == 3);
+    assert(lit->values[0] == "-12" && lit->values[1] == "3.25" && lit->values[2] == "NULL");
+    auto n2c = parse("INSERT INTO t VALUES(?, :x, ?5, :x)");
+    auto ph = dynamic_cast<ASTInsert*>(n2c.get());
+    assert(ph && ph->params.size() == 5 && ph->params[1] == "x");
+    assert(ph->values[0] == "?1" && ph->values[1] == "?2" && ph->values[2] == "?5" && ph->values[3] == "?2");
+    auto n2d = parse("SELECT * FROM t WHERE rowid = :id");
+    auto ps = dynamic_cast<ASTSelect*>(n2d.get());
+    assert(ps && ps->where && ps->where->kind == Expr::Cmp && ps->where->op == Expr::EQ);
+    assert(ps->where->lhs.column && ps->where->lhs.text == "rowid" && ps->where->rhs.text == "?1");
     auto s = dynamic_cast<ASTSelect*>(n3.get());
-    assert(s && s->where_rowid && s->rowid==1);
+    assert(s && s->where && !s->where->rhs.column && s->where->rhs.text == "1");
     assert(!parse("BAD SQL"));
+    auto n1b = parse("create index t_ab ON t (a, b)");
+    auto ci = dynamic_cast<ASTCreateIndex*>(n1b.get());
+    assert(ci && ci->name == "t_ab" && ci->table == "t" && ci->cols == (std::vector<std::string>{"a", "b"}));
+    assert(!parse("CREATE INDEX t_a ON t()") && !parse("CREATE INDEX ON t(a)") && !parse("CREATE INDEX i ON t(a) x"));
+    auto n4 = parse("BEGIN");
+    auto n5 = parse("commit transaction");
+    auto n6 = parse("ROLLBACK");
+    auto b = dynamic_cast<ASTTransaction*>(n4.get());
+    assert(b && b->kind == ASTTransaction::Begin);
+    auto c = dynamic_cast<ASTTransaction*>(n5.get());
+    assert(c && c->kind == ASTTransaction::Commit);
+    auto r = dynamic_cast<ASTTransaction*>(n6.get());
+    assert(r && r->kind == ASTTransaction::Rollback);
+    assert(!parse("BEGIN nonsense"));
+    auto n7 = parse("DELETE FROM t WHERE rowid BETWEEN 3 AND 9 AND rowid < 8");
+    auto d = dynamic_cast<ASTDelete*>(n7.get());
+    std::vector<const Expr*> rest;
+    RowidRange dr = rowid_range(d ? d->where.get() : nullptr, rest);
+    assert(d && d->table == "t" && dr.has_lo && dr.lo == 3);
+    assert(dr.has_hi && dr.hi == 7 && rest.empty());
+    auto n8 = parse("DELETE FROM t");
+    auto d2 = dynamic_cast<ASTDelete*>(n8.get());
+    assert(d2 && !d2->where);
+    auto n9 = parse("UPDATE t SET b = 'y', a=4 WHERE rowid > 2");
+    auto u = dynamic_cast<ASTUpdate*>(n9.get());
+    assert(u && u->sets.size() == 2 && u->sets[0].second == "'y'" && u->sets[1].first == "a");
+    RowidRange ur = rowid_range(u->where.get(), rest);
+    assert(ur.has_lo && ur.lo == 3 && !ur.has_hi && rest.empty());
+    assert(!parse("UPDATE t SET WHERE rowid=1"));
+    assert(!parse("DELETE FROM t WHERE a"));
+    assert(!parse("DELETE FROM t WHERE (a = 1"));
+    assert(!parse("SELECT * FROM t WHERE a = 1 orb = 2"));
+
+    // aggregates in the select list and GROUP BY
+    auto g1 = parse("SELECT a, count(*), SUM(b), max (c) FROM t WHERE b > 1 GROUP BY a, d");
+    auto gs = dynamic_cast<ASTSelect*>(g1.get());
+    assert(gs && gs->cols == (std::vector<std::string>{"a", "*", "b", "c"}) && gs->where);
+    assert(gs->aggs == (std::vector<AggFn>{AggFn::None, AggFn::Count, AggFn::Sum, AggFn::Max}));
+    assert(gs->group_by == (std::vector<std::string>{"a", "d"}));
+    auto g2 = parse("SELECT count, avg(min) FROM t");
+    auto gs2 = dynamic_cast<ASTSelect*>(g2.get());
+    assert(gs2 && gs2->cols == (std::vector<std::string>{"count", "min"}) && gs2->aggs[1] == AggFn::Avg);
+    auto g3 = parse("SELECT a FROM t GROUP BY a");
+    auto gs3 = dynamic_cast<ASTSelect*>(g3.get());
+    assert(gs3 && gs3->aggs.empty() && gs3->group_by.size() == 1);
+    assert(!parse("SELECT SUM(*) FROM t") && !parse("SELECT COUNT(a FROM t"));
+    assert(!parse("SELECT a FROM t GROUP a") && !parse("SELECT a FROM t GROUP BY"));
+
+    // ORDER BY terms and LIMIT [OFFSET]
+    auto o1 = parse("SELECT a FROM t WHERE a > 1 ORDER BY b DESC, 2, c asc LIMIT ?1 OFFSET 10");
+    auto os = dynamic_cast<ASTSelect*>(o1.get());
+    assert(os && os->order_by.size() == 3 && os->order_by[0] == std::make_pair(std::string("b"), true));
+    assert(os->order_by[1].first == "2" && !os->order_by[1].second && !os->order_by[2].second);
+    assert(os->limit == "?1" && os->offset == "10");
+    auto o2 = parse("SELECT a FROM t GROUP BY a LIMIT 3, 4");
+    auto os2 = dynamic_cast<ASTSelect*>(o2.get());
+    assert(os2 && os2->offset == "3" && os2->limit == "4" && os2->order_by.empty());
+    assert(!parse("SELECT a FROM t ORDER a") && !parse("SELECT a FROM t LIMIT") &&
+           !parse("SELECT a FROM t LIMIT 1 OFFSET") && !parse("SELECT a FROM t LIMIT 1 ORDER BY a"));
+
+    // predicates on any column: AND binds tighter than OR, parentheses
+    // group, and a literal on the left is moved to the right
+    auto w1 = parse("SELECT a FROM t WHERE a >= 2 AND (b = 'x' OR 5 < c) or a != NULL");
+    auto ws = dynamic_cast<ASTSelect*>(w1.get());
+    assert(ws && ws->where->kind == Expr::Or);
+    const Expr& conj = *ws->where->left;
+    assert(conj.kind == Expr::And && conj.left->op == Expr::GE && conj.left->rhs.text == "2");
+    const Expr& alt = *conj.right;
+    assert(alt.kind == Expr::Or && alt.left->rhs.text == "'x'");
+    assert(alt.right->op == Expr::GT && alt.right->lhs.text == "c" && alt.right->rhs.text == "5");
+    assert(ws->where->right->op == Expr::NE && ws->where->right->rhs.text == "NULL");
+    auto w2 = parse("UPDATE t SET a = 1 WHERE b BETWEEN ?1 AND :hi AND rowid <> 4");
+    auto wu = dynamic_cast<ASTUpdate*>(w2.get());
+    assert(wu && wu->params.size() == 2 && wu->params[1] == "hi");
+    rest.clear();
+    RowidRange wr = rowid_range(wu->where.get(), rest);
+    assert(!wr.has_lo && !wr.has_hi && rest.size() == 3); // b >= ?1, b <= ?2, rowid != 4
+
+    // rowid bounds fold into a range; what cannot fold is left to the rows
+    rest.clear();
+    auto w3 = parse("DELETE FROM t WHERE rowid >= ? AND rowid > 10 AND 20 >= ROWID AND a < 3");
+    RowidRange r3 = rowid_range(dynamic_cast<ASTDelete*>(w3.get())->where.get(), rest);
+    assert(r3.has_lo && r3.lo_param == 1 && r3.lo == 0 && r3.has_hi && r3.hi == 20);
+    assert(rest.size() == 2 && rest[0]->rhs.text == "10" && rest[1]->lhs.text == "a");
     return 0;
 }
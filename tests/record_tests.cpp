@@ -1,4 +1,5 @@
 #include "tinydb/record.hpp"
+#include <algorithm>
 #include <cassert>
 #include <limits>
 #include <random>
@@ -37,6 +38,115 @@ int main() {
     assert(out2[1].i == -1);
     assert(out2[2].i == std::numeric_limits<int64_t>::max());
     assert(out2[3].s == big);
+
+    // encoding into a reused buffer matches and shrinks/grows with the row
+    std::string buf;
+    tinydb::encode_row(row2.data(), row2.size(), buf);
+    assert(buf.size() == bytes2.size() && tinydb::row_size(row2.data(), row2.size()) == buf.size());
+    assert(std::equal(buf.begin(), buf.end(), bytes2.begin(),
+                      [](char a, uint8_t b) { return static_cast<uint8_t>(a) == b; }));
+    tinydb::encode_row(row2.data(), 2, buf);
+    auto head = tinydb::decode_row(reinterpret_cast<const uint8_t*>(buf.data()), buf.size());
+    assert(head.size() == 2 && head[1].i == -1);
+
+    // serial types: small signed ints in one body byte, 0/1 in none
+    auto size_of = [](std::vector<Value> r) { return tinydb::encode_row(r).size(); };
+    assert(size_of({{ColTag::INT, -1, {}}}) == 3);
+    assert(size_of({{ColTag::INT, -128, {}}}) == 3);
+    assert(size_of({{ColTag::INT, -129, {}}}) == 4);
+    assert(size_of({{ColTag::INT, 0, {}}, {ColTag::INT, 1, {}}}) == 3);
+    assert(size_of({{ColTag::INT, std::numeric_limits<int64_t>::min(), {}}}) == 10);
+    std::vector<Value> typed{
+        {ColTag::NIL, 0, {}},
+        {ColTag::REAL, 0, {}, {}, -1.5},
+        {ColTag::BLOB, 0, std::string("\0\xff", 2)},
+        {ColTag::TEXT, 0, {}},
+        {ColTag::INT, 1, {}},
+        {ColTag::INT, -40000, {}},
+        {ColTag::INT, int64_t{1} << 40, {}},
+        {ColTag::INT, std::numeric_limits<int64_t>::min(), {}},
+    };
+    auto tbytes = tinydb::encode_row(typed);
+    auto tout = tinydb::decode_row(tbytes.data(), tbytes.size());
+    assert(tout.size() == typed.size());
+    for (size_t i = 0; i < typed.size(); ++i) {
+        assert(tout[i].tag == typed[i].tag);
+        assert(tout[i].i == typed[i].i && tout[i].r == typed[i].r && tout[i].s == typed[i].s);
+    }
+
+    // single columns decode from a prefix that stops before later columns
+    tinydb::RowDecoder dec;
+    Value col;
+    dec.reset(bytes2.data(), 40);
+    assert(dec.columns() == 4);
+    assert(dec.get(2, col) && col.i == std::numeric_limits<int64_t>::max());
+    assert(!dec.get(3, col));
+    assert(dec.need() == bytes2.size());
+    dec.reset(bytes2.data(), bytes2.size());
+    assert(dec.get(3, col) && col.tag == ColTag::TEXT && col.text() == big);
+    assert(col.s.empty()); // borrowed, not copied
+    assert(dec.get(0, col) && col.tag == ColTag::INT && col.i == 0 && col.text().empty());
+    assert(dec.get(7, col) && col.tag == ColTag::INT && col.i == 0); // past the end
+
+    // column-major decoding agrees with the row decoder, strided per column
+    {
+        constexpr size_t N = 12, STRIDE = 3;
+        ColTag tag[N * STRIDE];
+        int64_t ints[N * STRIDE];
+        double reals[N * STRIDE];
+        std::string_view text[N * STRIDE];
+        tinydb::ColumnSink sink{tag + 1, ints + 1, reals + 1, text + 1, STRIDE};
+        assert(tinydb::row_columns(tbytes.data(), tbytes.size()) == typed.size());
+        assert(tinydb::row_columns(tbytes.data(), 1) == SIZE_MAX);
+        assert(tinydb::decode_columns(tbytes.data(), tbytes.size(), N, sink));
+        for (size_t i = 0; i < N; ++i) {
+            size_t at = 1 + i * STRIDE;
+            Value want = i < typed.size() ? typed[i] : Value{};
+            assert(tag[at] == want.tag && ints[at] == want.i && reals[at] == want.r);
+            assert(text[at] == want.text());
+        }
+        assert(!tinydb::decode_columns(bytes2.data(), 40, 4, sink));
+        assert(tinydb::decode_columns(bytes2.data(), 40, 3, sink));
+    }
+    // index keys: bytewise order of the encodings is compare_values()
+    // order, INT and REAL interleaved exactly
+    {
+        std::vector<Value> vals{
+            {ColTag::NIL, 0, {}},
+            {ColTag::INT, std::numeric_limits<int64_t>::min(), {}},
+            {ColTag::INT, -3, {}},
+            {ColTag::INT, 0, {}},
+            {ColTag::INT, 2, {}},
+            {ColTag::INT, std::numeric_limits<int64_t>::max(), {}},
+            {ColTag::TEXT, 0, ""},
+            {ColTag::TEXT, 0, std::string("a\0b", 3)},
+            {ColTag::TEXT, 0, "a"},
+            {ColTag::TEXT, 0, "ab"},
+            {ColTag::BLOB, 0, std::string("\0", 1)},
+            {ColTag::BLOB, 0, "\xff"},
+        };
+        for (double r : {-1e300, -9.3e18, -3.5, -2.75, -0.5, 0.25, 2.0, 2.5, 1e15 + 0.5, 9.3e18, 1e300})
+            vals.push_back(Value{ColTag::REAL, 0, {}, {}, r});
+        auto key = [](const Value& v) { std::string k; tinydb::append_key(v, k); return k; };
+        for (auto& a : vals)
+            for (auto& b : vals) {
+                int c = tinydb::compare_values(a, b), k = key(a).compare(key(b));
+                assert((c < 0) == (k < 0) && (c > 0) == (k > 0));
+            }
+        // an entry gives back each column, type included, and its rowid
+        std::string entry;
+        for (auto& v : vals) tinydb::append_key(v, entry);
+        tinydb::finish_key(vals.data(), vals.size(), -42, entry);
+        assert(tinydb::key_rowid(entry) == -42);
+        for (size_t i = 0; i < vals.size(); ++i) {
+            Value out;
+            assert(tinydb::key_column(entry, vals.size(), i, out));
+            assert(out.tag == vals[i].tag && out.i == vals[i].i && out.r == vals[i].r);
+            assert(out.text() == vals[i].text());
+        }
+        Value out;
+        assert(!tinydb::key_column(entry, vals.size(), vals.size(), out));
+        assert(!tinydb::key_column(entry.substr(0, 20), vals.size(), 3, out));
+    }
     return 0;
 }
-
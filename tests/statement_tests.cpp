@@ -0,0 +1,138 @@
+#include "tinydb/statement.hpp"
+#include "tinydb/storage.hpp"
+#include "tinydb/pager.hpp"
+#include "tinydb/btree.hpp"
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+int main() {
+    using namespace tinydb;
+    std::remove("statement.db");
+    Pager pager(std::make_unique<FileStorage>("statement.db"));
+    BTree bt(pager);
+    Catalog cat(pager, bt);
+    cat.create_table("t", {"a", "b"});
+    VM vm(bt, cat);
+
+    // one compiled INSERT, run with different bindings
+    auto ins = Statement::prepare("INSERT INTO t VALUES(?, :b)", cat);
+    assert(ins && ins->param_count() == 2 && !ins->is_query());
+    assert(ins->param_index("b") == 2 && ins->param_index("nosuch") == 0);
+    assert(!ins->bind(0, Value{}) && !ins->bind(3, Value{}));
+    for (int i = 1; i <= 500; ++i) {
+        ins->reset();
+        assert(ins->bind(1, Value{ColTag::INT, -i, {}}));
+        assert(ins->bind("b", Value{ColTag::TEXT, 0, "v" + std::to_string(i)}));
+        assert(ins->step(vm) == Statement::Step::Done);
+    }
+    ins->reset();
+    ins->clear_bindings();
+    assert(ins->step(vm) == Statement::Step::Done); // unbound: NULLs
+
+    auto sel = Statement::prepare("SELECT a, b FROM t WHERE rowid = ?", cat);
+    assert(sel && sel->is_query());
+    for (int key : {1, 250, 500}) {
+        sel->reset();
+        sel->bind(1, Value{ColTag::INT, key, {}});
+        assert(sel->step(vm) == Statement::Step::Row);
+        assert(sel->row()[0].i == -key && sel->row()[1].text() == "v" + std::to_string(key));
+        assert(sel->step(vm) == Statement::Step::Done);
+    }
+    sel->reset();
+    sel->bind(1, Value{ColTag::INT, 501, {}});
+    assert(sel->step(vm) == Statement::Step::Row);
+    assert(sel->row()[0].tag == ColTag::NIL && sel->row()[1].tag == ColTag::NIL);
+
+    // strict bounds on a placeholder become parameter + offset
+    auto del = Statement::prepare("DELETE FROM t WHERE rowid > ? AND rowid < ?2", cat);
+    assert(del && del->param_count() == 2);
+    del->bind(1, Value{ColTag::INT, 10, {}});
+    del->bind(2, Value{ColTag::INT, 20, {}});
+    assert(del->step(vm) == Statement::Step::Done);
+    auto all = Statement::prepare("SELECT a FROM t", cat);
+    size_t n = 0;
+    while (all->step(vm) == Statement::Step::Row) {
+        assert(all->row()[0].tag == ColTag::NIL || all->row()[0].i > -11 || all->row()[0].i < -19);
+        ++n;
+    }
+    assert(n == 501 - 9);
+    // a second placeholder bound on one side is checked row by row
+    auto head = Statement::prepare("DELETE FROM t WHERE rowid < ? AND rowid < 300", cat);
+    assert(head && head->param_count() == 1);
+    head->bind(1, Value{ColTag::INT, 5, {}});
+    assert(head->step(vm) == Statement::Step::Done);
+    all->reset();
+    for (n = 0; all->step(vm) == Statement::Step::Row; ++n) {}
+    assert(n == 501 - 9 - 4);
+    assert(!Statement::prepare("CREATE TABLE u(a INT)", cat));
+
+    // a paused statement is ended by another program on its VM
+    all->reset();
+    assert(all->step(vm) == Statement::Step::Row);
+    sel->reset();
+    assert(sel->step(vm) == Statement::Step::Row);
+    assert(all->step(vm) == Statement::Step::Error);
+    all->reset();
+    assert(all->step(vm) == Statement::Step::Row);
+
+    // placeholder rowid bounds: NULL (or unbound) matches nothing, REAL
+    // rounds inward, TEXT orders after every number, and a strict bound
+    // past the end of the INT range is empty
+    {
+        cat.create_table("r", {"a"});
+        auto fill = Statement::prepare("INSERT INTO r VALUES(?)", cat);
+        for (int i = 1; i <= 5; ++i) {
+            fill->reset();
+            fill->bind(1, Value{ColTag::INT, i, {}});
+            assert(fill->step(vm) == Statement::Step::Done);
+        }
+        auto count = [&](const char* sql, const Value* v) {
+            auto st = Statement::prepare(sql, cat);
+            assert(st);
+            if (v) st->bind(1, *v);
+            size_t rows = 0;
+            while (st->step(vm) == Statement::Step::Row) ++rows;
+            return rows;
+        };
+        Value nil{ColTag::NIL, 0, {}}, real{ColTag::REAL, 0, {}, {}, 4.5}, text{ColTag::TEXT, 0, "x"};
+        Value max{ColTag::INT, INT64_MAX, {}}, min{ColTag::INT, INT64_MIN, {}};
+        assert(count("SELECT * FROM r WHERE rowid >= ?", nullptr) == 0);
+        assert(count("SELECT * FROM r WHERE rowid <= ?", &nil) == 0);
+        assert(count("SELECT * FROM r WHERE rowid >= ?", &real) == 1);
+        assert(count("SELECT * FROM r WHERE rowid > ?", &real) == 1);
+        assert(count("SELECT * FROM r WHERE rowid <= ?", &real) == 4);
+        assert(count("SELECT * FROM r WHERE rowid < ?", &real) == 4);
+        assert(count("SELECT * FROM r WHERE rowid = ?", &real) == 0);
+        assert(count("SELECT * FROM r WHERE rowid >= ?", &text) == 0);
+        assert(count("SELECT * FROM r WHERE rowid < ?", &text) == 5);
+        assert(count("SELECT * FROM r WHERE rowid > ?", &max) == 0);
+        assert(count("SELECT * FROM r WHERE rowid < ?", &min) == 0);
+        assert(count("SELECT * FROM r WHERE rowid >= ?", &min) == 5);
+        assert(count("DELETE FROM r WHERE rowid >= ?", nullptr) == 0);
+        assert(count("DELETE FROM r WHERE rowid <= ?", &nil) == 0);
+        assert(count("DELETE FROM r WHERE rowid > ?", &max) == 0);
+        assert(count("SELECT * FROM r", nullptr) == 5);
+        assert(count("DELETE FROM r WHERE rowid >= ?", &real) == 0);
+        assert(count("SELECT * FROM r", nullptr) == 4);
+        assert(count("DELETE FROM r WHERE rowid < ?", &text) == 0);
+        assert(count("SELECT * FROM r", nullptr) == 0);
+    }
+
+    // cache: hits skip compilation, schema changes and LRU evict
+    StatementCache cache(2);
+    assert(!cache.find("SELECT * FROM u", cat));
+    Statement* miss = cache.insert("SELECT * FROM u", Statement::prepare("SELECT * FROM u", cat));
+    assert(cache.find("SELECT * FROM u", cat) == miss);
+    cat.create_table("u", {"x"});
+    assert(!cache.find("SELECT * FROM u", cat) && cache.size() == 0);
+    cache.insert("a", Statement::prepare("SELECT * FROM t", cat));
+    cache.insert("b", Statement::prepare("SELECT * FROM u", cat));
+    assert(cache.find("a", cat));
+    cache.insert("c", Statement::prepare("SELECT * FROM u", cat));
+    assert(cache.size() == 2 && cache.find("a", cat) && !cache.find("b", cat));
+    pager.flush();
+    return 0;
+}
@@ -19,6 +19,31 @@ int main() {
         assert(used == enc.size());
         assert(dec == v);
     }
+    // in-place encoding at the 1/2/3-byte boundaries and into a buffer
+    for (uint64_t v : {0ull, 127ull, 128ull, 16383ull, 16384ull, ~0ull}) {
+        uint8_t buf[tinydb::MAX_VARINT + 1];
+        buf[tinydb::MAX_VARINT] = 0xAA;
+        size_t n = tinydb::encode_varint(v, buf);
+        assert(n == tinydb::varint_size(v));
+        assert(n == tinydb::encode_varint(v).size());
+        assert(buf[tinydb::MAX_VARINT] == 0xAA);
+        auto [dec, used] = tinydb::decode_varint(buf, n);
+        assert(used == n && dec == v);
+        // decoding with trailing bytes available takes the unrolled path
+        auto [dec2, used2] = tinydb::decode_varint(buf, sizeof(buf));
+        assert(used2 == n && dec2 == v);
+    }
+    assert(tinydb::varint_size(127) == 1 && tinydb::varint_size(128) == 2);
+    assert(tinydb::varint_size(~0ull) == tinydb::MAX_VARINT);
+    // a truncated varint reports every byte consumed, still continued
+    {
+        uint8_t buf[tinydb::MAX_VARINT];
+        size_t n = tinydb::encode_varint(300, buf);
+        auto [dec, used] = tinydb::decode_varint(buf, n - 1);
+        (void)dec;
+        assert(used == n - 1 && (buf[used - 1] & 0x80));
+        assert(tinydb::decode_varint(buf, 0).second == 0);
+    }
     return 0;
 }
 
@@ -6,10 +6,15 @@
 #include "tinydb/btree.hpp"
 #include "tinydb/vm.hpp"
 #include <cassert>
+#include <cstdint>
+#include <cstdio>
 #include <memory>
+#include <string>
+#include <vector>
 
 int main() {
     using namespace tinydb;
+    std::remove("vm.db");
     Pager pager(std::make_unique<FileStorage>("vm.db"));
     BTree bt(pager);
     Catalog cat(pager, bt);
@@ -25,5 +30,124 @@ int main() {
     assert(vm.results()[0][0].i == 1);
     assert(vm.results()[0][1].s == "x");
     pager.flush();
+
+    // rowids continue from the table's maximum after reopening
+    {
+        Pager pager2(std::make_unique<FileStorage>("vm.db"));
+        BTree bt2(pager2);
+        Catalog cat2(pager2, bt2);
+        VM vm2(bt2, cat2);
+        vm2.run(codegen(*parse("INSERT INTO t VALUES(2,'y')"), cat2));
+        vm2.run(codegen(*parse("SELECT * FROM t"), cat2));
+        assert(vm2.results().size() == 2);
+        assert(vm2.results()[0][1].s == "x");
+        assert(vm2.results()[1][1].s == "y");
+    }
+
+    // Delete inside a scan removes the row under the cursor and Next
+    // continues with the row after it
+    {
+        cat.create_table("d");
+        uint32_t root = cat.lookup("d")->root;
+        for (int i = 0; i < 500; ++i)
+            vm.run(codegen(*parse("INSERT INTO d VALUES(" + std::to_string(i) + ")"), cat));
+        Program prog{{
+            {Op::OpenWrite,0,static_cast<int>(root),0},
+            {Op::Rewind,0,4,0},
+            {Op::Delete,0,0,0},
+            {Op::Next,0,2,0},
+            {Op::Halt,0,0,0},
+        }, {}, 0, 1};
+        assert(vm.run(prog) == 0);
+        vm.run(codegen(*parse("SELECT * FROM d"), cat));
+        assert(vm.results().empty());
+        assert(bt.check(root));
+    }
+
+    // step() pauses at each ResultRow with the cursor still open
+    {
+        cat.create_table("s");
+        for (int i = 0; i < 3000; ++i)
+            vm.run(codegen(*parse("INSERT INTO s VALUES(" + std::to_string(i) + ",'r')"), cat));
+        auto scan = codegen(*parse("SELECT * FROM s"), cat);
+        size_t base = pager.pinned();
+        vm.start(scan);
+        for (int i = 0; i < 3000; ++i) {
+            assert(vm.step() == StepResult::Row);
+            assert(vm.running(scan) && pager.pinned() == base + 1);
+            assert(vm.row()[0].i == i && vm.row()[1].text() == "r");
+        }
+        assert(vm.step() == StepResult::Done && !vm.running(scan));
+        assert(pager.pinned() == base);
+        // abandoning a paused scan releases its cursor
+        vm.start(scan);
+        assert(vm.step() == StepResult::Row);
+        vm.abort();
+        assert(pager.pinned() == base && vm.step() == StepResult::Done);
+    }
+
+    // scans run a leaf at a time through the batch ops; rows of any width,
+    // including ones continued on overflow pages, come out as inserted
+    {
+        cat.create_table("b", {"k", "v"});
+        auto scan = codegen(*parse("SELECT * FROM b"), cat);
+        bool batched = false;
+        for (auto& in : scan.code) batched |= in.op == Op::BatchLoad;
+        assert(batched);
+        std::string big(9000, 'z');
+        for (int i = 0; i < 2000; ++i) {
+            std::string v = i % 300 == 7 ? big : "v" + std::to_string(i);
+            std::string extra = i % 5 == 0 ? ", 2.5" : "";
+            vm.run(codegen(*parse("INSERT INTO b VALUES(" + std::to_string(i) + ", '" + v + "'" + extra + ")"), cat));
+        }
+        vm.run(scan);
+        assert(vm.results().size() == 2000);
+        for (int i = 0; i < 2000; ++i) {
+            auto& r = vm.results()[i];
+            assert(r.size() == (i % 5 == 0 ? 3u : 2u));
+            assert(r[0].i == i);
+            assert(r[1].s == (i % 300 == 7 ? big : "v" + std::to_string(i)));
+            if (r.size() == 3) assert(r[2].tag == ColTag::REAL && r[2].r == 2.5);
+        }
+        vm.run(codegen(*parse("SELECT k FROM b"), cat));
+        assert(vm.results().size() == 2000 && vm.results()[1999].size() == 1);
+        assert(vm.results()[1999][0].i == 1999);
+    }
+
+    // a whole row read after a wider one leaves none of the wider row's
+    // columns behind, whether it is returned, sorted or rewritten
+    {
+        cat.create_table("w", {"k", "v"});
+        vm.run(codegen(*parse("INSERT INTO w VALUES(1, 'x', 2.5)"), cat));
+        vm.run(codegen(*parse("INSERT INTO w VALUES(2)"), cat));
+        vm.run(codegen(*parse("INSERT INTO w VALUES(3, 'y')"), cat));
+        vm.run(codegen(*parse("SELECT * FROM w WHERE k > 0"), cat));
+        assert(vm.results().size() == 3);
+        assert(vm.results()[0].size() == 3 && vm.results()[1].size() == 1 && vm.results()[2].size() == 2);
+        vm.run(codegen(*parse("SELECT * FROM w ORDER BY 1 DESC"), cat));
+        assert(vm.results().size() == 3);
+        assert(vm.results()[0].size() == 2 && vm.results()[1].size() == 1 && vm.results()[2].size() == 3);
+        assert(vm.results()[0][1].s == "y" && vm.results()[2][2].r == 2.5);
+        vm.run(codegen(*parse("UPDATE w SET k = 7 WHERE k = 2"), cat));
+        vm.run(codegen(*parse("SELECT * FROM w WHERE k = 7"), cat));
+        assert(vm.results().size() == 1 && vm.results()[0].size() == 2);
+        assert(vm.results()[0][1].tag == ColTag::INT && vm.results()[0][1].i == 0);
+    }
+
+    // AddImm stays INT while the sum fits and goes on as REAL past that
+    {
+        Program prog{{
+            {Op::Constant,0,0,0},
+            {Op::AddImm,0,-1,0},
+            {Op::Copy,0,1,0},
+            {Op::AddImm,1,2,0},
+            {Op::ResultRow,0,2,0},
+            {Op::Halt,0,0,0},
+        }, {Value{ColTag::INT, INT64_MAX, {}}}, 2, 0};
+        assert(vm.run(prog) == 0 && vm.results().size() == 1);
+        auto& r = vm.results()[0];
+        assert(r[0].tag == ColTag::INT && r[0].i == INT64_MAX - 1);
+        assert(r[1].tag == ColTag::REAL && r[1].r == 9223372036854775808.0);
+    }
     return 0;
 }
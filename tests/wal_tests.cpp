@@ -0,0 +1,110 @@
+#include "tinydb/wal.hpp"
+#include "tinydb/pager.hpp"
+#include "tinydb/storage.hpp"
+#include <array>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+namespace {
+std::array<uint8_t, tinydb::PAGE_SIZE> filled(uint8_t v) {
+    std::array<uint8_t, tinydb::PAGE_SIZE> p;
+    p.fill(v);
+    return p;
+}
+} // namespace
+
+int main() {
+    using namespace tinydb;
+    const char* log_path = "wal_test.db-wal";
+    const char* db_path = "wal_test.db";
+    std::remove(log_path);
+    std::remove(db_path);
+
+    // only frames up to the last commit survive a reopen
+    auto a = filled(1), b = filled(2), c = filled(3);
+    {
+        Wal wal(std::make_unique<FileStorage>(log_path));
+        wal.append({{2, a.data()}, {3, b.data()}}, true, 3);
+        wal.append({{2, c.data()}}, false, 0);
+        uint8_t buf[PAGE_SIZE];
+        assert(wal.read(2, buf) && buf[0] == 3); // own pending frame is visible
+        assert(wal.has_pending());
+    }
+    {
+        Wal wal(std::make_unique<FileStorage>(log_path));
+        uint8_t buf[PAGE_SIZE];
+        assert(wal.frames() == 2);
+        assert(wal.read(2, buf) && buf[0] == 1);
+        assert(wal.read(3, buf) && buf[0] == 2);
+        assert(!wal.read(4, buf));
+        wal.append({{4, c.data()}}, true, 4);
+    }
+
+    // a torn frame ends replay at the previous commit
+    {
+        FileStorage log(log_path);
+        uint8_t junk = 0xFF;
+        log.write(32 + 2 * (24 + PAGE_SIZE) + 24 + 100, &junk, 1);
+    }
+    {
+        Wal wal(std::make_unique<FileStorage>(log_path));
+        uint8_t buf[PAGE_SIZE];
+        assert(wal.frames() == 2);
+        assert(!wal.read(4, buf));
+        // checkpoint copies committed pages into the database file
+        FileStorage db(db_path);
+        wal.checkpoint(db);
+        assert(wal.frames() == 0 && !wal.read(2, buf));
+        db.read(PAGE_SIZE, buf, PAGE_SIZE);
+        assert(buf[0] == 1 && buf[PAGE_SIZE - 1] == 1);
+        db.read(2 * PAGE_SIZE, buf, PAGE_SIZE);
+        assert(buf[0] == 2);
+    }
+    std::remove(log_path);
+    std::remove(db_path);
+
+    // Pager in WAL mode: the database file only changes at checkpoints
+    uint32_t pgno = 0;
+    {
+        Pager pager(std::make_unique<FileStorage>(db_path), 16,
+                    std::make_unique<FileStorage>(log_path));
+        pgno = pager.alloc();
+        Page& pg = pager.get(pgno);
+        std::memcpy(pg.data.data(), "walpage", 7);
+        pager.mark_dirty(pg);
+        pager.flush();
+        // spill far more dirty pages than the pool holds, then commit
+        for (int i = 0; i < 100; ++i) {
+            uint32_t no = pager.alloc();
+            Page& p = pager.get(no);
+            std::memcpy(p.data.data(), &no, sizeof(no));
+            pager.mark_dirty(p);
+        }
+        pager.flush();
+        FileStorage raw(db_path);
+        uint8_t buf[PAGE_SIZE];
+        raw.read(static_cast<uint64_t>(pgno - 1) * PAGE_SIZE, buf, PAGE_SIZE);
+        assert(std::memcmp(buf, "walpage", 7) != 0);
+        // a second pager recovers the committed state from the log alone
+        Pager reader(std::make_unique<FileStorage>(db_path), 16,
+                     std::make_unique<FileStorage>(log_path));
+        assert(std::memcmp(reader.get(pgno).data.data(), "walpage", 7) == 0);
+        for (uint32_t no = pgno + 1; no <= pgno + 100; ++no) {
+            uint32_t v = 0;
+            std::memcpy(&v, reader.get(no).data.data(), sizeof(v));
+            assert(v == no);
+        }
+        pager.checkpoint();
+        raw.read(static_cast<uint64_t>(pgno - 1) * PAGE_SIZE, buf, PAGE_SIZE);
+        assert(std::memcmp(buf, "walpage", 7) == 0);
+    }
+    {
+        Pager pager(std::make_unique<FileStorage>(db_path));
+        assert(std::memcmp(pager.get(pgno).data.data(), "walpage", 7) == 0);
+    }
+    std::remove(log_path);
+    std::remove(db_path);
+    return 0;
+}
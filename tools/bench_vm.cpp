@@ -0,0 +1,89 @@
+// Interpreter dispatch cost. Runs a two-instruction counting loop
+// (AddImm, Ge) on a VM with no database, then a column scan, and reports
+// nanoseconds per executed instruction / per row. Build once as is and
+// once with -DTINYDB_NO_COMPUTED_GOTO to compare threaded and switch
+// dispatch.
+#include "tinydb/btree.hpp"
+#include "tinydb/catalog.hpp"
+#include "tinydb/codegen.hpp"
+#include "tinydb/pager.hpp"
+#include "tinydb/parser.hpp"
+#include "tinydb/storage.hpp"
+#include "tinydb/vm.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+using namespace tinydb;
+
+namespace {
+double seconds_since(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+}
+
+int main(int argc, char** argv) {
+    long iters = argc > 1 ? std::atol(argv[1]) : 100000000L;
+    long rows = argc > 2 ? std::atol(argv[2]) : 200000L;
+#if defined(__GNUC__) && !defined(TINYDB_NO_COMPUTED_GOTO)
+    std::printf("dispatch: computed goto\n");
+#else
+    std::printf("dispatch: switch\n");
+#endif
+
+    // r0 = 0; r1 = iters; do r0 += 1 until r0 >= r1
+    Program loop{{
+        {Op::Integer, 0, 0, 0},
+        {Op::Integer, static_cast<int>(iters), 1, 0},
+        {Op::AddImm, 0, 1, 0},
+        {Op::Ge, 0, 2, 1},
+        {Op::Halt, 0, 0, 0},
+    }, {}, 2, 0};
+    VM bare;
+    auto t0 = std::chrono::steady_clock::now();
+    bare.run(loop);
+    double s = seconds_since(t0);
+    double executed = 2.0 * static_cast<double>(iters) + 3;
+    std::printf("loop: %.0f instructions in %.3f s, %.2f ns/instruction\n",
+                executed, s, s * 1e9 / executed);
+
+    const char* path = "bench_vm.db";
+    std::remove(path);
+    {
+        Pager pager(std::make_unique<FileStorage>(path));
+        BTree bt(pager);
+        Catalog cat(pager, bt);
+        cat.create_table("t", {"a", "b", "c"});
+        VM vm(bt, cat);
+        auto ins = codegen(*parse("INSERT INTO t VALUES(?, 'text', 2.5)"), cat);
+        std::vector<Value> params(1);
+        for (long i = 0; i < rows; ++i) {
+            params[0] = Value{ColTag::INT, i, {}};
+            vm.run(ins, &params);
+        }
+        auto scan = codegen(*parse("SELECT a, c FROM t"), cat);
+        // Best of several passes, so the first one's page faults and
+        // pool misses do not dominate.
+        long n = 0;
+        int64_t sum = 0;
+        s = 1e9;
+        for (int pass = 0; pass < 5; ++pass) {
+            t0 = std::chrono::steady_clock::now();
+            vm.start(scan);
+            n = 0;
+            sum = 0;
+            while (vm.step() == StepResult::Row) {
+                sum += vm.row()[0].i;
+                ++n;
+            }
+            s = std::min(s, seconds_since(t0));
+        }
+        std::printf("scan: %ld rows in %.3f s, %.1f ns/row (checksum %lld)\n",
+                    n, s, s * 1e9 / static_cast<double>(n), static_cast<long long>(sum));
+    }
+    std::remove(path);
+    return 0;
+}